@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+// 有界无锁环形队列，多生产者多消费者（Dmitry Vyukov的算法）。
+// 每个槽带一个序号：生产者和消费者各自用CAS推进自己的位置，再通过槽的序号交接数据，
+// 不需要互斥锁，也不分配内存。容量向上取整到2的幂。T应当是便宜可移动的类型（如指针或下标）。
+template<typename T>
+class BoundedRing
+{
+public:
+    explicit BoundedRing(std::size_t minCapacity)
+    {
+        if (minCapacity == 0 || minCapacity > (SIZE_MAX >> 2))
+            throw std::domain_error("Ring capacity out of range");
+        std::size_t capacity = 1;
+        while (capacity < minCapacity)
+            capacity <<= 1;
+        cells = std::make_unique<Cell[]>(capacity);
+        mask = capacity - 1;
+        for (std::size_t i = 0; i < capacity; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedRing(const BoundedRing&) = delete;
+    BoundedRing& operator=(const BoundedRing&) = delete;
+
+    // 队列满时返回false
+    bool tryPush(T value)
+    {
+        std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = cells[pos & mask];
+            const std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // 队列空时返回false
+    bool tryPop(T& value)
+    {
+        std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = cells[pos & mask];
+            const std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+    // 近似的元素个数，只用于统计
+    std::size_t sizeApprox() const
+    {
+        const std::size_t head = dequeuePos.load(std::memory_order_relaxed);
+        const std::size_t tail = enqueuePos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    // 生产者和消费者的位置各占一个缓存行，避免伪共享。
+    // 用填充数组而不是alignas，避免MSVC的C4324（对齐导致结构体填充）警告
+    static constexpr std::size_t kCacheLine = 64;
+
+    std::unique_ptr<Cell[]> cells;
+    std::size_t mask = 0;
+    char pad0[kCacheLine];
+    std::atomic<std::size_t> enqueuePos{ 0 };
+    char pad1[kCacheLine - sizeof(std::atomic<std::size_t>)];
+    std::atomic<std::size_t> dequeuePos{ 0 };
+    char pad2[kCacheLine - sizeof(std::atomic<std::size_t>)];
+};
@@ -1,4 +1,6 @@
 #include "wirehair.h"
+#include "qrcode_compression.hpp"
+#include "qrcode_stream_frame.hpp"
 #include <stdexcept>
 #include <print>
 #include <vector>
@@ -22,6 +24,13 @@ void initWirehair()
     }();
 }
 
+// 解帧用的缓冲区，重复使用避免每个二维码都分配一次
+std::vector<uint8_t>& frameScratch()
+{
+    static std::vector<uint8_t> block;
+    return block;
+}
+
 extern "C" {
 
 EXPORT
@@ -45,6 +54,85 @@ WirehairResult decode(WirehairCodec decoder, unsigned blockId, const void* block
     return wirehair_decode(decoder, blockId, blockData, blockSize);
 }
 
+// 解开一个二维码的载荷（封装自动识别）并校验CRC，块头写到outHeader[0..10]：
+// blockId、sessionId、hasSizes、messageBytes（分片字节数）、blockBytes、configHash、chunkIndex、chunkCount、
+// fileBytes的低32位、fileBytes的高32位、compression（Compression的值）。
+// hasSizes为0时尺寸（messageBytes、blockBytes、chunkCount、fileBytes）无效。
+// 格式不对或CRC不符时返回0
+EXPORT
+int parseFrameHeader(const uint8_t* payload, uint32_t payloadSize, uint32_t* outHeader)
+{
+    std::vector<uint8_t>& block = frameScratch();
+    qrstream::BlockHeader header;
+    size_t headerLen = 0;
+    if (!qrstream::decodePayload(payload, payloadSize, block) ||
+            !qrstream::readBlock(block.data(), block.size(), header, headerLen))
+        return 0;
+    outHeader[0] = header.blockId;
+    outHeader[1] = header.sessionId;
+    outHeader[2] = header.hasSizes ? 1 : 0;
+    outHeader[3] = header.messageBytes;
+    outHeader[4] = header.blockBytes;
+    outHeader[5] = header.configHash;
+    outHeader[6] = header.chunkIndex;
+    outHeader[7] = header.chunkCount;
+    outHeader[8] = static_cast<uint32_t>(header.fileBytes);
+    outHeader[9] = static_cast<uint32_t>(header.fileBytes >> 32);
+    outHeader[10] = static_cast<uint32_t>(header.compression);
+    return 1;
+}
+
+// 核对parseFrameHeader写出的带完整尺寸的块头（header同outHeader）里的尺寸，见qrstream::validBlockSizes。
+// sessionChunkCount为0表示会话还没开始，这时多个分片的最后一片也返回0：推不出普通分片的大小，丢掉它等别的块。
+// 否则sessionChunkBytes是普通分片的字节数，其余是会话的分片数、文件和块的字节数。
+// 返回1时才能按块头的尺寸分配文件缓冲区、创建解码器
+EXPORT
+int validateBlockSizes(const uint32_t* header, uint32_t sessionChunkCount, uint64_t sessionFileBytes,
+        uint64_t sessionChunkBytes, uint32_t sessionBlockBytes)
+{
+    qrstream::BlockHeader parsed;
+    parsed.hasSizes = header[2] != 0;
+    parsed.messageBytes = header[3];
+    parsed.blockBytes = header[4];
+    parsed.chunkIndex = header[6];
+    parsed.chunkCount = header[7];
+    parsed.fileBytes = header[8] | static_cast<uint64_t>(header[9]) << 32;
+    if (!parsed.hasSizes)
+        return 0;
+    if (sessionChunkCount == 0)
+    {
+        if (parsed.chunkCount > 1 && parsed.chunkIndex + 1 == parsed.chunkCount)
+            return 0;
+        return qrstream::validBlockSizes(parsed, nullptr) ? 1 : 0;
+    }
+    const qrstream::SessionSizes session{ sessionChunkCount, sessionFileBytes, sessionChunkBytes, sessionBlockBytes };
+    return qrstream::validBlockSizes(parsed, &session) ? 1 : 0;
+}
+
+// 解开一个二维码的载荷并交给decoder。载荷格式不对、CRC不符，或者会话id、分片序号、配置哈希与decoder对应的
+// 不一致时返回Wirehair_InvalidInput，不做wirehair解码
+EXPORT
+WirehairResult decodeFrame(WirehairCodec decoder, uint32_t sessionId, uint32_t chunkIndex, uint32_t configHash,
+        const uint8_t* payload, uint32_t payloadSize)
+{
+    std::vector<uint8_t>& block = frameScratch();
+    qrstream::BlockHeader header;
+    size_t headerLen = 0;
+    if (!qrstream::decodePayload(payload, payloadSize, block) ||
+            !qrstream::readBlock(block.data(), block.size(), header, headerLen) || header.sessionId != sessionId ||
+            header.chunkIndex != chunkIndex || header.configHash != configHash)
+        return Wirehair_InvalidInput;
+    return wirehair_decode(decoder, header.blockId, block.data() + headerLen,
+            static_cast<uint32_t>(block.size() - headerLen - qrstream::kBlockCrcBytes));
+}
+
+// 分片在文件里的起始位置
+EXPORT
+uint64_t getChunkOffset(uint32_t chunkIndex, uint32_t chunkCount, uint64_t fileBytes, uint32_t chunkBytes)
+{
+    return qrstream::chunkOffset(chunkIndex, chunkCount, fileBytes, chunkBytes);
+}
+
 EXPORT
 uint8_t* getDecodedData(WirehairCodec decoder, uint64_t size)
 {
@@ -61,6 +149,45 @@ uint8_t* getDecodedData(WirehairCodec decoder, uint64_t size)
     return data;
 }
 
+// 流式解压器和它的输出缓冲区
+struct Decompressor
+{
+    qrstream::StreamDecompressor stream;
+    std::vector<uint8_t> output;
+};
+
+EXPORT
+Decompressor* createDecompressor()
+{
+    return new Decompressor;
+}
+
+// 按顺序喂入压缩流的下一段，返回这次解出的数据，字节数写到outSize。
+// 返回的指针在下一次喂入或销毁前有效；流格式不对时返回nullptr
+EXPORT
+const uint8_t* feedDecompressor(Decompressor* decompressor, const uint8_t* data, uint32_t size, uint32_t* outSize)
+{
+    decompressor->output.clear();
+    *outSize = 0;
+    if (!decompressor->stream.feed(data, size, decompressor->output))
+        return nullptr;
+    *outSize = static_cast<uint32_t>(decompressor->output.size());
+    return decompressor->output.data();
+}
+
+// 喂入的压缩流是否正好在帧边界结束，整个流喂完后为0说明流被截断了
+EXPORT
+int decompressorFinished(const Decompressor* decompressor)
+{
+    return decompressor->stream.atFrameBoundary() ? 1 : 0;
+}
+
+EXPORT
+void destroyDecompressor(Decompressor* decompressor)
+{
+    delete decompressor;
+}
+
 EXPORT
 void destroyCoder(WirehairCodec coder) {
     wirehair_free(coder);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// 延迟直方图，按2的幂分桶：第i个桶是[2^i, 2^(i+1))微秒，第0个桶也包括不到1微秒的。
+// record()只做几次原子操作，不加锁，可以在多个线程同时调用；读出的是近似的快照，只用于统计。
+class LatencyHistogram
+{
+public:
+    static constexpr int kBuckets = 24;  // 最后一个桶收下所有不少于2^23微秒（约8.4秒）的
+
+    void record(std::chrono::nanoseconds latency)
+    {
+        const auto nanos = static_cast<std::uint64_t>(std::max<std::int64_t>(latency.count(), 0));
+        const int bucket = std::min(kBuckets - 1, std::max(static_cast<int>(std::bit_width(nanos / 1000)) - 1, 0));
+        buckets[static_cast<std::size_t>(bucket)].fetch_add(1, std::memory_order_relaxed);
+        totalNanos.fetch_add(nanos, std::memory_order_relaxed);
+        std::uint64_t largest = maxNanos.load(std::memory_order_relaxed);
+        while (nanos > largest && !maxNanos.compare_exchange_weak(largest, nanos, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    std::uint64_t count() const
+    {
+        std::uint64_t total = 0;
+        for (const std::atomic<std::uint64_t>& bucket : buckets)
+            total += bucket.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    std::uint64_t bucketCount(int bucket) const
+    {
+        return buckets[static_cast<std::size_t>(bucket)].load(std::memory_order_relaxed);
+    }
+
+    // 第bucket个桶的上界（不含）
+    static std::chrono::microseconds bucketLimit(int bucket)
+    {
+        return std::chrono::microseconds(std::uint64_t(2) << bucket);
+    }
+
+    std::chrono::nanoseconds mean() const
+    {
+        const std::uint64_t n = count();
+        return std::chrono::nanoseconds(n == 0 ? 0 : totalNanos.load(std::memory_order_relaxed) / n);
+    }
+
+    std::chrono::nanoseconds max() const
+    {
+        return std::chrono::nanoseconds(maxNanos.load(std::memory_order_relaxed));
+    }
+
+    // 分位数q（0到1）落在的桶的上界，不超过最大值；没有记录时为0
+    std::chrono::nanoseconds percentile(double q) const
+    {
+        const std::uint64_t n = count();
+        if (n == 0)
+            return std::chrono::nanoseconds(0);
+        const auto rank = static_cast<std::uint64_t>(q * static_cast<double>(n - 1));
+        std::uint64_t seen = 0;
+        int bucket = 0;
+        for (; bucket < kBuckets - 1; bucket++)
+        {
+            seen += bucketCount(bucket);
+            if (seen > rank)
+                break;
+        }
+        return std::min<std::chrono::nanoseconds>(bucketLimit(bucket), max());
+    }
+
+private:
+    std::array<std::atomic<std::uint64_t>, kBuckets> buckets{};
+    std::atomic<std::uint64_t> totalNanos{ 0 };
+    std::atomic<std::uint64_t> maxNanos{ 0 };
+};
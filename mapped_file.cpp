@@ -0,0 +1,105 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Cannot open " + path.string());
+    fileHandle = file;
+
+    LARGE_INTEGER fileSize{};
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        throw std::runtime_error("Cannot map empty file " + path.string());
+    }
+    length = static_cast<std::size_t>(fileSize.QuadPart);
+
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+        throw std::runtime_error("Cannot map " + path.string());
+    }
+    mappingHandle = mapping;
+
+    view = static_cast<const std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (view == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("Cannot map " + path.string());
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    UnmapViewOfFile(view);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + path.string());
+
+    struct stat info{};
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error("Cannot map empty file " + path.string());
+    }
+    length = static_cast<std::size_t>(info.st_size);
+
+    void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        close(fd);
+        throw std::runtime_error("Cannot map " + path.string());
+    }
+    madvise(mapped, length, MADV_SEQUENTIAL);
+    view = static_cast<const std::uint8_t*>(mapped);
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(const_cast<std::uint8_t*>(view), length);
+    close(fd);
+}
+
+#endif
+
+const std::uint8_t* MappedFile::data() const
+{
+    return view;
+}
+
+std::size_t MappedFile::size() const
+{
+    return length;
+}
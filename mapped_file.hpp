@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// 只读映射整个文件。大文件不必读进内存，由系统按需换页，顺序访问时提示系统预读。
+// 打不开、为空或映射失败时构造函数抛出std::runtime_error。
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const std::uint8_t* data() const;
+    std::size_t size() const;
+
+private:
+    const std::uint8_t* view = nullptr;
+    std::size_t length = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;     // HANDLE，避免在头文件里包含windows.h
+    void* mappingHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+};
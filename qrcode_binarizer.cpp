@@ -0,0 +1,464 @@
+#include "qrcode_binarizer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define QRBINARIZER_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QRBINARIZER_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define QRBINARIZER_NEON
+#endif
+
+namespace
+{
+
+constexpr int kBlockSize = QRBinarizer::kBlockSize;
+constexpr int kBlockPixels = kBlockSize * kBlockSize;
+
+std::uint8_t grayScalar(int r, int g, int b)
+{
+    return static_cast<std::uint8_t>((r * 77 + g * 150 + b * 29) >> 8);
+}
+
+// 一块8×8像素的和、最小值、最大值，p是块的左上角，stride是行宽
+void blockStatsScalar(const std::uint8_t* p, int stride, std::uint32_t& sum, std::uint8_t& min, std::uint8_t& max)
+{
+    sum = 0;
+    min = 255;
+    max = 0;
+    for (int y = 0; y < kBlockSize; y++, p += stride)
+    {
+        for (int x = 0; x < kBlockSize; x++)
+        {
+            sum += p[x];
+            min = std::min(min, p[x]);
+            max = std::max(max, p[x]);
+        }
+    }
+}
+
+// count（不超过64）个像素和各自的阈值比较，不超过阈值的为深色，打包成一个字
+std::uint64_t packScalar(const std::uint8_t* gray, const std::uint8_t* thresholds, int count)
+{
+    std::uint64_t word = 0;
+    for (int i = 0; i < count; i++)
+        word |= static_cast<std::uint64_t>(gray[i] <= thresholds[i]) << i;
+    return word;
+}
+
+#if defined(QRBINARIZER_SSE2)
+
+// 把每个64位通道里8个字节的最小值、最大值归约到通道的最低字节：先交换两个32位、再交换16位、最后比较相邻字节
+__m128i laneMin(__m128i v)
+{
+    v = _mm_min_epu8(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_min_epu8(v, _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_min_epu8(v, _mm_srli_epi16(v, 8));
+}
+
+__m128i laneMax(__m128i v)
+{
+    v = _mm_max_epu8(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm_max_epu8(v, _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_max_epu8(v, _mm_srli_epi16(v, 8));
+}
+
+// 4个BGRA像素（每个32位通道一个）转成灰度，结果在各通道的低字节
+__m128i grayFromBgra4(__m128i v)
+{
+    // 分量都小于256、权重都小于256，16位乘法的低16位就是乘积，32位通道的高16位保持为0
+    const __m128i lowByte = _mm_set1_epi32(0xFF);
+    const __m128i b = _mm_mullo_epi16(_mm_and_si128(v, lowByte), _mm_set1_epi32(29));
+    const __m128i g = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(v, 8), lowByte), _mm_set1_epi32(150));
+    const __m128i r = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(v, 16), lowByte), _mm_set1_epi32(77));
+    return _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(b, g), r), 8);
+}
+
+#endif
+
+#if defined(QRBINARIZER_AVX2)
+
+// 和SSE2的版本一样，在每个64位通道里归约
+__m256i laneMin(__m256i v)
+{
+    v = _mm256_min_epu8(v, _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm256_min_epu8(v, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)),
+            _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm256_min_epu8(v, _mm256_srli_epi16(v, 8));
+}
+
+__m256i laneMax(__m256i v)
+{
+    v = _mm256_max_epu8(v, _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    v = _mm256_max_epu8(v, _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)),
+            _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm256_max_epu8(v, _mm256_srli_epi16(v, 8));
+}
+
+// 8个BGRA像素转成灰度，和SSE2的版本一样
+__m256i grayFromBgra8(__m256i v)
+{
+    const __m256i lowByte = _mm256_set1_epi32(0xFF);
+    const __m256i b = _mm256_mullo_epi16(_mm256_and_si256(v, lowByte), _mm256_set1_epi32(29));
+    const __m256i g = _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi32(v, 8), lowByte), _mm256_set1_epi32(150));
+    const __m256i r = _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi32(v, 16), lowByte), _mm256_set1_epi32(77));
+    return _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(b, g), r), 8);
+}
+
+#endif
+
+// 一个块行里每块的像素和、最小值、最大值。rows是块行第一行，最后一块不满8列时取贴着右边的8列
+void blockRowStats(const std::uint8_t* rows, int width, int blocksX, std::uint32_t* sums, std::uint8_t* mins,
+        std::uint8_t* maxs)
+{
+    int bx = 0;
+#if defined(QRBINARIZER_AVX2)
+    // 一次4块：_mm256_sad_epu8把每个64位通道的8个字节加起来，正好是一块的一行
+    for (; (bx + 4) * kBlockSize <= width; bx += 4)
+    {
+        const std::uint8_t* p = rows + bx * kBlockSize;
+        __m256i sum = _mm256_setzero_si256();
+        __m256i min = _mm256_set1_epi8(-1);
+        __m256i max = _mm256_setzero_si256();
+        for (int y = 0; y < kBlockSize; y++, p += width)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            sum = _mm256_add_epi64(sum, _mm256_sad_epu8(v, _mm256_setzero_si256()));
+            min = _mm256_min_epu8(min, v);
+            max = _mm256_max_epu8(max, v);
+        }
+        alignas(32) std::uint64_t laneSums[4];
+        alignas(32) std::uint8_t laneMins[32];
+        alignas(32) std::uint8_t laneMaxs[32];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(laneSums), sum);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(laneMins), laneMin(min));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(laneMaxs), laneMax(max));
+        for (int i = 0; i < 4; i++)
+        {
+            sums[bx + i] = static_cast<std::uint32_t>(laneSums[i]);
+            mins[bx + i] = laneMins[i * 8];
+            maxs[bx + i] = laneMaxs[i * 8];
+        }
+    }
+#elif defined(QRBINARIZER_SSE2)
+    // 一次2块：_mm_sad_epu8把每个64位通道的8个字节加起来，正好是一块的一行
+    for (; (bx + 2) * kBlockSize <= width; bx += 2)
+    {
+        const std::uint8_t* p = rows + bx * kBlockSize;
+        __m128i sum = _mm_setzero_si128();
+        __m128i min = _mm_set1_epi8(-1);
+        __m128i max = _mm_setzero_si128();
+        for (int y = 0; y < kBlockSize; y++, p += width)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            sum = _mm_add_epi64(sum, _mm_sad_epu8(v, _mm_setzero_si128()));
+            min = _mm_min_epu8(min, v);
+            max = _mm_max_epu8(max, v);
+        }
+        min = laneMin(min);
+        max = laneMax(max);
+        sums[bx] = static_cast<std::uint32_t>(_mm_cvtsi128_si32(sum));
+        sums[bx + 1] = static_cast<std::uint32_t>(_mm_extract_epi16(sum, 4));
+        mins[bx] = static_cast<std::uint8_t>(_mm_cvtsi128_si32(min));
+        mins[bx + 1] = static_cast<std::uint8_t>(_mm_extract_epi16(min, 4));
+        maxs[bx] = static_cast<std::uint8_t>(_mm_cvtsi128_si32(max));
+        maxs[bx + 1] = static_cast<std::uint8_t>(_mm_extract_epi16(max, 4));
+    }
+#elif defined(QRBINARIZER_NEON)
+    // 一次2块，前8个字节是一块，后8个字节是另一块
+    for (; (bx + 2) * kBlockSize <= width; bx += 2)
+    {
+        const std::uint8_t* p = rows + bx * kBlockSize;
+        uint16x8_t sum = vdupq_n_u16(0);
+        uint8x16_t min = vdupq_n_u8(255);
+        uint8x16_t max = vdupq_n_u8(0);
+        for (int y = 0; y < kBlockSize; y++, p += width)
+        {
+            const uint8x16_t v = vld1q_u8(p);
+            sum = vpadalq_u8(sum, v);
+            min = vminq_u8(min, v);
+            max = vmaxq_u8(max, v);
+        }
+        const uint64x2_t total = vpaddlq_u32(vpaddlq_u16(sum));
+        // 两两取最小、最大三次后，第0、1个字节分别是两块的结果
+        uint8x8_t laneMin = vpmin_u8(vget_low_u8(min), vget_high_u8(min));
+        laneMin = vpmin_u8(laneMin, laneMin);
+        laneMin = vpmin_u8(laneMin, laneMin);
+        uint8x8_t laneMax = vpmax_u8(vget_low_u8(max), vget_high_u8(max));
+        laneMax = vpmax_u8(laneMax, laneMax);
+        laneMax = vpmax_u8(laneMax, laneMax);
+        sums[bx] = static_cast<std::uint32_t>(vgetq_lane_u64(total, 0));
+        sums[bx + 1] = static_cast<std::uint32_t>(vgetq_lane_u64(total, 1));
+        mins[bx] = vget_lane_u8(laneMin, 0);
+        mins[bx + 1] = vget_lane_u8(laneMin, 1);
+        maxs[bx] = vget_lane_u8(laneMax, 0);
+        maxs[bx + 1] = vget_lane_u8(laneMax, 1);
+    }
+#endif
+    for (; bx < blocksX; bx++)
+        blockStatsScalar(rows + std::min(bx * kBlockSize, width - kBlockSize), width, sums[bx], mins[bx], maxs[bx]);
+}
+
+// 64个像素和各自的阈值比较，打包成一个字
+std::uint64_t pack64(const std::uint8_t* gray, const std::uint8_t* thresholds)
+{
+#if defined(QRBINARIZER_AVX2)
+    std::uint64_t word = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(gray + 32 * i));
+        const __m256i t = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(thresholds + 32 * i));
+        // 无符号的v <= t等价于min(v, t) == v
+        const int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(v, t), v));
+        word |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(mask)) << (32 * i);
+    }
+    return word;
+#elif defined(QRBINARIZER_SSE2)
+    std::uint64_t word = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(gray + 16 * i));
+        const __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(thresholds + 16 * i));
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, t), v));
+        word |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(mask)) << (16 * i);
+    }
+    return word;
+#elif defined(QRBINARIZER_NEON)
+    // 比较结果和各字节的位权相与，再两两相加四次，第i个字节是第8i ~ 8i + 7个像素的8位
+    static const std::uint8_t kBitWeights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    const uint8x16_t weights = vld1q_u8(kBitWeights);
+    uint8x16_t bits[4];
+    for (int i = 0; i < 4; i++)
+        bits[i] = vandq_u8(vcleq_u8(vld1q_u8(gray + 16 * i), vld1q_u8(thresholds + 16 * i)), weights);
+    uint8x16_t sum = vpaddq_u8(vpaddq_u8(bits[0], bits[1]), vpaddq_u8(bits[2], bits[3]));
+    sum = vpaddq_u8(sum, sum);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum), 0);
+#else
+    return packScalar(gray, thresholds, 64);
+#endif
+}
+
+// 一行像素二值化，不满64个像素的最后一个字用标量处理，多出的位为0
+void thresholdRow(const std::uint8_t* gray, const std::uint8_t* thresholds, int width, std::uint64_t* words)
+{
+    const int fullWords = width / 64;
+    for (int i = 0; i < fullWords; i++)
+        words[i] = pack64(gray + i * 64, thresholds + i * 64);
+    if (width % 64 != 0)
+        words[fullWords] = packScalar(gray + fullWords * 64, thresholds + fullWords * 64, width % 64);
+}
+
+} // namespace
+
+const char* QRBinarizer::instructionSet()
+{
+#if defined(QRBINARIZER_AVX2)
+    return "AVX2";
+#elif defined(QRBINARIZER_SSE2)
+    return "SSE2";
+#elif defined(QRBINARIZER_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+void QRBinarizer::grayFromBgra(const std::uint8_t* bgra, std::size_t pixels, std::uint8_t* gray)
+{
+    std::size_t i = 0;
+#if defined(QRBINARIZER_AVX2)
+    for (; i + 32 <= pixels; i += 32)
+    {
+        const auto* in = reinterpret_cast<const __m256i*>(bgra + i * 4);
+        const __m256i a = _mm256_packs_epi32(grayFromBgra8(_mm256_loadu_si256(in)),
+                grayFromBgra8(_mm256_loadu_si256(in + 1)));
+        const __m256i b = _mm256_packs_epi32(grayFromBgra8(_mm256_loadu_si256(in + 2)),
+                grayFromBgra8(_mm256_loadu_si256(in + 3)));
+        // 打包指令在128位的两半里各自进行，每4个像素一组的顺序是0、2、4、6、1、3、5、7，重排回来
+        const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(a, b),
+                _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(gray + i), packed);
+    }
+#elif defined(QRBINARIZER_SSE2)
+    for (; i + 16 <= pixels; i += 16)
+    {
+        const auto* in = reinterpret_cast<const __m128i*>(bgra + i * 4);
+        const __m128i a = _mm_packs_epi32(grayFromBgra4(_mm_loadu_si128(in)), grayFromBgra4(_mm_loadu_si128(in + 1)));
+        const __m128i b = _mm_packs_epi32(grayFromBgra4(_mm_loadu_si128(in + 2)),
+                grayFromBgra4(_mm_loadu_si128(in + 3)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i), _mm_packus_epi16(a, b));
+    }
+#elif defined(QRBINARIZER_NEON)
+    for (; i + 16 <= pixels; i += 16)
+    {
+        const uint8x16x4_t v = vld4q_u8(bgra + i * 4);
+        uint16x8_t low = vmull_u8(vget_low_u8(v.val[0]), vdup_n_u8(29));
+        low = vmlal_u8(low, vget_low_u8(v.val[1]), vdup_n_u8(150));
+        low = vmlal_u8(low, vget_low_u8(v.val[2]), vdup_n_u8(77));
+        uint16x8_t high = vmull_u8(vget_high_u8(v.val[0]), vdup_n_u8(29));
+        high = vmlal_u8(high, vget_high_u8(v.val[1]), vdup_n_u8(150));
+        high = vmlal_u8(high, vget_high_u8(v.val[2]), vdup_n_u8(77));
+        vst1q_u8(gray + i, vcombine_u8(vshrn_n_u16(low, 8), vshrn_n_u16(high, 8)));
+    }
+#endif
+    for (; i < pixels; i++)
+        gray[i] = grayScalar(bgra[i * 4 + 2], bgra[i * 4 + 1], bgra[i * 4]);
+}
+
+void QRBinarizer::grayFromRgb(const std::uint8_t* rgb, std::size_t pixels, std::uint8_t* gray)
+{
+    std::size_t i = 0;
+#if defined(QRBINARIZER_NEON)
+    for (; i + 16 <= pixels; i += 16)
+    {
+        const uint8x16x3_t v = vld3q_u8(rgb + i * 3);
+        uint16x8_t low = vmull_u8(vget_low_u8(v.val[0]), vdup_n_u8(77));
+        low = vmlal_u8(low, vget_low_u8(v.val[1]), vdup_n_u8(150));
+        low = vmlal_u8(low, vget_low_u8(v.val[2]), vdup_n_u8(29));
+        uint16x8_t high = vmull_u8(vget_high_u8(v.val[0]), vdup_n_u8(77));
+        high = vmlal_u8(high, vget_high_u8(v.val[1]), vdup_n_u8(150));
+        high = vmlal_u8(high, vget_high_u8(v.val[2]), vdup_n_u8(29));
+        vst1q_u8(gray + i, vcombine_u8(vshrn_n_u16(low, 8), vshrn_n_u16(high, 8)));
+    }
+#endif
+    for (; i < pixels; i++)
+        gray[i] = grayScalar(rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2]);
+}
+
+void QRBinarizer::grayFromPackedYuv(const std::uint8_t* yuv, std::size_t pixels, int lumaOffset, std::uint8_t* gray)
+{
+    std::size_t i = 0;
+#if defined(QRBINARIZER_AVX2)
+    // Y在每个16位的低字节（YUYV）或高字节（UYVY），移到低字节后饱和打包成字节
+    const __m256i lowByte = _mm256_set1_epi16(0xFF);
+    for (; i + 32 <= pixels; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(yuv + i * 2));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(yuv + i * 2 + 32));
+        a = lumaOffset == 0 ? _mm256_and_si256(a, lowByte) : _mm256_srli_epi16(a, 8);
+        b = lumaOffset == 0 ? _mm256_and_si256(b, lowByte) : _mm256_srli_epi16(b, 8);
+        // 打包指令在128位的两半里各自进行，每8个像素一组的顺序是0、2、1、3，重排回来
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(gray + i), packed);
+    }
+#elif defined(QRBINARIZER_SSE2)
+    const __m128i lowByte = _mm_set1_epi16(0xFF);
+    for (; i + 16 <= pixels; i += 16)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(yuv + i * 2));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(yuv + i * 2 + 16));
+        a = lumaOffset == 0 ? _mm_and_si128(a, lowByte) : _mm_srli_epi16(a, 8);
+        b = lumaOffset == 0 ? _mm_and_si128(b, lowByte) : _mm_srli_epi16(b, 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i), _mm_packus_epi16(a, b));
+    }
+#elif defined(QRBINARIZER_NEON)
+    for (; i + 16 <= pixels; i += 16)
+    {
+        const uint8x16x2_t v = vld2q_u8(yuv + i * 2);
+        vst1q_u8(gray + i, lumaOffset == 0 ? v.val[0] : v.val[1]);
+    }
+#endif
+    for (; i < pixels; i++)
+        gray[i] = yuv[i * 2 + static_cast<std::size_t>(lumaOffset)];
+}
+
+void QRBinarizer::binarize(const QRGrayFrame& frame, QRBinaryImage& image)
+{
+    const int width = frame.width;
+    const int height = frame.height;
+    const std::uint8_t* pixels = frame.pixels.data();
+    image.width = width;
+    image.height = height;
+    image.wordsPerRow = (width + 63) / 64;
+    image.words.resize(static_cast<std::size_t>(image.wordsPerRow) * static_cast<std::size_t>(height));
+    auto rowOf = [&](int y) {
+        return image.words.data() + static_cast<std::size_t>(y) * static_cast<std::size_t>(image.wordsPerRow);
+    };
+
+    if (width < kBlockSize || height < kBlockSize)
+    {
+        std::uint64_t sum = 0;
+        for (const std::uint8_t pixel : frame.pixels)
+            sum += pixel;
+        const auto mean = static_cast<std::uint8_t>(frame.pixels.empty() ? 0 : sum / frame.pixels.size());
+        rowThresholds.assign(static_cast<std::size_t>(width), mean);
+        for (int y = 0; y < height; y++)
+            thresholdRow(pixels + static_cast<std::size_t>(y) * static_cast<std::size_t>(width), rowThresholds.data(),
+                    width, rowOf(y));
+        return;
+    }
+
+    // 每块的黑点。最后一行、一列不满一块时和前面的块重叠，取贴着边的8行、8列
+    const int blocksX = (width + kBlockSize - 1) / kBlockSize;
+    const int blocksY = (height + kBlockSize - 1) / kBlockSize;
+    blockSums.resize(static_cast<std::size_t>(blocksX));
+    blockMins.resize(static_cast<std::size_t>(blocksX));
+    blockMaxs.resize(static_cast<std::size_t>(blocksX));
+    blackPoints.resize(static_cast<std::size_t>(blocksX) * static_cast<std::size_t>(blocksY));
+    for (int by = 0; by < blocksY; by++)
+    {
+        const int top = std::min(by * kBlockSize, height - kBlockSize);
+        blockRowStats(pixels + static_cast<std::size_t>(top) * static_cast<std::size_t>(width), width, blocksX,
+                blockSums.data(), blockMins.data(), blockMaxs.data());
+        std::uint8_t* points = blackPoints.data() + static_cast<std::size_t>(by) * static_cast<std::size_t>(blocksX);
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            const int min = blockMins[static_cast<std::size_t>(bx)];
+            int blackPoint = static_cast<int>(blockSums[static_cast<std::size_t>(bx)]) / kBlockPixels;
+            if (blockMaxs[static_cast<std::size_t>(bx)] - min <= kMinContrast)
+            {
+                // 纯色块先当作浅色背景，阈值取最小值的一半；上方、左方的块更亮时说明这里是大片的深色
+                // （比如放大后的定位图案中心），跟着它们的黑点
+                blackPoint = min / 2;
+                if (by > 0 && bx > 0)
+                {
+                    const int neighbours = (points[bx - blocksX] + 2 * points[bx - 1] + points[bx - blocksX - 1]) / 4;
+                    if (min < neighbours)
+                        blackPoint = neighbours;
+                }
+            }
+            points[bx] = static_cast<std::uint8_t>(blackPoint);
+        }
+    }
+
+    // 黑点的积分图，第(by, bx)项是左上角by × bx块的黑点之和
+    const auto stride = static_cast<std::size_t>(blocksX + 1);
+    integral.assign(stride * static_cast<std::size_t>(blocksY + 1), 0);
+    for (int by = 0; by < blocksY; by++)
+    {
+        std::uint32_t rowSum = 0;
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            rowSum += blackPoints[static_cast<std::size_t>(by) * static_cast<std::size_t>(blocksX) +
+                    static_cast<std::size_t>(bx)];
+            const std::size_t index = static_cast<std::size_t>(by + 1) * stride + static_cast<std::size_t>(bx + 1);
+            integral[index] = integral[index - stride] + rowSum;
+        }
+    }
+
+    // 每块的阈值是周围5×5块（贴边时少一些）黑点的平均，展开到块行的每一列，再逐行比较
+    rowThresholds.resize(static_cast<std::size_t>(blocksX) * kBlockSize);
+    for (int by = 0; by < blocksY; by++)
+    {
+        const auto y0 = static_cast<std::size_t>(std::max(by - kWindowRadius, 0));
+        const auto y1 = static_cast<std::size_t>(std::min(by + kWindowRadius + 1, blocksY));
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            const auto x0 = static_cast<std::size_t>(std::max(bx - kWindowRadius, 0));
+            const auto x1 = static_cast<std::size_t>(std::min(bx + kWindowRadius + 1, blocksX));
+            const std::uint32_t sum = integral[y1 * stride + x1] - integral[y0 * stride + x1] -
+                    integral[y1 * stride + x0] + integral[y0 * stride + x0];
+            const auto count = static_cast<std::uint32_t>((y1 - y0) * (x1 - x0));
+            std::memset(rowThresholds.data() + bx * kBlockSize, static_cast<int>(sum / count), kBlockSize);
+        }
+        const int yEnd = std::min((by + 1) * kBlockSize, height);
+        for (int y = by * kBlockSize; y < yEnd; y++)
+            thresholdRow(pixels + static_cast<std::size_t>(y) * static_cast<std::size_t>(width), rowThresholds.data(),
+                    width, rowOf(y));
+    }
+}
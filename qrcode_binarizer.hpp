@@ -0,0 +1,63 @@
+#pragma once
+
+#include "qrcode_frame_source.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 二值图：按位存储，每行wordsPerRow = (width + 63) / 64个字，第x个像素是第x / 64个字的第x % 64位，置位为深色。
+// 行尾多出的位为0（浅色），找定位图案时可以按字跳过整段同色的像素
+struct QRBinaryImage
+{
+    int width = 0;
+    int height = 0;
+    int wordsPerRow = 0;
+    std::vector<std::uint64_t> words;
+
+    const std::uint64_t* row(int y) const
+    {
+        return words.data() + static_cast<std::size_t>(y) * static_cast<std::size_t>(wordsPerRow);
+    }
+
+    // 坐标不做范围检查
+    bool get(int x, int y) const
+    {
+        return (row(y)[x >> 6] >> (x & 63) & 1) != 0;
+    }
+};
+
+// 接收端的灰度转换和二值化，按编译目标选AVX2、SSE2或NEON实现，都没有时用标量实现，结果完全一样。
+// 阈值是局部自适应的：先按8×8像素的小块求均值、最小值和最大值得到每块的黑点，明暗差太小的块（纯色区域）
+// 参考上方和左方已经算好的块；再用黑点的积分图求以每块为中心5×5块的平均值，作为块内像素的阈值。
+// 和全局阈值相比，光照不均、屏幕反光和摄像头暗角下也能分开深浅模块。
+// 阈值按块行展开成逐像素的一行，比较和打包成位一次处理16或32个像素。
+class QRBinarizer
+{
+public:
+    static constexpr int kBlockSize = 8;
+    static constexpr int kWindowRadius = 2;  // 阈值取周围(2 × 2 + 1)²块黑点的平均
+    static constexpr int kMinContrast = 24;  // 块内最大、最小值相差不超过这个时当作纯色
+
+    // 编译进来的实现："AVX2"、"SSE2"、"NEON"或"scalar"
+    static const char* instructionSet();
+
+    // 以下把一段像素转成灰度，彩色按BT.601亮度的定点近似，权重之和为256，和发送端录帧、原始视频的转换一样
+    // BGRA，每像素4字节：Qt的RGB32、ARGB32按小端存储的字节顺序
+    static void grayFromBgra(const std::uint8_t* bgra, std::size_t pixels, std::uint8_t* gray);
+    // RGB，每像素3字节。只有NEON有向量实现，x86上SSE2没有合适的字节重排指令，用标量实现
+    static void grayFromRgb(const std::uint8_t* rgb, std::size_t pixels, std::uint8_t* gray);
+    // YUYV、UYVY等打包的YUV 4:2:2，每像素2字节，取每2字节里lumaOffset（0或1）处的Y
+    static void grayFromPackedYuv(const std::uint8_t* yuv, std::size_t pixels, int lumaOffset, std::uint8_t* gray);
+
+    // 二值化一帧，结果写进image（复用其容量）。不到一块大的图用全图均值作阈值
+    void binarize(const QRGrayFrame& frame, QRBinaryImage& image);
+
+private:
+    std::vector<std::uint32_t> blockSums;       // 当前块行每块的像素和
+    std::vector<std::uint8_t> blockMins;
+    std::vector<std::uint8_t> blockMaxs;
+    std::vector<std::uint8_t> blackPoints;      // 每块的黑点，blocksX × blocksY
+    std::vector<std::uint32_t> integral;        // 黑点的积分图，(blocksX + 1) × (blocksY + 1)
+    std::vector<std::uint8_t> rowThresholds;    // 当前块行逐像素展开的阈值
+};
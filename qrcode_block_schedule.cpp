@@ -0,0 +1,109 @@
+#include "qrcode_block_schedule.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+// n的ratio倍，向上取整，至少为1
+static std::uint32_t scaledBlocks(std::uint32_t n, double ratio)
+{
+    const double blocks = std::ceil(n * ratio);
+    return static_cast<std::uint32_t>(std::clamp(blocks, 1.0, static_cast<double>(UINT32_MAX)));
+}
+
+QRBlockSchedule::QRBlockSchedule(std::vector<std::uint32_t> chunkBlocks, const Config& config) :
+    originalBlocks(std::move(chunkBlocks)), scheduleConfig(config)
+{
+    if (originalBlocks.empty() || originalBlocks.size() >= kNoChunk || config.activeChunks < 1 ||
+            !(config.overheadTarget >= 1.0) || !(config.repairRatio > 0.0))
+        throw std::domain_error("Invalid block schedule configuration");
+
+    const auto chunks = static_cast<std::uint32_t>(originalBlocks.size());
+    nextBlockIds.assign(chunks, 0);
+    acknowledged.assign(chunks, false);
+    for (std::uint32_t i = 0; i < chunks; i++)
+        pending.push_back(i);
+    slots.resize(std::min<std::size_t>(static_cast<std::size_t>(config.activeChunks), chunks));
+}
+
+std::size_t QRBlockSchedule::slotCount() const
+{
+    return slots.size();
+}
+
+bool QRBlockSchedule::next(Block& block)
+{
+    while (!finished())
+    {
+        // 从上次的位置开始轮流找一个还有块要发的位置
+        for (std::size_t k = 0; k < slots.size(); k++)
+        {
+            const std::size_t index = nextSlot;
+            Slot& slot = slots[index];
+            nextSlot = (nextSlot + 1) % slots.size();
+            if (slot.chunkIndex != kNoChunk && (slot.remaining == 0 || acknowledged[slot.chunkIndex]))
+                slot.chunkIndex = kNoChunk;
+            if (slot.chunkIndex == kNoChunk && !fillSlot(slot))
+                continue;
+
+            block.slot = index;
+            block.chunkIndex = slot.chunkIndex;
+            block.blockId = nextBlockIds[slot.chunkIndex]++;
+            block.startsChunk = slot.loadedChunk != slot.chunkIndex;
+            slot.loadedChunk = slot.chunkIndex;
+            slot.remaining--;
+            counters.sentBlocks++;
+            return true;
+        }
+
+        // 所有位置都空闲，本轮发完了
+        if (!scheduleConfig.loop)
+        {
+            exhausted = true;
+            break;
+        }
+        counters.pass++;
+        for (std::uint32_t i = 0; i < originalBlocks.size(); i++)
+        {
+            if (!acknowledged[i])
+                pending.push_back(i);
+        }
+    }
+    return false;
+}
+
+bool QRBlockSchedule::fillSlot(Slot& slot)
+{
+    while (!pending.empty())
+    {
+        const std::uint32_t chunk = pending.front();
+        pending.pop_front();
+        if (acknowledged[chunk])
+            continue;
+        slot.chunkIndex = chunk;
+        slot.remaining = counters.pass == 1 ? scaledBlocks(originalBlocks[chunk], scheduleConfig.overheadTarget) :
+                scaledBlocks(originalBlocks[chunk], scheduleConfig.repairRatio);
+        counters.startedChunks++;
+        return true;
+    }
+    return false;
+}
+
+void QRBlockSchedule::acknowledge(std::uint32_t chunkIndex)
+{
+    if (chunkIndex >= acknowledged.size() || acknowledged[chunkIndex])
+        return;
+    acknowledged[chunkIndex] = true;
+    counters.acknowledgedChunks++;
+}
+
+bool QRBlockSchedule::finished() const
+{
+    return exhausted || counters.acknowledgedChunks == acknowledged.size();
+}
+
+QRBlockSchedule::Stats QRBlockSchedule::stats() const
+{
+    return counters;
+}
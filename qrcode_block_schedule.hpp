@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// 块的发送计划：决定每个码发送哪个分片的哪个块，不涉及编码。
+//
+// wirehair是系统码，blockId小于原始块数的块就是数据本身。每个分片先发原始块，再发修复块，
+// 第一轮一共发overheadTarget倍原始块数：接收端一块不漏时发完原始块就能解完，漏了几块也不用等下一轮。
+// 同时有activeChunks个位置交错发送，一个分片发够本轮的块数后，它的位置交给本轮下一个还没发的分片，
+// 分片的块编号跨轮延续，每一轮发的都是新的修复块。
+//
+// 第一轮结束后，loop为false时计划结束；为true时对还没确认的分片再发一轮，每轮repairRatio倍原始块数。
+// 接收端通过反馈确认解完的分片后，这些分片不再发送（已经在发的也马上让出位置），全部确认后计划结束。
+// 不是线程安全的，由调用者加锁。
+class QRBlockSchedule
+{
+public:
+    struct Config
+    {
+        int activeChunks = 4;          // 同时交错发送的分片数
+        double overheadTarget = 1.05;  // 第一轮每个分片发送的块数相对其原始块数的倍数
+        double repairRatio = 0.5;      // 之后每轮每个分片再发的修复块数相对其原始块数的倍数
+        bool loop = false;             // 第一轮之后是否继续发送还没确认的分片
+    };
+
+    struct Block
+    {
+        std::size_t slot = 0;          // 发送位置，下标小于slotCount()
+        std::uint32_t chunkIndex = 0;
+        std::uint32_t blockId = 0;
+        bool startsChunk = false;      // 这个位置换成了另一个分片，调用者要为它准备编码器
+    };
+
+    struct Stats
+    {
+        std::uint32_t pass = 1;                // 当前是第几轮
+        std::uint64_t sentBlocks = 0;
+        std::uint64_t startedChunks = 0;       // 分片占用位置的次数
+        std::uint32_t acknowledgedChunks = 0;  // 接收端确认解完的分片数
+    };
+
+    // chunkBlocks[i]是第i个分片的原始块数。配置不合法时抛出std::domain_error
+    QRBlockSchedule(std::vector<std::uint32_t> chunkBlocks, const Config& config);
+
+    std::size_t slotCount() const;
+
+    // 取下一个要发送的块，计划结束时返回false
+    bool next(Block& block);
+
+    // 接收端确认分片已经解完，重复确认或序号越界时忽略
+    void acknowledge(std::uint32_t chunkIndex);
+
+    bool finished() const;
+    Stats stats() const;
+
+private:
+    static constexpr std::uint32_t kNoChunk = UINT32_MAX;
+
+    struct Slot
+    {
+        std::uint32_t chunkIndex = kNoChunk;   // 正在发送的分片，kNoChunk为空闲
+        std::uint32_t loadedChunk = kNoChunk;  // 调用者为这个位置准备好编码器的分片
+        std::uint32_t remaining = 0;           // 本轮还要发送的块数
+    };
+
+    // 从本轮还没发的分片里取一个放到slot，没有了返回false
+    bool fillSlot(Slot& slot);
+
+    std::vector<std::uint32_t> originalBlocks;
+    std::vector<std::uint32_t> nextBlockIds;  // 每个分片下一个要发送的块编号
+    std::vector<bool> acknowledged;
+    Config scheduleConfig;
+    std::deque<std::uint32_t> pending;        // 本轮还没轮到的分片
+    std::vector<Slot> slots;
+    std::size_t nextSlot = 0;
+    bool exhausted = false;
+    Stats counters;
+};
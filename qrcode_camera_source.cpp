@@ -0,0 +1,106 @@
+#include "qrcode_camera_source.hpp"
+#include "qrcode_binarizer.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+QRCameraSource::QRCameraSource(const QCameraInfo& cameraInfo, QObject* parent) :
+    QAbstractVideoSurface(parent), camera(new QCamera(cameraInfo, this))
+{
+    camera->setViewfinder(this);
+    camera->start();
+    if (camera->error() != QCamera::NoError)
+        throw std::runtime_error("Cannot start camera " + cameraInfo.description().toStdString() + ": " +
+                camera->errorString().toStdString());
+}
+
+QRCameraSource::~QRCameraSource()
+{
+    camera->stop();
+}
+
+QList<QVideoFrame::PixelFormat> QRCameraSource::supportedPixelFormats(QAbstractVideoBuffer::HandleType handleType) const
+{
+    if (handleType != QAbstractVideoBuffer::NoHandle)
+        return {};
+    // 平面格式的Y平面在最前面，打包格式按固定间隔取Y
+    return { QVideoFrame::Format_Y8, QVideoFrame::Format_YUV420P, QVideoFrame::Format_YV12, QVideoFrame::Format_NV12,
+             QVideoFrame::Format_NV21, QVideoFrame::Format_YUYV, QVideoFrame::Format_UYVY, QVideoFrame::Format_RGB32,
+             QVideoFrame::Format_ARGB32 };
+}
+
+bool QRCameraSource::present(const QVideoFrame& frame)
+{
+    QVideoFrame mapped(frame);
+    if (!mapped.map(QAbstractVideoBuffer::ReadOnly))
+        return false;
+    const int width = mapped.width();
+    const int height = mapped.height();
+    const int stride = mapped.bytesPerLine();
+    const uchar* bits = mapped.bits();
+    const QVideoFrame::PixelFormat format = mapped.pixelFormat();
+
+    {
+        std::lock_guard lock(mutex);
+        if (hasFrame)
+            dropped++;
+        latest.width = width;
+        latest.height = height;
+        latest.pixels.resize(static_cast<std::size_t>(width) * static_cast<std::size_t>(height));
+        latest.index = arrivedFrames++;
+        for (int y = 0; y < height; y++)
+        {
+            const uchar* line = bits + static_cast<std::ptrdiff_t>(y) * stride;
+            std::uint8_t* out = latest.pixels.data() + static_cast<std::size_t>(y) * static_cast<std::size_t>(width);
+            switch (format)
+            {
+                case QVideoFrame::Format_YUYV:
+                    QRBinarizer::grayFromPackedYuv(line, static_cast<std::size_t>(width), 0, out);
+                    break;
+                case QVideoFrame::Format_UYVY:
+                    QRBinarizer::grayFromPackedYuv(line, static_cast<std::size_t>(width), 1, out);
+                    break;
+                case QVideoFrame::Format_RGB32:
+                case QVideoFrame::Format_ARGB32:
+                    // 0xAARRGGBB按小端存储，字节顺序为B、G、R、A
+                    QRBinarizer::grayFromBgra(line, static_cast<std::size_t>(width), out);
+                    break;
+                default:
+                    std::memcpy(out, line, static_cast<std::size_t>(width));
+                    break;
+            }
+        }
+        hasFrame = true;
+    }
+    mapped.unmap();
+    frameReady.notify_one();
+    return true;
+}
+
+bool QRCameraSource::read(QRGrayFrame& frame)
+{
+    std::unique_lock lock(mutex);
+    frameReady.wait(lock, [this] { return hasFrame || stopped; });
+    if (stopped)
+        return false;
+    // 交换缓冲区，摄像头下一帧写进处理线程用过的那块内存
+    std::swap(frame, latest);
+    hasFrame = false;
+    return true;
+}
+
+void QRCameraSource::stop()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopped = true;
+    }
+    frameReady.notify_all();
+}
+
+std::uint64_t QRCameraSource::droppedFrames() const
+{
+    std::lock_guard lock(mutex);
+    return dropped;
+}
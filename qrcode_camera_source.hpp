@@ -0,0 +1,45 @@
+#pragma once
+
+#include "qrcode_frame_source.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#include <QAbstractVideoSurface>
+#include <QCamera>
+#include <QCameraInfo>
+#include <QVideoFrame>
+
+// 摄像头帧源：用Qt Multimedia打开摄像头（Linux上即V4L2设备），每帧只取亮度。
+// 必须在主线程创建，摄像头的帧在主线程的事件循环里到达，read()可以在处理线程调用。
+// 只保留最新的一帧：处理线程跟不上时旧帧直接被覆盖，不会越积越多。
+class QRCameraSource : public QAbstractVideoSurface, public QRFrameSource
+{
+    Q_OBJECT
+public:
+    // 打不开摄像头时抛出std::runtime_error
+    explicit QRCameraSource(const QCameraInfo& cameraInfo, QObject* parent = nullptr);
+    ~QRCameraSource() override;
+
+    QList<QVideoFrame::PixelFormat> supportedPixelFormats(
+            QAbstractVideoBuffer::HandleType handleType = QAbstractVideoBuffer::NoHandle) const override;
+    bool present(const QVideoFrame& frame) override;
+
+    bool read(QRGrayFrame& frame) override;
+    void stop() override;
+
+    // 处理线程来不及取、被新帧覆盖的帧数
+    std::uint64_t droppedFrames() const override;
+
+private:
+    QCamera* camera;
+
+    mutable std::mutex mutex;
+    std::condition_variable frameReady;
+    QRGrayFrame latest;              // 最新到达、还没被取走的帧
+    bool hasFrame = false;
+    bool stopped = false;
+    std::uint64_t arrivedFrames = 0;
+    std::uint64_t dropped = 0;
+};
@@ -0,0 +1,239 @@
+#include "qrcode_compression.hpp"
+#include "qrcode_stream_frame.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace qrstream
+{
+
+namespace
+{
+
+constexpr std::size_t kMinMatch = 4;
+constexpr std::size_t kLastLiterals = 5;   // 块的最后5个字节必须是字面量
+constexpr std::size_t kMatchStartLimit = 12;  // 最后一个匹配必须在块结束前12字节之前开始
+constexpr std::size_t kMaxOffset = 65535;
+constexpr int kHashBits = 14;
+static_assert(kLz4TableEntries == std::size_t{ 1 } << kHashBits);
+
+std::uint32_t read32(const std::uint8_t* p)
+{
+    std::uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+std::uint32_t hash4(std::uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+// 长度的扩展字节：先写满255，最后一个小于255
+std::uint8_t* writeLength(std::size_t length, std::uint8_t* op)
+{
+    for (; length >= 255; length -= 255)
+        *op++ = 255;
+    *op++ = static_cast<std::uint8_t>(length);
+    return op;
+}
+
+bool readLength(const std::uint8_t* src, std::size_t srcLen, std::size_t& ip, std::size_t& length)
+{
+    std::uint8_t byte = 0;
+    do
+    {
+        if (ip >= srcLen)
+            return false;
+        byte = src[ip++];
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// 写一个序列：literalLen个字面量，之后是一个匹配（matchLen为0时是块的最后一个序列，没有匹配）
+std::uint8_t* writeSequence(const std::uint8_t* literals, std::size_t literalLen, std::size_t offset,
+        std::size_t matchLen, std::uint8_t* op)
+{
+    std::uint8_t* token = op++;
+    *token = static_cast<std::uint8_t>(std::min<std::size_t>(literalLen, 15) << 4);
+    if (literalLen >= 15)
+        op = writeLength(literalLen - 15, op);
+    std::memcpy(op, literals, literalLen);
+    op += literalLen;
+    if (matchLen == 0)
+        return op;
+
+    *op++ = static_cast<std::uint8_t>(offset);
+    *op++ = static_cast<std::uint8_t>(offset >> 8);
+    const std::size_t length = matchLen - kMinMatch;
+    *token = static_cast<std::uint8_t>(*token | std::min<std::size_t>(length, 15));
+    if (length >= 15)
+        op = writeLength(length - 15, op);
+    return op;
+}
+
+} // namespace
+
+std::size_t lz4CompressBound(std::size_t len)
+{
+    return len + len / 255 + 16;
+}
+
+std::size_t lz4Compress(const std::uint8_t* src, std::size_t len, std::uint8_t* dst, std::uint32_t* table)
+{
+    // 表里存位置加1，0表示空
+    std::fill(table, table + kLz4TableEntries, 0u);
+    std::uint8_t* op = dst;
+    std::size_t anchor = 0;
+    if (len > kMatchStartLimit)
+    {
+        const std::size_t matchEnd = len - kLastLiterals;
+        std::size_t ip = 0;
+        while (ip < len - kMatchStartLimit)
+        {
+            const std::uint32_t sequence = read32(src + ip);
+            std::uint32_t& slot = table[hash4(sequence)];
+            const std::size_t candidate = slot;
+            slot = static_cast<std::uint32_t>(ip + 1);
+            if (candidate == 0 || ip - (candidate - 1) > kMaxOffset || read32(src + candidate - 1) != sequence)
+            {
+                // 连续找不到匹配时逐渐加大步长，压不动的数据也能很快扫过去
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            std::size_t match = candidate - 1;
+            std::size_t matchLen = kMinMatch;
+            while (ip + matchLen < matchEnd && src[match + matchLen] == src[ip + matchLen])
+                matchLen++;
+            while (ip > anchor && match > 0 && src[ip - 1] == src[match - 1])
+            {
+                ip--;
+                match--;
+                matchLen++;
+            }
+            op = writeSequence(src + anchor, ip - anchor, ip - match, matchLen, op);
+            ip += matchLen;
+            anchor = ip;
+        }
+    }
+    op = writeSequence(src + anchor, len - anchor, 0, 0, op);
+    return static_cast<std::size_t>(op - dst);
+}
+
+bool lz4Decompress(const std::uint8_t* src, std::size_t srcLen, std::uint8_t* dst, std::size_t dstLen)
+{
+    std::size_t ip = 0;
+    std::size_t op = 0;
+    for (;;)
+    {
+        if (ip >= srcLen)
+            return false;
+        const std::uint8_t token = src[ip++];
+
+        std::size_t literalLen = token >> 4;
+        if (literalLen == 15 && !readLength(src, srcLen, ip, literalLen))
+            return false;
+        if (literalLen > srcLen - ip || literalLen > dstLen - op)
+            return false;
+        std::memcpy(dst + op, src + ip, literalLen);
+        ip += literalLen;
+        op += literalLen;
+        if (ip == srcLen)
+            return op == dstLen;  // 最后一个序列只有字面量
+
+        if (srcLen - ip < 2)
+            return false;
+        const std::size_t offset = static_cast<std::size_t>(src[ip] | src[ip + 1] << 8);
+        ip += 2;
+        std::size_t matchLen = token & 15;
+        if (matchLen == 15 && !readLength(src, srcLen, ip, matchLen))
+            return false;
+        matchLen += kMinMatch;
+        if (offset == 0 || offset > op || matchLen > dstLen - op)
+            return false;
+
+        // 偏移小于长度时源和目标重叠，要逐字节复制来重复前面的内容
+        const std::uint8_t* match = dst + op - offset;
+        if (offset >= matchLen)
+            std::memcpy(dst + op, match, matchLen);
+        else
+            for (std::size_t i = 0; i < matchLen; i++)
+                dst[op + i] = match[i];
+        op += matchLen;
+    }
+}
+
+void compressStream(const std::uint8_t* data, std::size_t len, std::vector<std::uint8_t>& out)
+{
+    std::vector<std::uint32_t> table(kLz4TableEntries);
+    std::vector<std::uint8_t> scratch(lz4CompressBound(kCompressionFrameBytes));
+    std::uint8_t sizes[20];
+    for (std::size_t pos = 0; pos < len; pos += kCompressionFrameBytes)
+    {
+        const std::size_t frameLen = std::min(kCompressionFrameBytes, len - pos);
+        const std::size_t compressedLen = lz4Compress(data + pos, frameLen, scratch.data(), table.data());
+        const bool stored = compressedLen >= frameLen;
+        const std::size_t storedLen = stored ? frameLen : compressedLen;
+        std::size_t n = writeVarint(frameLen, sizes);
+        n += writeVarint(storedLen, sizes + n);
+        out.insert(out.end(), sizes, sizes + n);
+        const std::uint8_t* frame = stored ? data + pos : scratch.data();
+        out.insert(out.end(), frame, frame + storedLen);
+    }
+}
+
+bool StreamDecompressor::feed(const std::uint8_t* data, std::size_t len, std::vector<std::uint8_t>& out)
+{
+    std::size_t pos = 0;
+    if (pending.empty())
+    {
+        // 没有剩下的帧时直接从输入解，只把末尾不完整的帧留下
+        if (!decodeFrames(data, len, pos, out))
+            return false;
+        pending.assign(data + pos, data + len);
+        return true;
+    }
+    pending.insert(pending.end(), data, data + len);
+    if (!decodeFrames(pending.data(), pending.size(), pos, out))
+        return false;
+    pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(pos));
+    return true;
+}
+
+bool StreamDecompressor::atFrameBoundary() const
+{
+    return pending.empty();
+}
+
+bool StreamDecompressor::decodeFrames(const std::uint8_t* in, std::size_t len, std::size_t& pos,
+        std::vector<std::uint8_t>& out)
+{
+    for (;;)
+    {
+        std::size_t next = pos;
+        std::uint64_t frameLen = 0;
+        std::uint64_t storedLen = 0;
+        if (!readVarint(in, len, next, frameLen) || !readVarint(in, len, next, storedLen))
+        {
+            // 帧头本身不完整：超过两个最长varint还读不出来就是格式不对
+            return len - pos < 20;
+        }
+        if (frameLen == 0 || frameLen > kCompressionFrameBytes || storedLen > frameLen)
+            return false;
+        if (storedLen > len - next)
+            return true;  // 数据还没收全
+
+        const std::size_t start = out.size();
+        out.resize(start + static_cast<std::size_t>(frameLen));
+        if (storedLen == frameLen)
+            std::memcpy(out.data() + start, in + next, static_cast<std::size_t>(frameLen));
+        else if (!lz4Decompress(in + next, static_cast<std::size_t>(storedLen), out.data() + start,
+                         static_cast<std::size_t>(frameLen)))
+            return false;
+        pos = next + static_cast<std::size_t>(storedLen);
+    }
+}
+
+} // namespace qrstream
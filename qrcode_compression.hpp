@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 发送前的压缩：LZ4块格式（https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md）的自带实现，不依赖外部库。
+// 日志、JSON、文本一类的数据通常能压到几分之一，要显示的帧数也按比例减少。
+//
+// 压缩流由若干帧组成，每帧：[原始字节数: varint] [存储字节数: varint] [数据]。
+// 存储字节数等于原始字节数时数据原样存储（压不动的帧），否则是一个LZ4块。
+// 每帧最多kCompressionFrameBytes原始字节，帧之间互不引用，接收端按顺序拿到一段就能解一段，不用等整个流。
+// 流是否压缩由块头里的Compression标记（见qrcode_stream_frame.hpp）。
+namespace qrstream
+{
+
+constexpr std::size_t kCompressionFrameBytes = std::size_t{ 1 } << 20;
+
+// 压缩len字节最坏情况下的LZ4块字节数
+std::size_t lz4CompressBound(std::size_t len);
+
+// 把src压缩成一个LZ4块写到dst（至少lz4CompressBound(len)字节），返回写入的字节数。
+// table是调用者提供的哈希表，至少kLz4TableEntries项，重复使用避免每次分配
+constexpr std::size_t kLz4TableEntries = std::size_t{ 1 } << 14;
+std::size_t lz4Compress(const std::uint8_t* src, std::size_t len, std::uint8_t* dst, std::uint32_t* table);
+
+// 解一个LZ4块，解出的字节数必须正好是dstLen。块格式不对时返回false
+bool lz4Decompress(const std::uint8_t* src, std::size_t srcLen, std::uint8_t* dst, std::size_t dstLen);
+
+// 把data压缩成压缩流，追加到out
+void compressStream(const std::uint8_t* data, std::size_t len, std::vector<std::uint8_t>& out);
+
+// 流式解压：压缩流可以按任意大小分段依次喂入，每次解出已经完整的帧
+class StreamDecompressor
+{
+public:
+    // 喂入压缩流的下一段，解出的数据追加到out。流格式不对时返回false，之后的结果无意义
+    bool feed(const std::uint8_t* data, std::size_t len, std::vector<std::uint8_t>& out);
+
+    // 喂入的数据正好在帧边界结束
+    bool atFrameBoundary() const;
+
+private:
+    // 从in[pos, len)解出所有完整的帧，pos停在第一个不完整的帧
+    bool decodeFrames(const std::uint8_t* in, std::size_t len, std::size_t& pos, std::vector<std::uint8_t>& out);
+
+    std::vector<std::uint8_t> pending;  // 上次剩下的不完整的帧
+};
+
+} // namespace qrstream
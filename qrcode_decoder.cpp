@@ -0,0 +1,477 @@
+#include "qrcode_decoder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+using namespace qrcodegen;
+
+namespace
+{
+
+// 格式信息里纠错等级的编码（QrCode::getFormatBits()的逆），下标为格式信息的高2位
+constexpr QrCode::Ecc kFormatEcc[4] = {
+    QrCode::Ecc::MEDIUM, QrCode::Ecc::LOW, QrCode::Ecc::HIGH, QrCode::Ecc::QUARTILE,
+};
+
+// 32个合法的格式码：5位数据加10位BCH校验，再与0x5412异或，和QrCode::drawFormatBits()一样
+constexpr std::array<int, 32> kFormatCodes = [] {
+    std::array<int, 32> codes{};
+    for (int data = 0; data < 32; data++)
+    {
+        int rem = data;
+        for (int i = 0; i < 10; i++)
+            rem = (rem << 1) ^ ((rem >> 9) * 0x537);
+        codes[static_cast<std::size_t>(data)] = (data << 10 | rem) ^ 0x5412;
+    }
+    return codes;
+}();
+
+// 34个合法的版本码（版本7~40）：6位版本号加12位BCH校验，和QrCode::drawVersion()一样，下标为版本号 - 7
+constexpr std::array<long, 34> kVersionCodes = [] {
+    std::array<long, 34> codes{};
+    for (int version = 7; version <= 40; version++)
+    {
+        int rem = version;
+        for (int i = 0; i < 12; i++)
+            rem = (rem << 1) ^ ((rem >> 11) * 0x1F25);
+        codes[static_cast<std::size_t>(version - 7)] = static_cast<long>(version) << 12 | rem;
+    }
+    return codes;
+}();
+
+// GF(2^8/0x11D)的指数表和对数表，生成元0x02，和QrCode::reedSolomonMultiply()是同一个域。
+// 指数表存两个周期，两个对数相加不用取模
+struct GaloisField
+{
+    std::array<std::uint8_t, 510> exp{};
+    std::array<std::uint8_t, 256> log{};
+};
+
+constexpr GaloisField kField = [] {
+    GaloisField field;
+    int x = 1;
+    for (int i = 0; i < 255; i++)
+    {
+        field.exp[static_cast<std::size_t>(i)] = static_cast<std::uint8_t>(x);
+        field.exp[static_cast<std::size_t>(i + 255)] = static_cast<std::uint8_t>(x);
+        field.log[static_cast<std::size_t>(x)] = static_cast<std::uint8_t>(i);
+        x <<= 1;
+        if (x & 0x100)
+            x ^= 0x11D;
+    }
+    return field;
+}();
+
+constexpr int kMaxEccCodewords = 30;  // 每块纠错码字数的上限，和QrCode::MAX_ECC_CODEWORDS_PER_BLOCK一样
+
+std::uint8_t gfMultiply(std::uint8_t a, std::uint8_t b)
+{
+    if (a == 0 || b == 0)
+        return 0;
+    return kField.exp[static_cast<std::size_t>(kField.log[a] + kField.log[b])];
+}
+
+// b不能为0
+std::uint8_t gfDivide(std::uint8_t a, std::uint8_t b)
+{
+    if (a == 0)
+        return 0;
+    return kField.exp[static_cast<std::size_t>(kField.log[a] + 255 - kField.log[b])];
+}
+
+// α的power次方，power可以是任意非负数
+std::uint8_t gfPower(int power)
+{
+    return kField.exp[static_cast<std::size_t>(power % 255)];
+}
+
+// 求多项式在x处的值，poly[i]是i次项的系数
+std::uint8_t evaluate(const std::uint8_t* poly, int degree, std::uint8_t x)
+{
+    std::uint8_t value = 0;
+    for (int i = degree; i >= 0; i--)
+        value = static_cast<std::uint8_t>(gfMultiply(value, x) ^ poly[i]);
+    return value;
+}
+
+constexpr char kAlphanumericCharset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+// 各模式字符数字段的位数，按版本1~9、10~26、27~40分三档
+constexpr int kNumericCountBits[3] = { 10, 12, 14 };
+constexpr int kAlphanumericCountBits[3] = { 9, 11, 13 };
+constexpr int kByteCountBits[3] = { 8, 16, 16 };
+
+// 按位读数据码字，高位在前
+class BitReader
+{
+public:
+    BitReader(const std::uint8_t* bytes, std::size_t len) : buffer(bytes), bitCount(len * 8)
+    {
+    }
+
+    std::size_t remaining() const
+    {
+        return bitCount - position;
+    }
+
+    // 读bits（不超过32）位，不够时返回false
+    bool read(int bits, std::uint32_t& value)
+    {
+        if (static_cast<std::size_t>(bits) > remaining())
+            return false;
+        value = 0;
+        while (bits > 0)
+        {
+            const int available = 8 - static_cast<int>(position & 7);
+            const int take = std::min(available, bits);
+            const std::uint32_t part = (buffer[position >> 3] >> (available - take)) & ((1u << take) - 1);
+            value = value << take | part;
+            position += static_cast<std::size_t>(take);
+            bits -= take;
+        }
+        return true;
+    }
+
+private:
+    const std::uint8_t* buffer;
+    std::size_t bitCount;
+    std::size_t position = 0;
+};
+
+bool parseNumeric(BitReader& reader, std::uint32_t count, std::vector<std::uint8_t>& payload)
+{
+    std::uint32_t value = 0;
+    for (; count >= 3; count -= 3)
+    {
+        if (!reader.read(10, value) || value >= 1000)
+            return false;
+        payload.push_back(static_cast<std::uint8_t>('0' + value / 100));
+        payload.push_back(static_cast<std::uint8_t>('0' + value / 10 % 10));
+        payload.push_back(static_cast<std::uint8_t>('0' + value % 10));
+    }
+    if (count == 2)
+    {
+        if (!reader.read(7, value) || value >= 100)
+            return false;
+        payload.push_back(static_cast<std::uint8_t>('0' + value / 10));
+        payload.push_back(static_cast<std::uint8_t>('0' + value % 10));
+    }
+    else if (count == 1)
+    {
+        if (!reader.read(4, value) || value >= 10)
+            return false;
+        payload.push_back(static_cast<std::uint8_t>('0' + value));
+    }
+    return true;
+}
+
+bool parseAlphanumeric(BitReader& reader, std::uint32_t count, std::vector<std::uint8_t>& payload)
+{
+    std::uint32_t value = 0;
+    for (; count >= 2; count -= 2)
+    {
+        if (!reader.read(11, value) || value >= 45 * 45)
+            return false;
+        payload.push_back(static_cast<std::uint8_t>(kAlphanumericCharset[value / 45]));
+        payload.push_back(static_cast<std::uint8_t>(kAlphanumericCharset[value % 45]));
+    }
+    if (count == 1)
+    {
+        if (!reader.read(6, value) || value >= 45)
+            return false;
+        payload.push_back(static_cast<std::uint8_t>(kAlphanumericCharset[value]));
+    }
+    return true;
+}
+
+} // namespace
+
+bool QRDecoder::decode(const BitMatrix& modules, std::vector<std::uint8_t>& payload, Result* result)
+{
+    const int size = modules.getSize();
+    if (size < 21 || size > 177 || (size - 17) % 4 != 0)
+        return false;
+    const int version = (size - 17) / 4;
+    QrCode::Ecc ecc = QrCode::Ecc::LOW;
+    int mask = 0;
+    if (!readFormat(modules, ecc, mask))
+        return false;
+    // 版本信息和尺寸不符说明网格的尺寸估错了，调用者可以换个尺寸重新采样。版本信息读不出时按尺寸算
+    if (version >= 7)
+    {
+        const int markedVersion = readVersion(modules);
+        if (markedVersion != 0 && markedVersion != version)
+            return false;
+    }
+
+    // 按放置顺序取出码字位，同时去掉掩码。模块网格和模板的行宽一样，按整个网格连续的字下标访问
+    const QrVersionTemplate& versionTemplate = QrVersionTemplate::get(version);
+    const std::vector<std::uint32_t>& positions = versionTemplate.getCodewordBitPositions();
+    const std::uint64_t* grid = modules.getRow(0);
+    const std::uint64_t* maskWords = versionTemplate.getMaskPattern(mask).getRow(0);
+    codewords.assign(positions.size() / 8, 0);
+    for (std::size_t i = 0; i < positions.size(); i++)
+    {
+        const std::uint32_t p = positions[i];
+        const std::uint64_t word = grid[p >> 6] ^ maskWords[p >> 6];
+        codewords[i >> 3] = static_cast<std::uint8_t>(codewords[i >> 3] | ((word >> (p & 63)) & 1) << (7 - (i & 7)));
+    }
+
+    // 还原交错（QrCode::addEccAndInterleave()的逆）：第j列是各块的第j个字节，短块没有第shortDataLen列，
+    // 纠错码字的各列在全部数据码字之后。逐块纠错，再把数据码字拼起来
+    const QrCode::BlockLayout layout = QrCode::getBlockLayout(version, ecc);
+    const int shortDataLen = layout.shortBlockLen - layout.blockEccLen;
+    const int numLongBlocks = layout.numBlocks - layout.numShortBlocks;
+    int corrected = 0;
+    data.resize(static_cast<std::size_t>(layout.dataCodewords));
+    block.resize(static_cast<std::size_t>(layout.shortBlockLen + 1));
+    for (int i = 0, k = 0; i < layout.numBlocks; i++)
+    {
+        const int dataLen = shortDataLen + (i < layout.numShortBlocks ? 0 : 1);
+        for (int j = 0; j < shortDataLen; j++)
+            block[static_cast<std::size_t>(j)] = codewords[static_cast<std::size_t>(j * layout.numBlocks + i)];
+        if (i >= layout.numShortBlocks)
+            block[static_cast<std::size_t>(shortDataLen)] =
+                    codewords[static_cast<std::size_t>(shortDataLen * layout.numBlocks + i - layout.numShortBlocks)];
+        for (int j = 0; j < layout.blockEccLen; j++)
+            block[static_cast<std::size_t>(dataLen + j)] = codewords[static_cast<std::size_t>(
+                    (shortDataLen + j) * layout.numBlocks + numLongBlocks + i)];
+
+        const int errors = correctBlock(block.data(), dataLen + layout.blockEccLen, layout.blockEccLen);
+        if (errors < 0)
+            return false;
+        corrected += errors;
+        std::copy_n(block.begin(), dataLen, data.begin() + k);
+        k += dataLen;
+    }
+
+    payload.clear();
+    if (!parseSegments(data.data(), data.size(), version, payload))
+        return false;
+    if (result != nullptr)
+        *result = Result{ version, ecc, mask, corrected };
+    return true;
+}
+
+bool QRDecoder::readFormat(const BitMatrix& modules, QrCode::Ecc& ecc, int& mask)
+{
+    // 两份格式信息的位置和QrCode::drawFormatBits()一样，第i位对应格式码的第i位
+    const int size = modules.getSize();
+    int first = 0;
+    int second = 0;
+    auto bit = [&modules](int x, int y, int i) {
+        return modules.get(x, y) ? 1 << i : 0;
+    };
+    for (int i = 0; i <= 5; i++)
+        first |= bit(8, i, i);
+    first |= bit(8, 7, 6);
+    first |= bit(8, 8, 7);
+    first |= bit(7, 8, 8);
+    for (int i = 9; i < 15; i++)
+        first |= bit(14 - i, 8, i);
+    for (int i = 0; i < 8; i++)
+        second |= bit(size - 1 - i, 8, i);
+    for (int i = 8; i < 15; i++)
+        second |= bit(8, size - 15 + i, i);
+
+    // 合法格式码之间至少差7位，距离不超过3时可以确定是哪一个
+    int best = -1;
+    int bestDistance = 4;
+    for (int data = 0; data < 32; data++)
+    {
+        const auto code = static_cast<unsigned>(kFormatCodes[static_cast<std::size_t>(data)]);
+        const int distance = std::min(std::popcount(code ^ static_cast<unsigned>(first)),
+                std::popcount(code ^ static_cast<unsigned>(second)));
+        if (distance < bestDistance)
+        {
+            best = data;
+            bestDistance = distance;
+        }
+    }
+    if (best < 0)
+        return false;
+    ecc = kFormatEcc[best >> 3];
+    mask = best & 7;
+    return true;
+}
+
+int QRDecoder::readVersion(const BitMatrix& modules)
+{
+    // 两份版本信息的位置和QrCode::drawVersion()一样：右上角的一份在(a, b)，左下角的一份在(b, a)
+    const int size = modules.getSize();
+    long first = 0;
+    long second = 0;
+    for (int i = 0; i < 18; i++)
+    {
+        const int a = size - 11 + i % 3;
+        const int b = i / 3;
+        if (modules.get(a, b))
+            first |= 1L << i;
+        if (modules.get(b, a))
+            second |= 1L << i;
+    }
+
+    // 合法版本码之间至少差8位，距离不超过3时可以确定是哪一个
+    int best = 0;
+    int bestDistance = 4;
+    for (int version = 7; version <= 40; version++)
+    {
+        const auto code = static_cast<unsigned long>(kVersionCodes[static_cast<std::size_t>(version - 7)]);
+        const int distance = std::min(std::popcount(code ^ static_cast<unsigned long>(first)),
+                std::popcount(code ^ static_cast<unsigned long>(second)));
+        if (distance < bestDistance)
+        {
+            best = version;
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+int QRDecoder::correctBlock(std::uint8_t* block, int len, int eccLen)
+{
+    // 伴随式S_i = r(α^i)，i = 0 ~ eccLen - 1，和QrCode::reedSolomonComputeDivisor()的生成多项式的根对应。
+    // 块的第一个字节是最高次项。按字节累加：第k个字节对S_i的贡献是b_k·α^(i·(len - 1 - k))，
+    // 在对数域里指数每次加len - 1 - k，每项只要一次查表，没有错误时这是纠错的全部开销
+    std::uint8_t syndromes[kMaxEccCodewords] = {};
+    for (int k = 0; k < len; k++)
+    {
+        if (block[k] == 0)
+            continue;
+        const int step = (len - 1 - k) % 255;
+        int exponent = kField.log[block[k]];
+        for (int i = 0; i < eccLen; i++)
+        {
+            syndromes[i] ^= kField.exp[static_cast<std::size_t>(exponent)];
+            exponent += step;
+            if (exponent >= 255)
+                exponent -= 255;
+        }
+    }
+    if (std::all_of(syndromes, syndromes + eccLen, [](std::uint8_t value) { return value == 0; }))
+        return 0;
+
+    // Berlekamp-Massey：求错误位置多项式Λ(x)，次数errors就是错误码字数
+    std::uint8_t locator[kMaxEccCodewords + 1] = { 1 };
+    std::uint8_t previous[kMaxEccCodewords + 1] = { 1 };
+    std::uint8_t saved[kMaxEccCodewords + 1];
+    int errors = 0;
+    int shift = 1;
+    std::uint8_t previousDiscrepancy = 1;
+    for (int n = 0; n < eccLen; n++)
+    {
+        std::uint8_t discrepancy = syndromes[n];
+        for (int i = 1; i <= errors; i++)
+            discrepancy ^= gfMultiply(locator[i], syndromes[n - i]);
+        if (discrepancy == 0)
+        {
+            shift++;
+            continue;
+        }
+        const std::uint8_t scale = gfDivide(discrepancy, previousDiscrepancy);
+        const bool grow = 2 * errors <= n;
+        if (grow)
+            std::copy_n(locator, eccLen + 1, saved);
+        for (int i = 0; i + shift <= eccLen; i++)
+            locator[i + shift] ^= gfMultiply(scale, previous[i]);
+        if (grow)
+        {
+            errors = n + 1 - errors;
+            std::copy_n(saved, eccLen + 1, previous);
+            previousDiscrepancy = discrepancy;
+            shift = 1;
+        }
+        else
+        {
+            shift++;
+        }
+    }
+    if (errors == 0 || 2 * errors > eccLen)
+        return -1;
+
+    // 错误值多项式Ω(x) = S(x)Λ(x) mod x^eccLen
+    std::uint8_t evaluator[kMaxEccCodewords];
+    for (int i = 0; i < eccLen; i++)
+    {
+        std::uint8_t value = 0;
+        for (int j = 0; j <= std::min(i, errors); j++)
+            value ^= gfMultiply(syndromes[i - j], locator[j]);
+        evaluator[i] = value;
+    }
+
+    // Chien搜索找Λ(x)的根：第k个字节是x^(len - 1 - k)项，位置值X = α^(len - 1 - k)，Λ(X^-1) = 0时这个字节有错。
+    // Forney算法求错误值，生成多项式的根从α^0开始，e = X·Ω(X^-1) / Λ'(X^-1)
+    int found = 0;
+    for (int k = 0; k < len; k++)
+    {
+        const int power = len - 1 - k;
+        const std::uint8_t inverse = gfPower(255 - power);
+        if (evaluate(locator, errors, inverse) != 0)
+            continue;
+        // 特征为2，Λ'(x)只剩奇次项：Λ'(x) = Σ Λ_i x^(i-1)，i为奇数
+        std::uint8_t derivative = 0;
+        for (int i = 1; i <= errors; i += 2)
+            derivative ^= gfMultiply(locator[i], gfPower(kField.log[inverse] * (i - 1)));
+        if (derivative == 0)
+            return -1;
+        const std::uint8_t magnitude = gfMultiply(gfPower(power),
+                gfDivide(evaluate(evaluator, eccLen - 1, inverse), derivative));
+        block[k] ^= magnitude;
+        found++;
+    }
+    // 根的个数和次数对不上说明错误超出了纠错能力，块已经改过了也没关系，整个码都会被丢掉
+    return found == errors ? errors : -1;
+}
+
+bool QRDecoder::parseSegments(const std::uint8_t* data, std::size_t len, int version,
+        std::vector<std::uint8_t>& payload)
+{
+    const int group = version <= 9 ? 0 : version <= 26 ? 1 : 2;
+    BitReader reader(data, len);
+    std::uint32_t mode = 0;
+    std::uint32_t count = 0;
+    for (;;)
+    {
+        // 终止符，或者数据区正好用完（剩下不到4位时可以省略终止符）
+        if (reader.remaining() < 4 || !reader.read(4, mode) || mode == 0)
+            return true;
+        switch (mode)
+        {
+            case 0x1:
+                if (!reader.read(kNumericCountBits[group], count) || !parseNumeric(reader, count, payload))
+                    return false;
+                break;
+            case 0x2:
+                if (!reader.read(kAlphanumericCountBits[group], count) || !parseAlphanumeric(reader, count, payload))
+                    return false;
+                break;
+            case 0x4:
+                if (!reader.read(kByteCountBits[group], count))
+                    return false;
+                for (std::uint32_t i = 0, value = 0; i < count; i++)
+                {
+                    if (!reader.read(8, value))
+                        return false;
+                    payload.push_back(static_cast<std::uint8_t>(value));
+                }
+                break;
+            case 0x7:
+            {
+                // ECI指示符只影响字符集，跳过：1到3字节，由第一个字节的高位决定长度
+                std::uint32_t first = 0;
+                std::uint32_t rest = 0;
+                if (!reader.read(8, first))
+                    return false;
+                if ((first & 0x80) == 0)
+                    break;
+                if ((first & 0xC0) == 0x80 ? !reader.read(8, rest) :
+                        (first & 0xE0) == 0xC0 ? !reader.read(16, rest) : true)
+                    return false;
+                break;
+            }
+            default:
+                return false;  // 汉字、结构链接等发送端不会用到的模式
+        }
+    }
+}
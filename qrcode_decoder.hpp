@@ -0,0 +1,49 @@
+#pragma once
+
+#include "qrcodegen.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 二维码解码，是QrCode编码过程的逆过程：输入采样好的模块网格，输出码里的载荷。
+// 先读格式信息得到纠错等级和掩码（版本7起再用版本信息核对网格尺寸），再用QrVersionTemplate的掩码图和码字位置表
+// 去掉掩码、按放置顺序取出码字，按getBlockLayout()的分块还原交错，每块用Reed-Solomon纠错，最后解析各个数据段。
+// 字节段原样输出，字母数字段和数字段输出对应的ASCII字符，
+// 拼起来正好是发送端各种封装的载荷（见qrcode_stream_frame.hpp）。
+// 每块最多纠正纠错码字数一半的错误码字，超出时多半能发现而返回false，偶尔会纠成别的码字，由块的CRC把关。
+// 缓冲区在对象里复用，每个解码线程一个。
+class QRDecoder
+{
+public:
+    struct Result
+    {
+        int version = 0;
+        qrcodegen::QrCode::Ecc ecc = qrcodegen::QrCode::Ecc::LOW;
+        int mask = 0;
+        int correctedCodewords = 0;  // Reed-Solomon纠正的码字数
+    };
+
+    // modules是version * 4 + 17见方的模块网格，置位为深色。成功时载荷写入payload（复用其容量），
+    // 码的参数写入result（可以为nullptr）。尺寸不对、格式信息无法识别、版本信息与尺寸不符、
+    // 错误超出纠错能力或数据段格式不对时返回false
+    bool decode(const qrcodegen::BitMatrix& modules, std::vector<std::uint8_t>& payload, Result* result = nullptr);
+
+private:
+    // 读两份格式信息，取与合法格式码距离最小的一个，距离超过3时返回false
+    static bool readFormat(const qrcodegen::BitMatrix& modules, qrcodegen::QrCode::Ecc& ecc, int& mask);
+
+    // 读两份版本信息（版本7起才有），取与合法版本码距离最小的一个，距离超过3时返回0
+    static int readVersion(const qrcodegen::BitMatrix& modules);
+
+    // 就地纠正一个块（数据码字在前，eccLen个纠错码字在后），返回纠正的码字数，无法纠正时返回-1
+    static int correctBlock(std::uint8_t* block, int len, int eccLen);
+
+    // 按版本解析data里的数据段，依次追加到payload
+    static bool parseSegments(const std::uint8_t* data, std::size_t len, int version,
+            std::vector<std::uint8_t>& payload);
+
+    std::vector<std::uint8_t> codewords;  // 按放置顺序取出的全部码字（交错的）
+    std::vector<std::uint8_t> block;      // 正在纠错的块
+    std::vector<std::uint8_t> data;       // 还原交错、纠错后的数据码字
+};
@@ -0,0 +1,145 @@
+#include "qrcode_frame_decoder.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+QRFrameDecoder::QRFrameDecoder(bool tracking) :
+    trackingEnabled(tracking)
+{
+}
+
+std::size_t QRFrameDecoder::decode(const QRGrayFrame& frame, std::vector<std::vector<std::uint8_t>>& payloads)
+{
+    const Clock::time_point start = Clock::now();
+    binarizer.binarize(frame, binary);
+    counters.binarizeTime += Clock::now() - start;
+
+    std::size_t found = 0;
+    if (trackingEnabled && !tracked.empty() && tracked.size() >= expectedCodes &&
+            ++framesSinceDetection < kRedetectInterval && decodeTracked(payloads, found))
+    {
+        counters.trackedFrames++;
+    }
+    else
+    {
+        found = 0;
+        detect(payloads, found);
+        counters.redetections++;
+        framesSinceDetection = 0;
+        if (found >= expectedCodes || ++shortDetections >= kRedetectInterval)
+        {
+            expectedCodes = found;
+            shortDetections = 0;
+        }
+    }
+    counters.frames++;
+    counters.decodedCodes += found;
+    return found;
+}
+
+bool QRFrameDecoder::decodeTracked(std::vector<std::vector<std::uint8_t>>& payloads, std::size_t& found)
+{
+    const Clock::time_point start = Clock::now();
+    bool lost = false;
+    for (TrackedCode& code : tracked)
+    {
+        if (found == payloads.size())
+            payloads.emplace_back();
+        // 先按原来的变换解码。通不过核对或者解不出时画面可能稍有移动、透视稍有变化，
+        // 在原来的位置附近重新找定位图案和校正图案，按新的变换再试一次
+        QRDecoder::Result result;
+        bool present = QRLocator::sampleGrid(binary, code.transform, code.dimension, modules) &&
+                QRLocator::verifyGrid(modules);
+        bool decoded = present && decoder.decode(modules, payloads[found], &result);
+        QRLocator::Homography moved;
+        if (!decoded && QRLocator::followTransform(binary, code.transform, code.dimension, moved) &&
+                QRLocator::sampleGrid(binary, moved, code.dimension, modules) && QRLocator::verifyGrid(modules))
+        {
+            code.transform = moved;
+            present = true;
+            decoded = decoder.decode(modules, payloads[found], &result);
+        }
+        if (!present)
+        {
+            lost = true;
+            break;
+        }
+        if (decoded)
+        {
+            counters.correctedCodewords += static_cast<std::uint64_t>(result.correctedCodewords);
+            found++;
+        }
+    }
+    counters.decodeTime += Clock::now() - start;
+    return !lost;
+}
+
+void QRFrameDecoder::detect(std::vector<std::vector<std::uint8_t>>& payloads, std::size_t& found)
+{
+    const Clock::time_point start = Clock::now();
+    QRLocator::findFinderPatterns(binary, patterns);
+    QRLocator::groupCandidates(patterns, candidates);
+    const Clock::time_point located = Clock::now();
+
+    tracked.clear();
+    usedPatterns.assign(patterns.size(), false);
+    for (const QRLocator::Candidate& candidate : candidates)
+    {
+        if (usedPatterns[candidate.topLeft] || usedPatterns[candidate.topRight] || usedPatterns[candidate.bottomLeft])
+            continue;
+        counters.candidates++;
+        if (found == payloads.size())
+            payloads.emplace_back();
+        bool decoded = false;
+        for (const int dimension : { candidate.dimension, candidate.dimension - 4, candidate.dimension + 4 })
+        {
+            if (dimension < 21 || dimension > 177)
+                continue;
+            // 定时图案的段数对不上时，定位图案配错了或者尺寸估错了，不必再找校正图案。
+            // 对得上时先试按校正图案求出的透视变换：有透视时仿射变换采样的右下部分是错的，连核对都通不过。
+            // 找不到校正图案或者解不出时退回仿射变换
+            const QRLocator::Homography affine = QRLocator::affineTransform(patterns, candidate, dimension);
+            if (!QRLocator::verifyTiming(binary, affine, dimension))
+                continue;
+            QRLocator::Homography perspective;
+            if (QRLocator::refineWithAlignment(binary, affine, dimension, perspective) &&
+                    decodeGrid(perspective, dimension, payloads[found]))
+            {
+                tracked.push_back({ perspective, dimension });
+                decoded = true;
+            }
+            else if (decodeGrid(affine, dimension, payloads[found]))
+            {
+                tracked.push_back({ affine, dimension });
+                decoded = true;
+            }
+            if (decoded)
+                break;
+        }
+        if (!decoded)
+            continue;
+        usedPatterns[candidate.topLeft] = true;
+        usedPatterns[candidate.topRight] = true;
+        usedPatterns[candidate.bottomLeft] = true;
+        found++;
+    }
+
+    counters.finderPatterns += patterns.size();
+    counters.locateTime += located - start;
+    counters.decodeTime += Clock::now() - located;
+}
+
+bool QRFrameDecoder::decodeGrid(const QRLocator::Homography& transform, int dimension,
+        std::vector<std::uint8_t>& payload)
+{
+    QRDecoder::Result result;
+    if (!QRLocator::sampleGrid(binary, transform, dimension, modules) || !QRLocator::verifyGrid(modules) ||
+            !decoder.decode(modules, payload, &result))
+        return false;
+    counters.correctedCodewords += static_cast<std::uint64_t>(result.correctedCodewords);
+    return true;
+}
+
+const QRFrameDecoder::Stats& QRFrameDecoder::stats() const
+{
+    return counters;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "qrcode_binarizer.hpp"
+#include "qrcode_decoder.hpp"
+#include "qrcode_frame_source.hpp"
+#include "qrcode_locator.hpp"
+#include "qrcodegen.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 从一帧灰度图里解出所有二维码的载荷：二值化 → 找定位图案 → 配成候选码 → 采样 → 核对 → 解码。
+// 候选码按边长从小到大尝试，解码成功的码占用它的三个定位图案，平铺的码互相之间不会配错。
+// 估算的尺寸解码失败时再试相邻的两个版本。缓冲区在对象里复用，每个处理线程一个。
+// 跟踪模式下记住上一次完整检测解出的各个码的变换，之后的帧不找定位图案，直接按变换采样：
+// 摄像头和屏幕不动时只需二值化和采样。按原来的变换解不出时在原来的位置附近重新找定位图案和校正图案，
+// 跟上画面小的移动和透视变化。有一个码这样仍通不过verifyGrid（画面移动太多、码的布局变了）就重新完整检测；
+// 通过核对但解码失败（帧正好在刷新一半时拍下）不算丢失。
+// 跟踪只看已知的位置，分片末尾没有铺满的帧之后重新出现的码看不到，所以跟踪的码比之前完整检测解出的最多个数少时
+// 每帧都完整检测，连续kRedetectInterval帧都少才接受变少了的布局；另外每kRedetectInterval帧完整检测一次，发现新增的码。
+class QRFrameDecoder
+{
+public:
+    // 各阶段的累计耗时和计数
+    struct Stats
+    {
+        std::uint64_t frames = 0;
+        std::uint64_t finderPatterns = 0;
+        std::uint64_t candidates = 0;          // 尝试过的候选码
+        std::uint64_t decodedCodes = 0;
+        std::uint64_t correctedCodewords = 0;  // 解出的码里Reed-Solomon纠正的码字
+        std::uint64_t trackedFrames = 0;       // 按跟踪的变换解码、没有扫描整张图的帧
+        std::uint64_t redetections = 0;        // 完整检测的帧
+        std::chrono::nanoseconds binarizeTime{ 0 };
+        std::chrono::nanoseconds locateTime{ 0 };  // 找定位图案和配对
+        std::chrono::nanoseconds decodeTime{ 0 };  // 采样、核对和解码，含跟踪模式下重新找图案和采样
+    };
+
+    static constexpr int kRedetectInterval = 30;
+
+    explicit QRFrameDecoder(bool tracking = true);
+
+    // 解出的载荷写进payloads的前若干项（复用各项的容量，payloads只增不减），返回解出的个数
+    std::size_t decode(const QRGrayFrame& frame, std::vector<std::vector<std::uint8_t>>& payloads);
+
+    const Stats& stats() const;
+
+private:
+    struct TrackedCode
+    {
+        QRLocator::Homography transform;
+        int dimension = 0;
+    };
+
+    // 按跟踪的变换解码并更新变换，有码丢失时返回false
+    bool decodeTracked(std::vector<std::vector<std::uint8_t>>& payloads, std::size_t& found);
+    // 找定位图案、配对、逐个候选码解码，解出的码记进tracked
+    void detect(std::vector<std::vector<std::uint8_t>>& payloads, std::size_t& found);
+    // 采样、核对、解码一个码
+    bool decodeGrid(const QRLocator::Homography& transform, int dimension, std::vector<std::uint8_t>& payload);
+
+    bool trackingEnabled;
+    std::vector<TrackedCode> tracked;
+    std::size_t expectedCodes = 0;  // 完整检测解出的最多个数
+    int shortDetections = 0;        // 连续解出的个数少于expectedCodes的完整检测
+    int framesSinceDetection = 0;
+    QRBinarizer binarizer;
+    QRBinaryImage binary;
+    std::vector<QRLocator::FinderPattern> patterns;
+    std::vector<QRLocator::Candidate> candidates;
+    std::vector<bool> usedPatterns;
+    qrcodegen::BitMatrix modules;
+    QRDecoder decoder;
+    Stats counters;
+};
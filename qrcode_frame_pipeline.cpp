@@ -0,0 +1,369 @@
+#include "qrcode_frame_pipeline.hpp"
+#include "qrcode_payload_encoder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+using namespace qrcodegen;
+
+// 帧总数：排队的帧，加上每个工作线程手里正在渲染的一帧，再加上显示线程正在呈现的一帧
+static std::size_t poolSize(const QRFramePipeline::Config& config)
+{
+    if (config.workerCount < 1 || config.queueDepth < 1)
+        throw std::domain_error("Worker count and queue depth must be positive");
+    return static_cast<std::size_t>(config.queueDepth) + static_cast<std::size_t>(config.workerCount) + 1;
+}
+
+QRFramePipeline::QRFramePipeline(const std::uint8_t* fileData, std::size_t fileSize, const Config& pipelineConfig) :
+    data(fileData), dataBytes(fileSize), config(pipelineConfig), freeFrames(poolSize(pipelineConfig)),
+    readyFrames(poolSize(pipelineConfig))
+{
+    if (config.packetSize < 1 || config.qrVersion < 0 || config.quietZone < 0 || config.tileColumns < 1 ||
+            config.tileRows < 1 || config.chunkBlocks < 2 || config.chunkBlocks > 63999)
+        throw std::domain_error("Invalid pipeline configuration");
+    if (dataBytes == 0)
+        throw std::domain_error("Nothing to send");
+    if (dataBytes > qrstream::kMaxFileBytes)
+        throw std::domain_error("Data too large");
+
+    // 块头和CRC的空间按带完整尺寸的块预留，只带配置哈希的块会剩下几个字节
+    std::uint64_t packet = static_cast<std::uint64_t>(config.packetSize);
+    if (config.qrVersion != 0)
+    {
+        // 块大小取目标版本能装下的最大值。块头的长度又和块大小决定的分片数有关，
+        // 从按最长块头算的块大小开始，逐字节增大到再大就装不下为止
+        version = config.qrVersion;
+        const std::size_t blockBytes = QRPayloadEncoder::maxBlockBytes(config.framing, version, config.ecc);
+        // 块头里的各个尺寸都取最小值时的开销，连1字节的块也装不下时不必再按分片数算，
+        // 否则大文件按1字节的块切出的分片太多，报错的是分片数
+        if (blockBytes <= qrstream::maxBlockOverhead(dataBytes, 1, 1, 1))
+            throw std::domain_error("QR version too small for a block");
+        constexpr std::size_t maxOverhead = qrstream::kMaxBlockHeaderBytes + qrstream::kBlockCrcBytes;
+        packet = blockBytes > maxOverhead ? blockBytes - maxOverhead : 0;
+        while (packet + 1 + overheadFor(packet + 1) <= blockBytes)
+            packet++;
+        if (packet == 0)
+            throw std::domain_error("QR version too small for a block");
+        config.packetSize = static_cast<int>(packet);
+        blockOverhead = overheadFor(packet);
+    }
+    else
+    {
+        // 能装下一个完整块（封装后）的最小版本
+        blockOverhead = overheadFor(packet);
+        version = QRPayloadEncoder::minVersion(config.framing, static_cast<std::size_t>(packet) + blockOverhead,
+                config.ecc);
+    }
+    // wirehair至少要2个原始块
+    if (dataBytes <= packet)
+        throw std::domain_error("Data fits in a single block, use a smaller packet size or QR version");
+    layoutChunks(packet, chunks, chunkStride);
+    session = static_cast<std::uint16_t>(std::random_device{}());
+
+    std::vector<std::uint32_t> chunkBlocks(chunks);
+    for (std::uint32_t i = 0; i < chunks; i++)
+        chunkBlocks[i] = static_cast<std::uint32_t>((chunkBytesOf(i) + packet - 1) / packet);
+    QRBlockSchedule::Config scheduleConfig;
+    scheduleConfig.activeChunks = config.activeChunks;
+    scheduleConfig.overheadTarget = config.overheadTarget;
+    scheduleConfig.repairRatio = config.repairRatio;
+    scheduleConfig.loop = config.loop;
+    schedule = std::make_unique<QRBlockSchedule>(std::move(chunkBlocks), scheduleConfig);
+    slots.resize(schedule->slotCount());
+
+    const std::size_t count = poolSize(config);
+    frames.reserve(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        frames.push_back(std::make_unique<Frame>());
+        freeFrames.tryPush(frames.back().get());
+    }
+}
+
+QRFramePipeline::~QRFramePipeline()
+{
+    stop();
+    for (ChunkSlot& slot : slots)
+        wirehair_free(slot.encoder);
+}
+
+void QRFramePipeline::layoutChunks(std::uint64_t packet, std::uint32_t& count, std::uint64_t& stride) const
+{
+    stride = static_cast<std::uint64_t>(config.chunkBlocks) * packet;
+    // 只剩一个块的最后一片并入前一片（这一片因此最多chunkBlocks + 1个块）
+    const std::uint64_t n = qrstream::chunkCountFor(dataBytes, stride, packet);
+    if (n > qrstream::kMaxChunkCount)
+        throw std::domain_error("Too many chunks, use more blocks per chunk");
+    count = static_cast<std::uint32_t>(n);
+}
+
+std::size_t QRFramePipeline::overheadFor(std::uint64_t packet) const
+{
+    std::uint32_t count = 0;
+    std::uint64_t stride = 0;
+    layoutChunks(packet, count, stride);
+    const std::uint64_t last = dataBytes - static_cast<std::uint64_t>(count - 1) * stride;
+    const std::uint64_t largest = count > 1 ? std::max(stride, last) : last;
+    if (largest > UINT32_MAX || packet > UINT32_MAX)
+        throw std::domain_error("Chunk too large");
+    return qrstream::maxBlockOverhead(dataBytes, count, static_cast<std::uint32_t>(largest),
+            static_cast<std::uint32_t>(packet));
+}
+
+std::uint32_t QRFramePipeline::chunkBytesOf(std::uint32_t chunkIndex) const
+{
+    if (chunkIndex + 1 < chunks)
+        return static_cast<std::uint32_t>(chunkStride);
+    return static_cast<std::uint32_t>(dataBytes - static_cast<std::uint64_t>(chunks - 1) * chunkStride);
+}
+
+void QRFramePipeline::startChunk(ChunkSlot& slot, std::uint32_t chunkIndex)
+{
+    slot.chunkIndex = chunkIndex;
+    slot.chunkBytes = chunkBytesOf(chunkIndex);
+
+    // 复用换下来的分片的编码器对象
+    const std::uint64_t offset = qrstream::chunkOffset(chunkIndex, chunks, dataBytes, slot.chunkBytes);
+    WirehairCodec codec = wirehair_encoder_create(slot.encoder, data + static_cast<std::size_t>(offset),
+            slot.chunkBytes, static_cast<std::uint32_t>(config.packetSize));
+    if (!codec)
+        throw std::runtime_error("Failed to create encoder for chunk " + std::to_string(chunkIndex));
+    slot.encoder = codec;
+}
+
+void QRFramePipeline::start()
+{
+    if (running.exchange(true))
+        return;
+    activeWorkers = config.workerCount;
+    for (int i = 0; i < config.workerCount; i++)
+        workers.emplace_back(&QRFramePipeline::workerLoop, this);
+}
+
+void QRFramePipeline::stop()
+{
+    running = false;
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+QRFramePipeline::Frame* QRFramePipeline::tryAcquire()
+{
+    Frame* frame = nullptr;
+    if (!readyFrames.tryPop(frame))
+    {
+        consumerStalls.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return frame;
+}
+
+void QRFramePipeline::release(Frame* frame)
+{
+    freeFrames.tryPush(frame);  // 队列容量不小于帧总数，不会失败
+}
+
+QRFramePipeline::Stats QRFramePipeline::stats() const
+{
+    Stats result;
+    result.queueDepth = readyFrames.sizeApprox();
+    result.queueCapacity = static_cast<std::size_t>(config.queueDepth);
+    result.producedFrames = producedFrames.load(std::memory_order_relaxed);
+    result.producerStalls = producerStalls.load(std::memory_order_relaxed);
+    result.consumerStalls = consumerStalls.load(std::memory_order_relaxed);
+    result.pass = schedulePass.load(std::memory_order_relaxed);
+    result.sentBlocks = sentBlocks.load(std::memory_order_relaxed);
+    result.acknowledgedChunks = acknowledgedChunks.load(std::memory_order_relaxed);
+    return result;
+}
+
+int QRFramePipeline::qrVersion() const
+{
+    return version;
+}
+
+int QRFramePipeline::packetSize() const
+{
+    return config.packetSize;
+}
+
+std::uint16_t QRFramePipeline::sessionId() const
+{
+    return session;
+}
+
+std::uint32_t QRFramePipeline::chunkCount() const
+{
+    return chunks;
+}
+
+void QRFramePipeline::acknowledgeChunk(std::uint32_t chunkIndex)
+{
+    std::lock_guard<std::mutex> lock(acknowledgeMutex);
+    pendingAcknowledgements.push_back(chunkIndex);
+}
+
+bool QRFramePipeline::finished() const
+{
+    return running.load(std::memory_order_relaxed) && activeWorkers.load(std::memory_order_acquire) == 0 &&
+            readyFrames.sizeApprox() == 0;
+}
+
+bool QRFramePipeline::failed() const
+{
+    return hasFailed.load(std::memory_order_acquire);
+}
+
+std::string QRFramePipeline::errorMessage() const
+{
+    std::lock_guard<std::mutex> lock(errorMutex);
+    return error;
+}
+
+void QRFramePipeline::fail(std::string text)
+{
+    {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!hasFailed.load(std::memory_order_relaxed))
+            error = std::move(text);
+    }
+    hasFailed.store(true, std::memory_order_release);
+    running = false;
+}
+
+void QRFramePipeline::workerLoop()
+try
+{
+    // 每个工作线程有自己的编码上下文和输出，互不共享
+    QRPayloadEncoder qrEncoder(config.framing, config.ecc);
+    QrCode qr = QrEncoderContext::makeOutput();
+    const int blockCount = config.tileColumns * config.tileRows;
+    const size_t blockStride = static_cast<size_t>(config.packetSize) + blockOverhead;  // 块头、块数据和CRC
+    std::vector<uint8_t> blocks(static_cast<size_t>(blockCount) * blockStride);
+    std::vector<size_t> headerLengths(static_cast<size_t>(blockCount));
+    std::vector<uint32_t> blockLengths(static_cast<size_t>(blockCount));
+
+    qrstream::BlockHeader header;
+    header.sessionId = session;
+    header.compression = config.compression;
+    header.chunkCount = chunks;
+    header.fileBytes = dataBytes;
+    header.blockBytes = static_cast<uint32_t>(config.packetSize);
+
+    const int qrSize = version * 4 + 17;
+    const int pitch = qrSize + config.quietZone;  // 相邻两个码左上角的距离
+    const int width = config.tileColumns * pitch + config.quietZone;
+    const int height = config.tileRows * pitch + config.quietZone;
+    bool stalled = false;
+
+    while (running.load(std::memory_order_relaxed))
+    {
+        Frame* frame = nullptr;
+        if (!freeFrames.tryPop(frame))
+        {
+            // 预渲染的帧已经排满，等显示线程归还
+            if (!stalled)
+                producerStalls.fetch_add(1, std::memory_order_relaxed);
+            stalled = true;
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            continue;
+        }
+        stalled = false;
+
+        // 按发送计划取这一帧的块，块编码本身很快，整帧在一次加锁内完成
+        int codeCount = 0;
+        uint32_t firstChunk = 0;
+        uint32_t firstBlockId = 0;
+        WirehairResult encodeResult = Wirehair_Success;
+        {
+            std::lock_guard<std::mutex> lock(encoderMutex);
+            {
+                std::lock_guard<std::mutex> acknowledgeLock(acknowledgeMutex);
+                for (uint32_t chunkIndex : pendingAcknowledgements)
+                    schedule->acknowledge(chunkIndex);
+                pendingAcknowledgements.clear();
+            }
+
+            QRBlockSchedule::Block next;
+            while (codeCount < blockCount && encodeResult == Wirehair_Success && schedule->next(next))
+            {
+                ChunkSlot& slot = slots[next.slot];
+                if (next.startsChunk)
+                    startChunk(slot, next.chunkIndex);
+
+                header.chunkIndex = next.chunkIndex;
+                header.blockId = next.blockId;
+                header.hasSizes = next.blockId % qrstream::kFullHeaderInterval == 0;
+                header.messageBytes = slot.chunkBytes;
+                if (codeCount == 0)
+                {
+                    firstChunk = header.chunkIndex;
+                    firstBlockId = header.blockId;
+                }
+                if (next.blockId > qrstream::kMaxBlockId)
+                {
+                    encodeResult = Wirehair_Error;
+                    break;
+                }
+
+                const auto index = static_cast<size_t>(codeCount);
+                uint8_t* block = &blocks[index * blockStride];
+                headerLengths[index] = qrstream::writeBlockHeader(header, block);
+                encodeResult = wirehair_encode(slot.encoder, next.blockId, block + headerLengths[index],
+                        static_cast<uint32_t>(config.packetSize), &blockLengths[index]);
+                codeCount++;
+            }
+
+            const QRBlockSchedule::Stats scheduleStats = schedule->stats();
+            schedulePass.store(scheduleStats.pass, std::memory_order_relaxed);
+            sentBlocks.store(scheduleStats.sentBlocks, std::memory_order_relaxed);
+            acknowledgedChunks.store(scheduleStats.acknowledgedChunks, std::memory_order_relaxed);
+        }
+        if (encodeResult != Wirehair_Success)
+        {
+            freeFrames.tryPush(frame);
+            fail("Encode failed at chunk " + std::to_string(header.chunkIndex) + " block " +
+                    std::to_string(header.blockId));
+            return;
+        }
+        if (codeCount == 0)
+        {
+            // 发送计划结束
+            freeFrames.tryPush(frame);
+            activeWorkers.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+
+        // 计划在帧中间结束时，剩下的位置留空
+        frame->image.reset(width, height);
+        frame->payloadBytes = 0;
+        for (int i = 0; i < codeCount; i++)
+        {
+            const auto index = static_cast<size_t>(i);
+            uint8_t* block = &blocks[index * blockStride];
+            const size_t blockLen = qrstream::sealBlock(block, headerLengths[index] + blockLengths[index]);
+
+            // 以固定版本创建二维码，画到网格里对应的位置
+            const size_t payloadLen = qrEncoder.encode(block, blockLen, version, qr);
+            const int column = i % config.tileColumns;
+            const int row = i / config.tileColumns;
+            frame->image.drawQrCode(qr, config.quietZone + column * pitch, config.quietZone + row * pitch);
+            frame->payloadBytes += payloadLen;
+        }
+        frame->chunkIndex = firstChunk;
+        frame->firstBlockId = firstBlockId;
+        frame->blockCount = codeCount;
+
+        readyFrames.tryPush(frame);  // 队列容量不小于帧总数，不会失败
+        producedFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+catch (const std::exception& e)
+{
+    fail(e.what());
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "bounded_ring.hpp"
+#include "qrcode_block_schedule.hpp"
+#include "qrcode_module_image.hpp"
+#include "qrcode_stream_frame.hpp"
+#include "qrcodegen.hpp"
+#include "wirehair.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 后台编码流水线：若干工作线程各自完成 wirehair分块 → 二维码编码 → 模块图 的全部工作，
+// 把渲染好的帧放进无锁有界队列，显示线程只取帧、呈现、归还，不做任何编码。
+// 帧对象预先分配好，在空闲队列和就绪队列之间循环使用，稳态下不分配内存。
+//
+// 一帧可以是tileColumns×tileRows个独立的二维码，每个码承载一个带块头和CRC的wirehair块（格式见qrcode_stream_frame.hpp），
+// 接收端各自解码即可。所有码的版本相同，大小一致，排列成规则网格，
+// 码与码之间、码与图边缘之间都留quietZone个模块的静区。
+//
+// 版本有两种定法：qrVersion为0时取能装下packetSize字节块的最小版本，码里通常会剩下一些填充；
+// qrVersion不为0时反过来，packetSize改为这个版本和纠错等级下能装下的最大块，码里几乎没有填充。
+//
+// 数据按chunkBlocks个块切成分片，每个分片一个wirehair编码器。发送哪个分片的哪个块由QRBlockSchedule决定：
+// 同时只有activeChunks个分片在发送，各码轮流取这些分片的块，先发原始块再发修复块。
+// 计划结束后工作线程退出，显示完已渲染的帧后finished()为true；接收端确认的分片通过acknowledgeChunk()不再发送。
+// 编码器的内存只和活动分片的大小有关，数据本身由调用者提供（可以是映射的文件），流水线不复制。
+class QRFramePipeline
+{
+public:
+    struct Config
+    {
+        int packetSize = 600;   // wirehair块大小（字节），qrVersion不为0时忽略
+        int qrVersion = 0;      // 目标二维码版本，0为按packetSize自动选择
+        qrcodegen::QrCode::Ecc ecc = qrcodegen::QrCode::Ecc::LOW;  // 纠错等级
+        qrstream::Framing framing = qrstream::Framing::Raw;  // 块在二维码里的封装
+        int quietZone = 10;     // 静区宽度（模块数）
+        int tileColumns = 1;    // 每帧的二维码列数
+        int tileRows = 1;       // 每帧的二维码行数
+        int workerCount = 2;    // 工作线程数
+        int queueDepth = 8;     // 最多预先渲染的帧数
+        int chunkBlocks = 16000;       // 每个分片的原始块数（wirehair一个消息最多64000块）
+        int activeChunks = 4;          // 同时交错发送的分片数
+        double overheadTarget = 1.05;  // 第一轮每个分片发送的块数相对其原始块数的倍数
+        double repairRatio = 0.5;      // 之后每轮每个分片再发的修复块数相对其原始块数的倍数
+        bool loop = false;             // 第一轮之后是否继续发送接收端还没确认的分片
+        qrstream::Compression compression = qrstream::Compression::None;  // 数据是否是调用者压缩好的压缩流，写在块头里
+    };
+
+    struct Frame
+    {
+        QRModuleImage image;             // 整帧的模块图，含静区
+        std::uint32_t chunkIndex = 0;    // 第一个码的分片序号和块编号
+        std::uint32_t firstBlockId = 0;
+        int blockCount = 0;              // 帧里的码数，计划结束时的最后一帧可能不满
+        std::size_t payloadBytes = 0;    // 帧里所有二维码承载的字节数
+    };
+
+    struct Stats
+    {
+        std::size_t queueDepth = 0;          // 已渲染、等待呈现的帧数
+        std::size_t queueCapacity = 0;
+        std::uint64_t producedFrames = 0;
+        std::uint64_t producerStalls = 0;    // 空闲帧用完、工作线程只能等待的次数（显示跟不上）
+        std::uint64_t consumerStalls = 0;    // 显示线程取帧时队列为空的次数（编码跟不上）
+        std::uint32_t pass = 1;              // 发送计划的第几轮
+        std::uint64_t sentBlocks = 0;
+        std::uint32_t acknowledgedChunks = 0;
+    };
+
+    // 发送data开始的size字节，data在流水线销毁前必须一直有效。
+    // 创建wirehair编码器失败时抛出std::runtime_error；配置不合法时抛出std::domain_error
+    QRFramePipeline(const std::uint8_t* data, std::size_t size, const Config& config);
+    ~QRFramePipeline();
+
+    QRFramePipeline(const QRFramePipeline&) = delete;
+    QRFramePipeline& operator=(const QRFramePipeline&) = delete;
+
+    void start();
+    void stop();
+
+    // 显示线程：取一帧已渲染的帧，没有时返回nullptr。用完后必须release()
+    Frame* tryAcquire();
+    void release(Frame* frame);
+
+    Stats stats() const;
+
+    // 每个二维码使用的版本
+    int qrVersion() const;
+
+    // 实际使用的wirehair块大小（字节）
+    int packetSize() const;
+
+    // 本次发送的会话id，写在每个块头里
+    std::uint16_t sessionId() const;
+
+    std::uint32_t chunkCount() const;
+
+    // 接收端确认分片已经解完，可以在任意线程调用。确认在渲染下一帧时生效
+    void acknowledgeChunk(std::uint32_t chunkIndex);
+
+    // 发送计划已经结束，而且渲染好的帧都已经取走
+    bool finished() const;
+
+    // 工作线程出错后返回true，流水线不再产出新帧
+    bool failed() const;
+    std::string errorMessage() const;
+
+private:
+    // 一个正在发送的分片
+    struct ChunkSlot
+    {
+        WirehairCodec encoder = nullptr;
+        std::uint32_t chunkIndex = 0;
+        std::uint32_t chunkBytes = 0;
+    };
+
+    // 按packet字节的块切分片：分片数和普通分片的字节数，最后一片太小时并入前一片
+    void layoutChunks(std::uint64_t packet, std::uint32_t& count, std::uint64_t& stride) const;
+    std::size_t overheadFor(std::uint64_t packet) const;
+    std::uint32_t chunkBytesOf(std::uint32_t chunkIndex) const;
+    // 把slot换成chunkIndex分片，调用者持有encoderMutex
+    void startChunk(ChunkSlot& slot, std::uint32_t chunkIndex);
+
+    void workerLoop();
+    void fail(std::string message);
+
+    const std::uint8_t* data;
+    std::uint64_t dataBytes;
+    Config config;
+    int version = 0;
+    std::size_t blockOverhead = 0;  // 每个块预留的块头和CRC字节数
+    std::uint16_t session = 0;
+    std::uint32_t chunks = 0;
+    std::uint64_t chunkStride = 0;  // 除最后一片外每个分片的字节数
+
+    // wirehair没有说明编码器可以并发使用，块编码只是少量异或，串行化的开销可以忽略。
+    // 换分片时创建编码器耗时较长（与分片大小成正比），这期间其他工作线程要等待，由预渲染的帧队列吸收
+    std::mutex encoderMutex;
+    std::unique_ptr<QRBlockSchedule> schedule;
+    std::vector<ChunkSlot> slots;  // 与发送计划的位置一一对应
+
+    // 确认先放在这里，由工作线程在encoderMutex内交给发送计划，调用者不必等编码器创建完
+    std::mutex acknowledgeMutex;
+    std::vector<std::uint32_t> pendingAcknowledgements;
+
+    std::atomic<std::uint32_t> schedulePass{ 1 };
+    std::atomic<std::uint64_t> sentBlocks{ 0 };
+    std::atomic<std::uint32_t> acknowledgedChunks{ 0 };
+    std::atomic<int> activeWorkers{ 0 };  // 还没因为计划结束而退出的工作线程
+
+    std::vector<std::unique_ptr<Frame>> frames;
+    BoundedRing<Frame*> freeFrames;
+    BoundedRing<Frame*> readyFrames;
+
+    std::vector<std::thread> workers;
+    std::atomic<bool> running{ false };
+    std::atomic<std::uint64_t> producedFrames{ 0 };
+    std::atomic<std::uint64_t> producerStalls{ 0 };
+    std::atomic<std::uint64_t> consumerStalls{ 0 };
+
+    mutable std::mutex errorMutex;
+    std::atomic<bool> hasFailed{ false };
+    std::string error;
+};
@@ -0,0 +1,104 @@
+#include "qrcode_frame_scheduler.hpp"
+#include "qrcode_frame_view.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include <QGuiApplication>
+#include <QOpenGLWidget>
+#include <QScreen>
+#include <QTimer>
+#include <QWindow>
+
+
+QRFrameScheduler::QRFrameScheduler(QRFrameView* frameView, int framePeriod, QObject* parent) :
+    QObject(parent), view(frameView), refreshesPerFrame(std::max(1, framePeriod))
+{
+    if (auto* gl = qobject_cast<QOpenGLWidget*>(view->widget()))
+    {
+        connect(gl, &QOpenGLWidget::frameSwapped, this, &QRFrameScheduler::onRefresh);
+    }
+    else
+    {
+        fallbackTimer = new QTimer(this);
+        fallbackTimer->setTimerType(Qt::PreciseTimer);
+        connect(fallbackTimer, &QTimer::timeout, this, &QRFrameScheduler::onRefresh);
+    }
+}
+
+void QRFrameScheduler::setFrameSource(FrameSource source)
+{
+    frameSource = std::move(source);
+}
+
+void QRFrameScheduler::start()
+{
+    // 窗口显示后才能确定所在的屏幕
+    const QWindow* window = view->widget()->window()->windowHandle();
+    const QScreen* screen = window != nullptr ? window->screen() : QGuiApplication::primaryScreen();
+    const double rate = screen != nullptr && screen->refreshRate() > 1 ? screen->refreshRate() : 60.0;
+    periodMs = 1000.0 / rate;
+
+    counters = Stats();
+    nextDue = 0;
+    lastTickNs = -1;
+    clock.start();
+    running = true;
+    if (fallbackTimer != nullptr)
+        fallbackTimer->start(static_cast<int>(std::lround(periodMs)));
+    else
+        view->widget()->update();  // 启动连续重绘，之后每次缓冲交换都会回到onRefresh
+}
+
+void QRFrameScheduler::stop()
+{
+    running = false;
+    if (fallbackTimer != nullptr)
+        fallbackTimer->stop();
+}
+
+const QRFrameScheduler::Stats& QRFrameScheduler::stats() const
+{
+    return counters;
+}
+
+double QRFrameScheduler::refreshRate() const
+{
+    return 1000.0 / periodMs;
+}
+
+void QRFrameScheduler::onRefresh()
+{
+    if (!running)
+        return;
+
+    // 按实际间隔折算经过了几次刷新，超过1.5个周期说明中间有刷新被错过
+    const std::int64_t now = clock.nsecsElapsed();
+    std::uint64_t elapsed = 1;
+    if (lastTickNs >= 0)
+    {
+        const double intervals = static_cast<double>(now - lastTickNs) / 1e6 / periodMs;
+        if (intervals > 1.5)
+            elapsed = static_cast<std::uint64_t>(std::lround(intervals));
+    }
+    lastTickNs = now;
+    counters.droppedRefreshes += elapsed - 1;
+    counters.refreshes += elapsed;
+
+    if (counters.refreshes > nextDue && frameSource)
+    {
+        if (frameSource())
+        {
+            // 计划在nextDue之后的第一次刷新呈现，更晚就算迟到；下一帧从这次实际呈现起算
+            if (counters.refreshes > nextDue + 1)
+                counters.lateFrames++;
+            counters.presentedFrames++;
+            nextDue = counters.refreshes + static_cast<std::uint64_t>(refreshesPerFrame) - 1;
+            return;  // showFrame()已经请求了重绘
+        }
+        counters.starvedTicks++;
+    }
+    if (fallbackTimer == nullptr)
+        view->widget()->update();  // 内容不变也要重绘，才能继续收到下一次刷新
+}
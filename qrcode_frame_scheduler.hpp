@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include <QElapsedTimer>
+#include <QObject>
+
+class QTimer;
+class QRFrameView;
+
+// 帧调度器：以显示器刷新为节拍，每framePeriod次刷新呈现一帧新内容。
+// GL显示方式下节拍来自QOpenGLWidget::frameSwapped（交换间隔为1，即垂直同步），
+// 软件绘制方式下没有垂直同步信号，用按屏幕刷新率设置的精确定时器近似。
+// 内容的生产与呈现分离：到期时只调用frameSource把已准备好的帧交给显示控件，
+// 帧源应在呈现之后再（异步地）准备下一帧，生产的抖动不会拉长当前帧的显示时间。
+class QRFrameScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats
+    {
+        std::uint64_t refreshes = 0;         // 经过的刷新次数，包括错过的
+        std::uint64_t presentedFrames = 0;   // 呈现的新帧数
+        std::uint64_t droppedRefreshes = 0;  // 两次节拍间隔超过1.5个刷新周期时错过的刷新数
+        std::uint64_t lateFrames = 0;        // 晚于计划的刷新才呈现的帧数
+        std::uint64_t starvedTicks = 0;      // 帧已到期但帧源还没准备好的节拍数
+    };
+
+    // 把下一帧交给显示控件，还没有准备好时返回false，调度器会在下一个节拍重试
+    using FrameSource = std::function<bool()>;
+
+    QRFrameScheduler(QRFrameView* frameView, int framePeriod, QObject* parent = nullptr);
+
+    void setFrameSource(FrameSource source);
+    void start();
+    void stop();
+
+    const Stats& stats() const;
+    double refreshRate() const;  // 调度使用的刷新率（Hz）
+
+private slots:
+    void onRefresh();
+
+private:
+    QRFrameView* view;
+    int refreshesPerFrame;
+    FrameSource frameSource;
+    QTimer* fallbackTimer = nullptr;  // 软件绘制方式下的节拍
+    bool running = false;
+
+    double periodMs = 1000.0 / 60;
+    QElapsedTimer clock;
+    std::int64_t lastTickNs = -1;
+    std::uint64_t nextDue = 0;  // 下一帧计划在第几次刷新呈现
+    Stats counters;
+};
@@ -0,0 +1,100 @@
+#include "qrcode_frame_source.hpp"
+#include "qrcode_binarizer.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <QImage>
+#include <QString>
+
+QRImageSequenceSource::QRImageSequenceSource(const std::filesystem::path& directory)
+{
+    constexpr const char* kExtensions[] = { ".pgm", ".pbm", ".ppm", ".png", ".bmp", ".jpg", ".jpeg" };
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+    {
+        std::string extension = entry.path().extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (entry.is_regular_file() && std::find(std::begin(kExtensions), std::end(kExtensions), extension) !=
+                std::end(kExtensions))
+            files.push_back(entry.path());
+    }
+    if (error)
+        throw std::runtime_error("Cannot read directory " + directory.string() + ": " + error.message());
+    if (files.empty())
+        throw std::runtime_error("No images in " + directory.string());
+    std::sort(files.begin(), files.end());
+}
+
+bool QRImageSequenceSource::read(QRGrayFrame& frame)
+{
+    if (next >= files.size())
+        return false;
+    const std::filesystem::path& path = files[next];
+    const QImage image = QImage(QString::fromStdWString(path.wstring())).convertToFormat(QImage::Format_Grayscale8);
+    if (image.isNull())
+        throw std::runtime_error("Cannot load image " + path.string());
+
+    // QImage的每行按4字节对齐，逐行复制去掉填充
+    frame.width = image.width();
+    frame.height = image.height();
+    frame.pixels.resize(static_cast<std::size_t>(frame.width) * static_cast<std::size_t>(frame.height));
+    for (int y = 0; y < frame.height; y++)
+        std::memcpy(frame.pixels.data() + static_cast<std::size_t>(y) * static_cast<std::size_t>(frame.width),
+                image.constScanLine(y), static_cast<std::size_t>(frame.width));
+    frame.index = next++;
+    return true;
+}
+
+std::size_t QRImageSequenceSource::frameCount() const
+{
+    return files.size();
+}
+
+QRRawVideoSource::QRRawVideoSource(const std::filesystem::path& path, int width, int height, PixelFormat format) :
+    stream(path, std::ios::binary), frameWidth(width), frameHeight(height), pixelFormat(format)
+{
+    if (width <= 0 || height <= 0 || (format == PixelFormat::Yuv420p && (width % 2 != 0 || height % 2 != 0)))
+        throw std::domain_error("Invalid raw video frame size");
+    if (!stream)
+        throw std::runtime_error("Cannot open " + path.string());
+    const std::size_t pixels = static_cast<std::size_t>(width) * static_cast<std::size_t>(height);
+    switch (format)
+    {
+        case PixelFormat::Gray:
+            raw.resize(pixels);
+            break;
+        case PixelFormat::Rgb24:
+            raw.resize(pixels * 3);
+            break;
+        case PixelFormat::Yuv420p:
+            raw.resize(pixels + pixels / 2);
+            break;
+    }
+}
+
+bool QRRawVideoSource::read(QRGrayFrame& frame)
+{
+    // 文件末尾不完整的一帧丢掉
+    if (!stream.read(reinterpret_cast<char*>(raw.data()), static_cast<std::streamsize>(raw.size())))
+        return false;
+    const std::size_t pixels = static_cast<std::size_t>(frameWidth) * static_cast<std::size_t>(frameHeight);
+    frame.width = frameWidth;
+    frame.height = frameHeight;
+    frame.pixels.resize(pixels);
+    if (pixelFormat == PixelFormat::Rgb24)
+    {
+        QRBinarizer::grayFromRgb(raw.data(), pixels, frame.pixels.data());
+    }
+    else
+    {
+        // 灰度帧和YUV的Y平面都是开头的pixels个字节
+        std::memcpy(frame.pixels.data(), raw.data(), pixels);
+    }
+    frame.index = nextIndex++;
+    return true;
+}
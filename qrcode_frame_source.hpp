@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// 接收端的一帧灰度图：每像素一个字节，按行连续存储，没有行尾填充
+struct QRGrayFrame
+{
+    int width = 0;
+    int height = 0;
+    std::vector<std::uint8_t> pixels;
+    std::uint64_t index = 0;  // 帧源里的序号，从0开始
+};
+
+// 接收端的帧来源。read()在处理线程里调用，各实现自己负责转成灰度图。
+class QRFrameSource
+{
+public:
+    virtual ~QRFrameSource() = default;
+
+    // 读下一帧到frame（复用其容量），没有更多帧或者已经stop()时返回false。读取出错时抛出std::runtime_error
+    virtual bool read(QRGrayFrame& frame) = 0;
+
+    // 让阻塞在read()里的调用尽快返回false，可以在任意线程调用
+    virtual void stop()
+    {
+    }
+
+    // 帧源自己丢掉、没有交给read()的帧数，可以在任意线程调用
+    virtual std::uint64_t droppedFrames() const
+    {
+        return 0;
+    }
+
+    // 总帧数，事先不知道时为0
+    virtual std::size_t frameCount() const
+    {
+        return 0;
+    }
+};
+
+// 目录里的图片序列（如发送端--record录下的帧），按文件名排序依次读取，格式由Qt的图片插件决定
+class QRImageSequenceSource : public QRFrameSource
+{
+public:
+    // 目录不存在或者没有图片时抛出std::runtime_error
+    explicit QRImageSequenceSource(const std::filesystem::path& directory);
+
+    bool read(QRGrayFrame& frame) override;
+
+    std::size_t frameCount() const override;
+
+private:
+    std::vector<std::filesystem::path> files;
+    std::size_t next = 0;
+};
+
+// 没有文件头的原始视频，所有帧大小相同、首尾相接，可以用ffmpeg -f rawvideo从录像导出
+class QRRawVideoSource : public QRFrameSource
+{
+public:
+    enum class PixelFormat
+    {
+        Gray,     // 每像素1字节
+        Rgb24,    // 每像素3字节，R、G、B
+        Yuv420p,  // Y平面后跟1/4大小的U、V平面，只用Y平面
+    };
+
+    // 打不开文件时抛出std::runtime_error，尺寸不合法时抛出std::domain_error
+    QRRawVideoSource(const std::filesystem::path& path, int width, int height, PixelFormat format);
+
+    bool read(QRGrayFrame& frame) override;
+
+private:
+    std::ifstream stream;
+    int frameWidth;
+    int frameHeight;
+    PixelFormat pixelFormat;
+    std::vector<std::uint8_t> raw;  // 一帧的原始数据
+    std::uint64_t nextIndex = 0;
+};
@@ -0,0 +1,217 @@
+#include "qrcode_frame_view.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+
+#include <QOpenGLShaderProgram>
+#include <QPainter>
+#include <QtGlobal>
+
+using namespace qrcodegen;
+
+
+void renderToImage(const QRModuleImage& modules, int scale, QImage& image)
+{
+    if (scale < 1)
+        throw std::domain_error("Scale must be positive");
+    if (modules.width > INT_MAX / scale || modules.height > INT_MAX / scale)
+        throw std::overflow_error("Scale too large");
+
+    const int width = modules.width * scale;
+    const int height = modules.height * scale;
+    if (image.width() != width || image.height() != height || image.format() != QImage::Format_Grayscale8)
+        image = QImage(width, height, QImage::Format_Grayscale8);
+
+    const auto span = static_cast<size_t>(width);
+    for (int y = 0; y < modules.height; y++)
+    {
+        const uint8_t* src = modules.pixels.data() + static_cast<size_t>(y) * static_cast<size_t>(modules.width);
+        uchar* line = image.scanLine(y * scale);
+        for (int x = 0; x < modules.width; x++)
+            std::memset(line + x * scale, src[x], static_cast<size_t>(scale));
+        // 同一模块行的其余像素行直接复制第一行
+        for (int i = 1; i < scale; i++)
+            std::memcpy(image.scanLine(y * scale + i), line, span);
+    }
+}
+
+
+/*---- QRFrameView ----*/
+
+void QRFrameView::setModulePixels(int pixels)
+{
+    if (pixels < 0)
+        throw std::domain_error("Module pixels must be non-negative");
+    modulePixels = pixels;
+}
+
+int QRFrameView::chooseScale(int availableWidth, int availableHeight, const QRModuleImage& frame) const
+{
+    if (frame.width == 0 || frame.height == 0)
+        return 1;
+    const int fit = std::min(availableWidth / frame.width, availableHeight / frame.height);
+    if (modulePixels > 0 && modulePixels <= fit)
+        return modulePixels;
+    return std::max(1, fit);
+}
+
+
+/*---- QRRasterFrameWidget ----*/
+
+QRRasterFrameWidget::QRRasterFrameWidget(QWidget* parent) : QWidget(parent)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);  // paintEvent自己铺满背景
+}
+
+QWidget* QRRasterFrameWidget::widget()
+{
+    return this;
+}
+
+void QRRasterFrameWidget::showFrame(const QRModuleImage& frame)
+{
+    if (frame.width == 0 || frame.height == 0)
+        return;
+    const qreal dpr = devicePixelRatioF();
+    const int scale = chooseScale(static_cast<int>(width() * dpr), static_cast<int>(height() * dpr), frame);
+    renderToImage(frame, scale, image);
+    image.setDevicePixelRatio(dpr);
+    update();
+}
+
+void QRRasterFrameWidget::paintEvent(QPaintEvent*)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::white);
+    if (image.isNull())
+        return;
+    const QSizeF logical = QSizeF(image.size()) / image.devicePixelRatio();
+    painter.drawImage(QPointF((width() - logical.width()) / 2, (height() - logical.height()) / 2), image);
+}
+
+
+/*---- QRGLFrameWidget ----*/
+
+// 不写#version，QOpenGLShaderProgram会为桌面GL补上精度限定符的定义，同一份源码也能在GLES 2上编译
+static const char* const kVertexShader = R"(
+attribute highp vec2 pos;
+varying mediump vec2 uv;
+void main()
+{
+    uv = vec2(pos.x * 0.5 + 0.5, 0.5 - pos.y * 0.5);  // 纹理第0行在顶部
+    gl_Position = vec4(pos, 0.0, 1.0);
+}
+)";
+
+static const char* const kFragmentShader = R"(
+uniform sampler2D tex;
+varying mediump vec2 uv;
+void main()
+{
+    gl_FragColor = vec4(texture2D(tex, uv).rrr, 1.0);
+}
+)";
+
+static const GLfloat kQuad[] = { -1.f, -1.f, 1.f, -1.f, -1.f, 1.f, 1.f, 1.f };
+
+QRGLFrameWidget::QRGLFrameWidget(QWidget* parent) : QOpenGLWidget(parent)
+{
+}
+
+QRGLFrameWidget::~QRGLFrameWidget()
+{
+    // GL资源必须在自己的上下文中释放
+    makeCurrent();
+    program.reset();
+    if (texture != 0)
+        glDeleteTextures(1, &texture);
+    doneCurrent();
+}
+
+QWidget* QRGLFrameWidget::widget()
+{
+    return this;
+}
+
+void QRGLFrameWidget::showFrame(const QRModuleImage& frame)
+{
+    texels.width = frame.width;
+    texels.height = frame.height;
+    texels.pixels.assign(frame.pixels.begin(), frame.pixels.end());  // 容量足够时不重新分配
+    dirty = true;
+    update();
+}
+
+void QRGLFrameWidget::initializeGL()
+{
+    initializeOpenGLFunctions();
+    glClearColor(1.f, 1.f, 1.f, 1.f);
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    uploadedWidth = 0;
+    uploadedHeight = 0;
+    dirty = !texels.pixels.empty();
+
+    program = std::make_unique<QOpenGLShaderProgram>();
+    program->addShaderFromSourceCode(QOpenGLShader::Vertex, kVertexShader);
+    program->addShaderFromSourceCode(QOpenGLShader::Fragment, kFragmentShader);
+    program->bindAttributeLocation("pos", 0);
+    if (!program->link())
+    {
+        // 异常不能穿过Qt的事件循环，链接失败时只记录日志，之后的帧只清屏
+        qWarning("Failed to link frame shader: %s", qPrintable(program->log()));
+        program.reset();
+    }
+}
+
+void QRGLFrameWidget::paintGL()
+{
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (texels.pixels.empty() || !program)
+        return;
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if (dirty)
+    {
+        // 纹理行宽不一定是4的倍数。GL_LUMINANCE在桌面兼容模式、GLES 2和ANGLE上都可用
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (uploadedWidth != texels.width || uploadedHeight != texels.height)
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, texels.width, texels.height, 0, GL_LUMINANCE,
+                    GL_UNSIGNED_BYTE, texels.pixels.data());
+            uploadedWidth = texels.width;
+            uploadedHeight = texels.height;
+        }
+        else
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texels.width, texels.height, GL_LUMINANCE, GL_UNSIGNED_BYTE,
+                    texels.pixels.data());
+        }
+        dirty = false;
+    }
+
+    // 在物理像素上取纹理尺寸的最大整数倍，保证每个模块占相同的像素数
+    const qreal dpr = devicePixelRatioF();
+    const int w = static_cast<int>(width() * dpr);
+    const int h = static_cast<int>(height() * dpr);
+    const int scale = chooseScale(w, h, texels);
+    const int viewWidth = texels.width * scale;
+    const int viewHeight = texels.height * scale;
+    glViewport((w - viewWidth) / 2, (h - viewHeight) / 2, viewWidth, viewHeight);
+
+    program->bind();
+    program->setUniformValue("tex", 0);
+    program->enableAttributeArray(0);
+    program->setAttributeArray(0, kQuad, 2);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    program->disableAttributeArray(0);
+    program->release();
+}
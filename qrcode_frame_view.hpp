@@ -0,0 +1,78 @@
+#pragma once
+
+#include "qrcode_module_image.hpp"
+
+#include <memory>
+
+#include <QImage>
+#include <QOpenGLFunctions>
+#include <QOpenGLWidget>
+#include <QWidget>
+
+class QOpenGLShaderProgram;
+
+// 将模块图按整数倍放大直接写入8位灰度图像。图像尺寸不变时复用原有缓冲区
+void renderToImage(const QRModuleImage& modules, int scale, QImage& image);
+
+// 二维码帧的显示接口，窗口只通过它提交新帧，不关心具体的绘制方式
+class QRFrameView
+{
+public:
+    virtual ~QRFrameView() = default;
+
+    virtual QWidget* widget() = 0;
+
+    // 提交一帧，模块图（含静区）由控件复制，调用返回后即可复用。帧在下一次重绘时呈现
+    virtual void showFrame(const QRModuleImage& frame) = 0;
+
+    // 每个模块占的物理像素数，0表示取能放进控件的最大整数倍（默认）
+    void setModulePixels(int pixels);
+
+protected:
+    // 按设置和可用的物理像素计算放大倍数，至少为1。固定倍数放不下时退回自动选择
+    int chooseScale(int availableWidth, int availableHeight, const QRModuleImage& frame) const;
+
+private:
+    int modulePixels = 0;
+};
+
+// 软件绘制：按控件的物理像素尺寸选择最大整数放大倍数，用QPainter居中绘制QImage，不做插值缩放。
+class QRRasterFrameWidget : public QWidget, public QRFrameView
+{
+public:
+    explicit QRRasterFrameWidget(QWidget* parent = nullptr);
+
+    QWidget* widget() override;
+    void showFrame(const QRModuleImage& frame) override;
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+
+private:
+    QImage image;
+};
+
+// 纹理上传：每个模块对应一个纹素，每帧只上传模块图大小的小纹理，
+// 由GPU以最近邻采样放大到整数倍，呈现开销与屏幕分辨率无关。缓冲交换跟随垂直同步。
+// 着色器同时兼容桌面GL 2.x、GLES 2和ANGLE，可在Mesa的llvmpipe等软件光栅器上运行。
+class QRGLFrameWidget : public QOpenGLWidget, public QRFrameView, protected QOpenGLFunctions
+{
+public:
+    explicit QRGLFrameWidget(QWidget* parent = nullptr);
+    ~QRGLFrameWidget() override;
+
+    QWidget* widget() override;
+    void showFrame(const QRModuleImage& frame) override;
+
+protected:
+    void initializeGL() override;
+    void paintGL() override;
+
+private:
+    QRModuleImage texels;   // 待上传的纹理，一字节一个模块
+    int uploadedWidth = 0;  // 当前纹理对象的尺寸，变化时重新分配
+    int uploadedHeight = 0;
+    bool dirty = false;     // texels有新内容未上传
+    GLuint texture = 0;
+    std::unique_ptr<QOpenGLShaderProgram> program;
+};
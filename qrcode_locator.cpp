@@ -0,0 +1,521 @@
+#include "qrcode_locator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+
+using namespace qrcodegen;
+
+namespace
+{
+
+// 五段的像素数是否接近1:1:3:1:1，每段允许半个模块的偏差
+bool isFinderRatio(const int counts[5])
+{
+    const int total = counts[0] + counts[1] + counts[2] + counts[3] + counts[4];
+    if (total < 7)
+        return false;
+    const double module = total / 7.0;
+    const double variance = module / 2;
+    return std::abs(module - counts[0]) < variance && std::abs(module - counts[1]) < variance &&
+            std::abs(3 * module - counts[2]) < 3 * variance && std::abs(module - counts[3]) < variance &&
+            std::abs(module - counts[4]) < variance;
+}
+
+// 沿一条扫描线从center向两边数出1:1:3:1:1的五段，dark(i)是扫描线上第i个像素（共length个）是否为深色。
+// 外侧四段都不超过maxCount，总长和expectedTotal相差不到40%时返回中心在扫描线上的坐标，否则返回负数
+template <typename Dark>
+double crossCheck(Dark dark, int length, int center, int maxCount, int expectedTotal, int& total)
+{
+    int counts[5] = {};
+    int i = center;
+    for (; i >= 0 && dark(i); i--)
+        counts[2]++;
+    for (; i >= 0 && !dark(i) && counts[1] <= maxCount; i--)
+        counts[1]++;
+    if (i < 0 || counts[1] > maxCount)
+        return -1;
+    for (; i >= 0 && dark(i) && counts[0] <= maxCount; i--)
+        counts[0]++;
+    if (counts[0] > maxCount)
+        return -1;
+
+    i = center + 1;
+    for (; i < length && dark(i); i++)
+        counts[2]++;
+    for (; i < length && !dark(i) && counts[3] <= maxCount; i++)
+        counts[3]++;
+    if (i == length || counts[3] > maxCount)
+        return -1;
+    for (; i < length && dark(i) && counts[4] <= maxCount; i++)
+        counts[4]++;
+    if (counts[4] > maxCount)
+        return -1;
+
+    total = counts[0] + counts[1] + counts[2] + counts[3] + counts[4];
+    if (5 * std::abs(total - expectedTotal) >= 2 * expectedTotal || !isFinderRatio(counts))
+        return -1;
+    return i - counts[4] - counts[3] - counts[2] / 2.0;
+}
+
+// 一行里从x开始第一个颜色和dark不同的像素，没有时返回width。行尾多出的位是浅色，找深色时不会越过width
+int nextTransition(const std::uint64_t* row, int x, int width, bool dark)
+{
+    const std::uint64_t flip = dark ? ~std::uint64_t(0) : 0;
+    const int words = (width + 63) / 64;
+    int word = x >> 6;
+    std::uint64_t bits = (row[word] ^ flip) & (~std::uint64_t(0) << (x & 63));
+    while (bits == 0)
+    {
+        if (++word == words)
+            return width;
+        bits = row[word] ^ flip;
+    }
+    return std::min(width, word * 64 + std::countr_zero(bits));
+}
+
+// 水平扫描发现的一组五段（在第y行、结束于x之前）经竖直、水平复核后加入patterns，离已有的图案很近时合并
+void addFinderPattern(const QRBinaryImage& image, const int counts[5], int x, int y,
+        std::vector<QRLocator::FinderPattern>& patterns)
+{
+    const int horizontalTotal = counts[0] + counts[1] + counts[2] + counts[3] + counts[4];
+    const double centerX = x - counts[4] - counts[3] - counts[2] / 2.0;
+
+    int verticalTotal = 0;
+    const auto column = static_cast<int>(centerX);
+    const double centerY = crossCheck([&image, column](int i) { return image.get(column, i); }, image.height, y,
+            counts[2], horizontalTotal, verticalTotal);
+    if (centerY < 0)
+        return;
+    int refinedTotal = 0;
+    const auto line = static_cast<int>(centerY);
+    const double refinedX = crossCheck([&image, line](int i) { return image.get(i, line); }, image.width, column,
+            counts[2], horizontalTotal, refinedTotal);
+    if (refinedX < 0)
+        return;
+
+    const double moduleSize = (refinedTotal + verticalTotal) / 14.0;
+    for (QRLocator::FinderPattern& pattern : patterns)
+    {
+        if (std::abs(pattern.center.x - refinedX) <= moduleSize && std::abs(pattern.center.y - centerY) <= moduleSize &&
+                std::abs(pattern.moduleSize - moduleSize) <= std::max(1.0, pattern.moduleSize / 2))
+        {
+            // 按发现次数加权平均
+            const double weight = pattern.count;
+            pattern.center.x = (pattern.center.x * weight + refinedX) / (weight + 1);
+            pattern.center.y = (pattern.center.y * weight + centerY) / (weight + 1);
+            pattern.moduleSize = (pattern.moduleSize * weight + moduleSize) / (weight + 1);
+            pattern.count++;
+            return;
+        }
+    }
+    patterns.push_back({ { refinedX, centerY }, moduleSize, 1 });
+}
+
+// 在模块坐标(u, v)附近找一个(2·half + 1)见方、离中心的切比雪夫距离为half - 1的一圈为浅色、其余为深色的图案：
+// half为2是校正图案，为3是定位图案（不含分隔符）。按transform在该处一个模块的两条边，
+// 以四分之一个模块的步长在各方向radius步内试探，返回中心的图像坐标。
+// 最多错一个模块；错得最少的位置应当连成一片，散在各处说明附近的数据模块碰巧也像这个图案，返回false
+bool findPattern(const QRBinaryImage& image, const QRLocator::Homography& transform, double u, double v, int half,
+        int radius, QRLocator::Point& found)
+{
+    const QRLocator::Point predicted = transform.map(u, v);
+    const QRLocator::Point right = transform.map(u + 1, v);
+    const QRLocator::Point down = transform.map(u, v + 1);
+    const QRLocator::Point ex{ right.x - predicted.x, right.y - predicted.y };
+    const QRLocator::Point ey{ down.x - predicted.x, down.y - predicted.y };
+
+    // 错了两个模块就不再往下核对，大部分偏移只看几个模块
+    const int side = 2 * half + 1;
+    int fewestMisses = 1;
+    int ties = 0;
+    double sumU = 0, sumV = 0;
+    double minU = 0, maxU = 0, minV = 0, maxV = 0;
+    for (int j = -radius; j <= radius; j++)
+    {
+        for (int i = -radius; i <= radius; i++)
+        {
+            const double du = i / 4.0;
+            const double dv = j / 4.0;
+            int misses = 0;
+            for (int k = 0; k < side * side && misses <= fewestMisses; k++)
+            {
+                const int dx = k % side - half;
+                const int dy = k / side - half;
+                const double x = predicted.x + (du + dx) * ex.x + (dv + dy) * ey.x;
+                const double y = predicted.y + (du + dx) * ex.y + (dv + dy) * ey.y;
+                const bool dark = std::max(std::abs(dx), std::abs(dy)) != half - 1;
+                if (x < 0 || y < 0 || x >= image.width || y >= image.height ||
+                        image.get(static_cast<int>(x), static_cast<int>(y)) != dark)
+                    misses++;
+            }
+            if (misses > fewestMisses)
+                continue;
+            if (misses < fewestMisses || ties == 0)
+            {
+                fewestMisses = misses;
+                ties = 0;
+                sumU = sumV = 0;
+                minU = maxU = du;
+                minV = maxV = dv;
+            }
+            ties++;
+            sumU += du;
+            sumV += dv;
+            minU = std::min(minU, du);
+            maxU = std::max(maxU, du);
+            minV = std::min(minV, dv);
+            maxV = std::max(maxV, dv);
+        }
+    }
+    if (ties == 0 || maxU - minU > 1.5 || maxV - minV > 1.5)
+        return false;
+    const double du = sumU / ties;
+    const double dv = sumV / ties;
+    found = { predicted.x + du * ex.x + dv * ey.x, predicted.y + du * ex.y + dv * ey.y };
+    return true;
+}
+
+// refineWithAlignment和followTransform的实现。estimate是仿射变换时第一个校正图案的误差随版本增大，
+// 搜索窗口按离左上角的距离放大；跟踪时estimate是上一帧的透视变换，都在各方向3个模块内找
+bool walkAlignmentPatterns(const QRBinaryImage& image, const QRLocator::Homography& estimate, int dimension,
+        bool affineEstimate, QRLocator::Homography& refined)
+{
+    if (dimension < 25)
+        return false;
+    // 校正图案中心所在的行列（和qrcodegen里的表相同）。沿对角线从左上往右下逐个找，每找到一个就用它和三个定位图案
+    // 重新求变换，再预测下一个：仿射估计的误差随离左上角的距离增长，大版本在梯形畸变下右下角能差出十几个模块，
+    // 而从上一个校正图案预测下一个只差一两个模块
+    const int version = (dimension - 17) / 4;
+    const int count = version / 7 + 2;
+    const int step = (version * 8 + count * 3 + 5) / (count * 4 - 4) * 2;
+    std::array<int, 7> positions{};
+    for (int i = count - 1, position = dimension - 7; i >= 1; i--, position -= step)
+        positions[static_cast<std::size_t>(i)] = position;
+    const auto last = static_cast<std::size_t>(count - 1);
+
+    const double far = dimension - 3.5;
+    std::array<QRLocator::Point, 4> modulePoints{ QRLocator::Point{ 3.5, 3.5 }, QRLocator::Point{ far, 3.5 },
+        QRLocator::Point{ 3.5, far }, QRLocator::Point{} };
+    std::array<QRLocator::Point, 4> imagePoints{ estimate.map(3.5, 3.5), estimate.map(far, 3.5),
+        estimate.map(3.5, far), QRLocator::Point{} };
+    refined = estimate;
+    for (std::size_t k = 1; k <= last; k++)
+    {
+        // 落在右上、左下两个定位图案连线附近的校正图案和三个定位图案求不出透视变换，换成最右一列的那个
+        const double v = positions[k] + 0.5;
+        const double u = std::abs(2 * v - dimension) < 8 ? positions[last] + 0.5 : v;
+        // 窗口取u + v的十分之一，能覆盖约20%的梯形畸变
+        const int radius = k == 1 && affineEstimate ? std::max(12, static_cast<int>(std::ceil((u + v) * 0.4))) : 12;
+        modulePoints[3] = { u, v };
+        if (!findPattern(image, refined, u, v, 2, radius, imagePoints[3]) ||
+                !QRLocator::fromCorrespondences(modulePoints, imagePoints, refined))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+void QRLocator::findFinderPatterns(const QRBinaryImage& image, std::vector<FinderPattern>& patterns)
+{
+    patterns.clear();
+    for (int y = 0; y < image.height; y++)
+    {
+        const std::uint64_t* row = image.row(y);
+        // 按同色的一段处理，偶数段为深色，奇数段为浅色
+        int counts[5] = {};
+        int state = 0;
+        bool dark = (row[0] & 1) != 0;
+        for (int x = 0; x < image.width; dark = !dark)
+        {
+            const int end = nextTransition(row, x, image.width, dark);
+            const int length = end - x;
+            x = end;
+            if (dark)
+            {
+                if (state & 1)
+                    state++;
+                counts[state] += length;
+                continue;
+            }
+            if (state == 4)
+            {
+                if (isFinderRatio(counts))
+                    addFinderPattern(image, counts, end - length, y, patterns);
+                // 不管是否找到，后三段都可能是下一个图案的前三段
+                counts[0] = counts[2];
+                counts[1] = counts[3];
+                counts[2] = counts[4];
+                counts[3] = length;
+                counts[4] = 0;
+                state = 3;
+            }
+            else if (counts[0] > 0)
+            {
+                counts[++state] = length;
+            }
+        }
+        // 行尾当作浅色，贴着右边缘的图案也能结束
+        if (state == 4 && isFinderRatio(counts))
+            addFinderPattern(image, counts, image.width, y, patterns);
+    }
+    // 只被一条扫描线发现的多半是噪声
+    std::erase_if(patterns, [](const FinderPattern& pattern) { return pattern.count < 2; });
+}
+
+void QRLocator::groupCandidates(const std::vector<FinderPattern>& patterns, std::vector<Candidate>& candidates)
+{
+    candidates.clear();
+    const std::size_t n = patterns.size();
+    for (std::size_t a = 0; a < n; a++)
+    {
+        const FinderPattern& corner = patterns[a];
+        for (std::size_t b = 0; b < n; b++)
+        {
+            for (std::size_t c = b + 1; c < n; c++)
+            {
+                if (b == a || c == a)
+                    continue;
+                const FinderPattern& first = patterns[b];
+                const FinderPattern& second = patterns[c];
+                const double smallest = std::min({ corner.moduleSize, first.moduleSize, second.moduleSize });
+                const double largest = std::max({ corner.moduleSize, first.moduleSize, second.moduleSize });
+                if (largest > smallest * 1.5)
+                    continue;
+
+                // 左上角到另外两个的两条边应当一样长、互相垂直
+                const double x1 = first.center.x - corner.center.x;
+                const double y1 = first.center.y - corner.center.y;
+                const double x2 = second.center.x - corner.center.x;
+                const double y2 = second.center.y - corner.center.y;
+                const double length1 = std::hypot(x1, y1);
+                const double length2 = std::hypot(x2, y2);
+                if (std::min(length1, length2) < std::max(length1, length2) * 0.8 ||
+                        std::abs(x1 * x2 + y1 * y2) > 0.25 * length1 * length2)
+                    continue;
+
+                const double moduleSize = (corner.moduleSize + first.moduleSize + second.moduleSize) / 3;
+                const double armLength = (length1 + length2) / 2;
+                const double dimension = armLength / moduleSize + 7;
+                if (dimension < 18 || dimension > 180)
+                    continue;
+                const int version = std::clamp(static_cast<int>(std::lround((dimension - 17) / 4)), 1, 40);
+
+                // 图像坐标y朝下，左上→右上转到左上→左下是顺时针，叉积为正
+                const bool clockwise = x1 * y2 - y1 * x2 > 0;
+                candidates.push_back({ a, clockwise ? b : c, clockwise ? c : b, moduleSize, version * 4 + 17,
+                        armLength });
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+            [](const Candidate& x, const Candidate& y) { return x.armLength < y.armLength; });
+}
+
+QRLocator::Point QRLocator::Homography::map(double u, double v) const
+{
+    const double w = h[6] * u + h[7] * v + 1;
+    return { (h[0] * u + h[1] * v + h[2]) / w, (h[3] * u + h[4] * v + h[5]) / w };
+}
+
+bool QRLocator::fromCorrespondences(const std::array<Point, 4>& modulePoints, const std::array<Point, 4>& imagePoints,
+        Homography& transform)
+{
+    // 每对点给出两个关于h的线性方程：x = h0·u + h1·v + h2 - h6·u·x - h7·v·x，y同理。8×8方程组用列主元消元求解
+    double rows[8][9];
+    for (std::size_t i = 0; i < 4; i++)
+    {
+        const auto [u, v] = modulePoints[i];
+        const auto [x, y] = imagePoints[i];
+        const double first[9] = { u, v, 1, 0, 0, 0, -u * x, -v * x, x };
+        const double second[9] = { 0, 0, 0, u, v, 1, -u * y, -v * y, y };
+        std::copy_n(first, 9, rows[2 * i]);
+        std::copy_n(second, 9, rows[2 * i + 1]);
+    }
+    for (int column = 0; column < 8; column++)
+    {
+        int pivot = column;
+        for (int row = column + 1; row < 8; row++)
+        {
+            if (std::abs(rows[row][column]) > std::abs(rows[pivot][column]))
+                pivot = row;
+        }
+        if (std::abs(rows[pivot][column]) < 1e-9)
+            return false;
+        std::swap(rows[pivot], rows[column]);
+        for (int row = 0; row < 8; row++)
+        {
+            if (row == column)
+                continue;
+            const double factor = rows[row][column] / rows[column][column];
+            for (int k = column; k < 9; k++)
+                rows[row][k] -= factor * rows[column][k];
+        }
+    }
+    for (std::size_t i = 0; i < 8; i++)
+        transform.h[i] = rows[i][8] / rows[i][i];
+    return true;
+}
+
+QRLocator::Homography QRLocator::affineTransform(const std::vector<FinderPattern>& patterns,
+        const Candidate& candidate, int dimension)
+{
+    // 三个定位图案的中心在模块坐标(3.5, 3.5)、(dimension - 3.5, 3.5)、(3.5, dimension - 3.5)
+    const Point origin = patterns[candidate.topLeft].center;
+    const Point right = patterns[candidate.topRight].center;
+    const Point down = patterns[candidate.bottomLeft].center;
+    const double span = dimension - 7.0;
+    const Point dx{ (right.x - origin.x) / span, (right.y - origin.y) / span };
+    const Point dy{ (down.x - origin.x) / span, (down.y - origin.y) / span };
+    Homography transform;
+    transform.h = { dx.x, dy.x, origin.x - 3.5 * (dx.x + dy.x), dx.y, dy.y, origin.y - 3.5 * (dx.y + dy.y), 0, 0 };
+    return transform;
+}
+
+bool QRLocator::refineWithAlignment(const QRBinaryImage& image, const Homography& estimate, int dimension,
+        Homography& refined)
+{
+    return walkAlignmentPatterns(image, estimate, dimension, true, refined);
+}
+
+bool QRLocator::followTransform(const QRBinaryImage& image, const Homography& previous, int dimension,
+        Homography& moved)
+{
+    const double far = dimension - 3.5;
+    const std::array<Point, 4> modulePoints{ Point{ 3.5, 3.5 }, Point{ far, 3.5 }, Point{ 3.5, far },
+        Point{ far, far } };
+    std::array<Point, 4> imagePoints{};
+    for (std::size_t i = 0; i < 3; i++)
+    {
+        if (!findPattern(image, previous, modulePoints[i].x, modulePoints[i].y, 3, 6, imagePoints[i]))
+            return false;
+    }
+    imagePoints[3] = previous.map(far, far);
+    Homography estimate;
+    if (!fromCorrespondences(modulePoints, imagePoints, estimate))
+        return false;
+    if (!walkAlignmentPatterns(image, estimate, dimension, false, moved))
+        moved = estimate;
+    return true;
+}
+
+bool QRLocator::sampleGrid(const QRBinaryImage& image, const Homography& transform, int dimension,
+        BitMatrix& modules)
+{
+    const std::array<double, 8>& h = transform.h;
+    // 四个角的模块中心都在图内、分母都为正时，变换后的网格是凸四边形，其余模块也都在图内
+    const double last = dimension - 0.5;
+    for (const auto [u, v] : { std::array{ 0.5, 0.5 }, std::array{ last, 0.5 }, std::array{ 0.5, last },
+                 std::array{ last, last } })
+    {
+        const Point corner = transform.map(u, v);
+        if (h[6] * u + h[7] * v + 1 <= 0 || corner.x < 0 || corner.y < 0 || corner.x >= image.width ||
+                corner.y >= image.height)
+            return false;
+    }
+
+    // 分子和分母都是u的线性函数，沿一行逐模块累加
+    modules.reset(dimension);
+    for (int y = 0; y < dimension; y++)
+    {
+        std::uint64_t* row = modules.getRow(y);
+        const double v = y + 0.5;
+        double nx = h[0] * 0.5 + h[1] * v + h[2];
+        double ny = h[3] * 0.5 + h[4] * v + h[5];
+        double w = h[6] * 0.5 + h[7] * v + 1;
+        for (int x = 0; x < dimension; x++, nx += h[0], ny += h[3], w += h[6])
+        {
+            const bool dark = image.get(static_cast<int>(nx / w), static_cast<int>(ny / w));
+            row[x >> 6] |= static_cast<std::uint64_t>(dark) << (x & 63);
+        }
+    }
+    return true;
+}
+
+bool QRLocator::verifyTiming(const QRBinaryImage& image, const Homography& transform, int dimension)
+{
+    // 从一端的分隔符到另一端的分隔符：浅色的分隔符、dimension - 16个深浅相间的模块、浅色的分隔符。
+    // 按四分之一个模块的步长采样，颜色连续两次不同才算新的一段，孤立的噪点不计。
+    // 有透视时仿射变换下这条线可能偏到旁边的数据模块上，再在两侧偏出四分之一、半个模块的线上数
+    const int expected = dimension - 14;
+    const int samples = 4 * (dimension - 15);
+    auto countRuns = [&](bool vertical, double across) {
+        int runs = 0;
+        bool color = false;
+        int pending = 0;
+        for (int k = 0; k <= samples; k++)
+        {
+            const double along = 7.5 + k / 4.0;
+            const Point point = vertical ? transform.map(across, along) : transform.map(along, across);
+            if (point.x < 0 || point.y < 0 || point.x >= image.width || point.y >= image.height)
+                return -1;
+            const bool dark = image.get(static_cast<int>(point.x), static_cast<int>(point.y));
+            if (runs == 0)
+            {
+                runs = 1;
+                color = dark;
+            }
+            else if (dark == color)
+            {
+                pending = 0;
+            }
+            else if (++pending == 2)
+            {
+                runs++;
+                color = dark;
+                pending = 0;
+            }
+        }
+        return runs;
+    };
+    for (const bool vertical : { false, true })
+    {
+        bool matched = false;
+        for (const double offset : { 0.0, -0.25, 0.25, -0.5, 0.5 })
+        {
+            if (std::abs(countRuns(vertical, 6.5 + offset) - expected) <= 2)
+            {
+                matched = true;
+                break;
+            }
+        }
+        if (!matched)
+            return false;
+    }
+    return true;
+}
+
+bool QRLocator::verifyGrid(const BitMatrix& modules)
+{
+    const int size = modules.getSize();
+    int checked = 0;
+    int wrong = 0;
+    auto expect = [&](int x, int y, bool dark) {
+        checked++;
+        if (modules.get(x, y) != dark)
+            wrong++;
+    };
+    // 定位图案中心在(3, 3)、(size - 4, 3)、(3, size - 4)，到中心的切比雪夫距离为2和4的一圈是浅色
+    for (const auto [cx, cy] : { std::array{ 3, 3 }, std::array{ size - 4, 3 }, std::array{ 3, size - 4 } })
+    {
+        for (int dy = -4; dy <= 4; dy++)
+        {
+            for (int dx = -4; dx <= 4; dx++)
+            {
+                const int x = cx + dx;
+                const int y = cy + dy;
+                const int distance = std::max(std::abs(dx), std::abs(dy));
+                if (0 <= x && x < size && 0 <= y && y < size)
+                    expect(x, y, distance != 2 && distance != 4);
+            }
+        }
+    }
+    for (int i = 8; i < size - 8; i++)
+    {
+        expect(i, 6, i % 2 == 0);
+        expect(6, i, i % 2 == 0);
+    }
+    return wrong * 8 <= checked;
+}
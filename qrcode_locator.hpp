@@ -0,0 +1,89 @@
+#pragma once
+
+#include "qrcode_binarizer.hpp"
+#include "qrcodegen.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 在二值图里找二维码：逐行扫描1:1:3:1:1的定位图案，再沿竖直、水平方向复核，
+// 把三个定位图案配成一个码的左上、右上、左下角，按三个中心得到仿射变换，版本2以上再沿对角线找到右下角的校正图案，
+// 用四个点求出透视变换，最后按变换采样模块网格。逐行扫描按字找颜色变化，整段同色的像素一次跳过64个。
+// 变换可以留到下一帧：在原来的位置附近重新找定位图案和校正图案，不用扫描整张图。
+class QRLocator
+{
+public:
+    struct Point
+    {
+        double x = 0;
+        double y = 0;
+    };
+
+    struct FinderPattern
+    {
+        Point center;
+        double moduleSize = 0;  // 估算的模块边长（像素）
+        int count = 0;          // 被多少条扫描线发现，越多越可信
+    };
+
+    // 三个定位图案配成的候选码
+    struct Candidate
+    {
+        std::size_t topLeft = 0;  // 在定位图案列表里的下标
+        std::size_t topRight = 0;
+        std::size_t bottomLeft = 0;
+        double moduleSize = 0;
+        int dimension = 0;        // 按定位图案间距估算的边长（模块数），已取到最近的合法尺寸
+        double armLength = 0;     // 左上到右上、左下的平均距离（像素）
+    };
+
+    // 找出图里所有的定位图案，覆盖patterns原来的内容
+    static void findFinderPatterns(const QRBinaryImage& image, std::vector<FinderPattern>& patterns);
+
+    // 把定位图案三个一组配成候选码，按边长从小到大排列：平铺的码之间，同一个码的三个定位图案总是离得最近
+    static void groupCandidates(const std::vector<FinderPattern>& patterns, std::vector<Candidate>& candidates);
+
+    // 模块坐标(u, v)到图像坐标的透视变换：w = h[6]·u + h[7]·v + 1，x = (h[0]·u + h[1]·v + h[2]) / w，
+    // y = (h[3]·u + h[4]·v + h[5]) / w。模块(x, y)的中心在(x + 0.5, y + 0.5)
+    struct Homography
+    {
+        std::array<double, 8> h{};
+
+        Point map(double u, double v) const;
+    };
+
+    // 求把modulePoints的四个点分别映射到imagePoints的变换，四个点里有三点共线时返回false
+    static bool fromCorrespondences(const std::array<Point, 4>& modulePoints, const std::array<Point, 4>& imagePoints,
+            Homography& transform);
+
+    // 按候选码的三个定位图案中心求dimension见方的码的仿射变换
+    static Homography affineTransform(const std::vector<FinderPattern>& patterns, const Candidate& candidate,
+            int dimension);
+
+    // 从estimate（通常是仿射变换）出发，沿对角线逐个找校正图案直到右下角那个，每找到一个就用它和三个定位图案的中心
+    // 重新求透视变换、预测下一个。第一个的搜索窗口随版本放大，之后的在各方向3个模块内。
+    // 版本1没有校正图案，有一个找不到或者有几处离得较远的位置同样像时返回false
+    static bool refineWithAlignment(const QRBinaryImage& image, const Homography& estimate, int dimension,
+            Homography& refined);
+
+    // 跟踪：在previous预测的位置附近（各方向1.5个模块内）重新找三个定位图案，再用refineWithAlignment找校正图案，
+    // 求出画面稍有移动、透视稍有变化之后的变换。校正图案找不到时按previous预测的右下角求。
+    // 有一个定位图案找不到时返回false
+    static bool followTransform(const QRBinaryImage& image, const Homography& previous, int dimension,
+            Homography& moved);
+
+    // 按变换采样dimension见方的模块网格，码超出图像时返回false
+    static bool sampleGrid(const QRBinaryImage& image, const Homography& transform, int dimension,
+            qrcodegen::BitMatrix& modules);
+
+    // 沿transform下的两条定时图案数深浅相间的段数，和dimension对得上（相差不超过2）时返回true。
+    // 有透视时仿射变换沿定时图案的位置不准，但段数不变；配错的定位图案之间是空白或者数据，段数对不上，
+    // 估错的尺寸也对不上。用来在找校正图案之前排除候选码
+    static bool verifyTiming(const QRBinaryImage& image, const Homography& transform, int dimension);
+
+    // 核对采样结果的三个定位图案（含分隔符）和两条定时图案，错的模块不超过八分之一时返回true。
+    // 配错的定位图案或者估错的尺寸几乎不可能通过，用来在解码之前排除候选码
+    static bool verifyGrid(const qrcodegen::BitMatrix& modules);
+};
@@ -0,0 +1,37 @@
+#include "qrcode_module_image.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace qrcodegen;
+
+
+void QRModuleImage::reset(int newWidth, int newHeight)
+{
+    if (newWidth < 0 || newHeight < 0)
+        throw std::domain_error("Image size must be non-negative");
+    width = newWidth;
+    height = newHeight;
+    pixels.assign(static_cast<size_t>(newWidth) * static_cast<size_t>(newHeight), 0xFF);
+}
+
+void QRModuleImage::drawQrCode(const QrCode& qr, int x0, int y0)
+{
+    const int size = qr.getSize();
+    if (x0 < 0 || y0 < 0 || x0 + size > width || y0 + size > height)
+        throw std::out_of_range("QR code outside of the image");
+    for (int y = 0; y < size; y++)
+    {
+        const uint64_t* row = qr.getRow(y);
+        uint8_t* line = pixels.data() + static_cast<size_t>(y0 + y) * static_cast<size_t>(width) +
+                static_cast<size_t>(x0);
+        // 逐个64位字展开，深色模块写0x00
+        for (int x = 0; x < size; x += 64)
+        {
+            uint64_t word = row[x >> 6];
+            const int end = std::min(size - x, 64);
+            for (int i = 0; i < end; i++, word >>= 1)
+                line[x + i] = static_cast<uint8_t>((word & 1) != 0 ? 0x00 : 0xFF);
+        }
+    }
+}
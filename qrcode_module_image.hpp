@@ -0,0 +1,21 @@
+#pragma once
+
+#include "qrcodegen.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// 一帧的模块图：每个模块一个字节（0x00深色，0xFF浅色），按行连续存储，包括静区。
+// 显示控件再把它按整数倍放大到屏幕上，所以生产线程只需要处理模块级的数据。
+struct QRModuleImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector<std::uint8_t> pixels;
+
+    // 改为width*height并全部填为浅色。容量足够时不重新分配内存
+    void reset(int newWidth, int newHeight);
+
+    // 把二维码的模块画到左上角为(x0, y0)的位置，整个码必须在图内
+    void drawQrCode(const qrcodegen::QrCode& qr, int x0, int y0);
+};
@@ -0,0 +1,99 @@
+#include "qrcode_payload_encoder.hpp"
+
+#include <stdexcept>
+
+using namespace qrcodegen;
+
+QRPayloadEncoder::QRPayloadEncoder(qrstream::Framing framing, QrCode::Ecc ecc) :
+    payloadFraming(framing), errorCorrection(ecc)
+{
+}
+
+int QRPayloadEncoder::minVersion(qrstream::Framing framing, std::size_t blockLen, QrCode::Ecc ecc)
+{
+    for (int version = QrCode::MIN_VERSION; version <= QrCode::MAX_VERSION; version++)
+    {
+        const int bits = payloadBits(framing, blockLen, version);
+        if (bits != -1 && bits <= QrCode::getNumDataCodewords(version, ecc) * 8)
+            return version;
+    }
+    throw std::domain_error("Packet size too large for a QR code");
+}
+
+std::size_t QRPayloadEncoder::maxBlockBytes(qrstream::Framing framing, int version, QrCode::Ecc ecc)
+{
+    if (version < QrCode::MIN_VERSION || version > QrCode::MAX_VERSION)
+        throw std::domain_error("QR version out of range");
+    const int capacityBits = QrCode::getNumDataCodewords(version, ecc) * 8;
+    auto fits = [&](std::size_t blockLen) {
+        const int bits = payloadBits(framing, blockLen, version);
+        return bits != -1 && bits <= capacityBits;
+    };
+
+    // 占用位数随块长度单调增加，二分查找最后一个装得下的长度。块长度不会超过数据码字的字节数
+    std::size_t lo = 1;
+    if (!fits(lo))
+        throw std::domain_error("QR version too small for a block");
+    std::size_t hi = static_cast<std::size_t>(capacityBits / 8) + 1;
+    while (hi - lo > 1)
+    {
+        const std::size_t mid = lo + (hi - lo) / 2;
+        if (fits(mid))
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int QRPayloadEncoder::payloadBits(qrstream::Framing framing, std::size_t blockLen, int version)
+{
+    // 各封装的载荷长度只取决于块长度，用全0的块算出需要的位数
+    const std::vector<std::uint8_t> block(blockLen);
+    std::vector<std::uint8_t> payload(qrstream::payloadBytes(framing, blockLen) + 1);
+    const std::size_t len = qrstream::encodePayload(framing, block.data(), blockLen, payload.data());
+    payload[len] = '\0';
+    std::vector<QrSegment> segs;
+    makeSegments(framing, payload.data(), len, segs);
+    return QrSegment::getTotalBits(segs, version);
+}
+
+std::size_t QRPayloadEncoder::encode(const std::uint8_t* block, std::size_t blockLen, int version, QrCode& out)
+{
+    payload.resize(qrstream::payloadBytes(payloadFraming, blockLen) + 1);
+    const std::size_t len = qrstream::encodePayload(payloadFraming, block, blockLen, payload.data());
+    if (payloadFraming == qrstream::Framing::Raw || payloadFraming == qrstream::Framing::Base64)
+    {
+        context.encodeBinary(payload.data(), len, errorCorrection, out, version, version);
+        return len;
+    }
+    payload[len] = '\0';
+    makeSegments(payloadFraming, payload.data(), len, segs);
+    context.encodeSegments(segs, errorCorrection, out, version, version);
+    return len;
+}
+
+void QRPayloadEncoder::makeSegments(qrstream::Framing framing, const std::uint8_t* payload, std::size_t len,
+        std::vector<QrSegment>& segs)
+{
+    segs.clear();
+    const char* text = reinterpret_cast<const char*>(payload);
+    switch (framing)
+    {
+    case qrstream::Framing::Alphanumeric:
+        segs.push_back(QrSegment::makeAlphanumeric(text));
+        break;
+    case qrstream::Framing::Numeric:
+    {
+        // 标记字符不是数字，单独成一个字母数字段，其余数字用数字模式
+        const char tag[] = { text[0], '\0' };
+        segs.push_back(QrSegment::makeAlphanumeric(tag));
+        segs.push_back(QrSegment::makeNumeric(text + 1));
+        break;
+    }
+    case qrstream::Framing::Raw:
+    case qrstream::Framing::Base64:
+        segs.push_back(QrSegment::makeBytes(std::vector<std::uint8_t>(payload, payload + len)));
+        break;
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "qrcode_stream_frame.hpp"
+#include "qrcodegen.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 把一个块（块头加数据）按选定的封装编码成二维码。
+// 字节封装（Raw、Base64）用单个字节模式段；文本封装用字母数字段或数字段，
+// 每种封装都落在二维码最省位数的那种模式上。编码缓冲区都在对象里复用，每个编码线程一个。
+class QRPayloadEncoder
+{
+public:
+    QRPayloadEncoder(qrstream::Framing framing, qrcodegen::QrCode::Ecc ecc);
+
+    // 能装下blockLen字节的块的最小版本，装不下时抛出std::domain_error
+    static int minVersion(qrstream::Framing framing, std::size_t blockLen, qrcodegen::QrCode::Ecc ecc);
+
+    // 给定版本能装下的最大块（块头、数据和CRC）字节数，连一个字节都装不下时抛出std::domain_error
+    static std::size_t maxBlockBytes(qrstream::Framing framing, int version, qrcodegen::QrCode::Ecc ecc);
+
+    // blockLen字节的块封装后在给定版本里占用的数据位数（含段头），超出段长度字段时返回-1
+    static int payloadBits(qrstream::Framing framing, std::size_t blockLen, int version);
+
+    // 以固定版本编码，结果写入out（应当来自QrEncoderContext::makeOutput()）。返回载荷的字节数（文本封装为字符数）
+    std::size_t encode(const std::uint8_t* block, std::size_t blockLen, int version, qrcodegen::QrCode& out);
+
+private:
+    // 按封装把payload分成二维码段，文本封装要求payload以'\0'结尾
+    static void makeSegments(qrstream::Framing framing, const std::uint8_t* payload, std::size_t len,
+            std::vector<qrcodegen::QrSegment>& segs);
+
+    qrstream::Framing payloadFraming;
+    qrcodegen::QrCode::Ecc errorCorrection;
+    qrcodegen::QrEncoderContext context;
+    std::vector<std::uint8_t> payload;
+    std::vector<qrcodegen::QrSegment> segs;
+};
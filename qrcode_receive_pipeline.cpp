@@ -0,0 +1,231 @@
+#include "qrcode_receive_pipeline.hpp"
+
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <utility>
+
+// 帧总数：排队的帧，加上每个工作线程手里正在处理的一帧，再加上读帧线程和消费线程手里各一帧
+static std::size_t poolSize(const QRReceivePipeline::Config& config)
+{
+    if (config.workerCount < 1 || config.queueDepth < 1)
+        throw std::domain_error("Worker count and queue depth must be positive");
+    return static_cast<std::size_t>(config.queueDepth) + static_cast<std::size_t>(config.workerCount) + 2;
+}
+
+QRReceivePipeline::QRReceivePipeline(QRFrameSource& frameSource, const Config& pipelineConfig) :
+    source(frameSource), config(pipelineConfig), freeFrames(poolSize(pipelineConfig)),
+    readFrames(poolSize(pipelineConfig)), decodedFrames(poolSize(pipelineConfig))
+{
+    const std::size_t count = poolSize(config);
+    frames.reserve(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        frames.push_back(std::make_unique<Frame>());
+        freeFrames.tryPush(frames.back().get());
+    }
+    for (int i = 0; i < config.workerCount; i++)
+        decoders.push_back(std::make_unique<QRFrameDecoder>(config.tracking));
+}
+
+QRReceivePipeline::~QRReceivePipeline()
+{
+    stop();
+}
+
+void QRReceivePipeline::start()
+{
+    if (running.exchange(true))
+        return;
+    activeWorkers = config.workerCount;
+    reader = std::thread(&QRReceivePipeline::readerLoop, this);
+    for (std::unique_ptr<QRFrameDecoder>& decoder : decoders)
+        workers.emplace_back(&QRReceivePipeline::workerLoop, this, std::ref(*decoder));
+}
+
+void QRReceivePipeline::stop()
+{
+    running = false;
+    source.stop();
+    if (reader.joinable())
+        reader.join();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+QRReceivePipeline::Frame* QRReceivePipeline::tryAcquire()
+{
+    Frame* frame = nullptr;
+    return decodedFrames.tryPop(frame) ? frame : nullptr;
+}
+
+void QRReceivePipeline::release(Frame* frame)
+{
+    histograms[static_cast<std::size_t>(Stage::Total)].record(Clock::now() - frame->readTime);
+    freeFrames.tryPush(frame);  // 队列容量不小于帧总数，不会失败
+}
+
+QRReceivePipeline::Stats QRReceivePipeline::stats() const
+{
+    Stats result;
+    result.readFrames = readCount.load(std::memory_order_relaxed);
+    result.processedFrames = processedCount.load(std::memory_order_relaxed);
+    result.decodedCodes = decodedCodeCount.load(std::memory_order_relaxed);
+    result.droppedFrames = droppedFrameCount.load(std::memory_order_relaxed);
+    result.droppedResults = droppedResultCount.load(std::memory_order_relaxed);
+    result.readerStalls = readerStallCount.load(std::memory_order_relaxed);
+    result.queuedFrames = readFrames.sizeApprox();
+    result.decodedFrames = decodedFrames.sizeApprox();
+    return result;
+}
+
+const LatencyHistogram& QRReceivePipeline::latency(Stage stage) const
+{
+    return histograms[static_cast<std::size_t>(stage)];
+}
+
+QRFrameDecoder::Stats QRReceivePipeline::decoderStats() const
+{
+    QRFrameDecoder::Stats total;
+    for (const std::unique_ptr<QRFrameDecoder>& decoder : decoders)
+    {
+        const QRFrameDecoder::Stats& stats = decoder->stats();
+        total.frames += stats.frames;
+        total.finderPatterns += stats.finderPatterns;
+        total.candidates += stats.candidates;
+        total.decodedCodes += stats.decodedCodes;
+        total.correctedCodewords += stats.correctedCodewords;
+        total.trackedFrames += stats.trackedFrames;
+        total.redetections += stats.redetections;
+        total.binarizeTime += stats.binarizeTime;
+        total.locateTime += stats.locateTime;
+        total.decodeTime += stats.decodeTime;
+    }
+    return total;
+}
+
+bool QRReceivePipeline::finished() const
+{
+    return readerDone.load(std::memory_order_acquire) && activeWorkers.load(std::memory_order_acquire) == 0 &&
+            decodedFrames.sizeApprox() == 0;
+}
+
+bool QRReceivePipeline::failed() const
+{
+    return hasFailed.load(std::memory_order_acquire);
+}
+
+std::string QRReceivePipeline::errorMessage() const
+{
+    std::lock_guard<std::mutex> lock(errorMutex);
+    return error;
+}
+
+void QRReceivePipeline::fail(std::string text)
+{
+    {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!hasFailed.load(std::memory_order_relaxed))
+            error = std::move(text);
+    }
+    hasFailed.store(true, std::memory_order_release);
+    running = false;
+    source.stop();
+}
+
+QRReceivePipeline::Frame* QRReceivePipeline::takeFrame()
+{
+    bool stalled = false;
+    while (running.load(std::memory_order_relaxed))
+    {
+        Frame* frame = nullptr;
+        if (freeFrames.tryPop(frame))
+            return frame;
+        if (config.dropFrames)
+        {
+            // 先丢还没处理的，再丢处理完没取走的，都是最旧的一帧
+            if (readFrames.tryPop(frame))
+            {
+                droppedFrameCount.fetch_add(1, std::memory_order_relaxed);
+                return frame;
+            }
+            if (decodedFrames.tryPop(frame))
+            {
+                droppedResultCount.fetch_add(1, std::memory_order_relaxed);
+                return frame;
+            }
+            // 帧都在工作线程和消费线程手里，马上会有归还的
+            std::this_thread::yield();
+            continue;
+        }
+        if (!stalled)
+            readerStallCount.fetch_add(1, std::memory_order_relaxed);
+        stalled = true;
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    return nullptr;
+}
+
+void QRReceivePipeline::readerLoop()
+{
+    try
+    {
+        while (Frame* frame = takeFrame())
+        {
+            const Clock::time_point start = Clock::now();
+            if (!source.read(frame->image))
+            {
+                freeFrames.tryPush(frame);
+                break;
+            }
+            frame->readTime = Clock::now();
+            histograms[static_cast<std::size_t>(Stage::Read)].record(frame->readTime - start);
+            readFrames.tryPush(frame);  // 队列容量不小于帧总数，不会失败
+            readCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        fail(e.what());
+    }
+    readerDone.store(true, std::memory_order_release);
+}
+
+void QRReceivePipeline::workerLoop(QRFrameDecoder& decoder)
+{
+    try
+    {
+        while (running.load(std::memory_order_relaxed))
+        {
+            Frame* frame = nullptr;
+            if (!readFrames.tryPop(frame))
+            {
+                // 读帧线程退出前放进队列的帧都已经看得到，队列空了就是处理完了
+                if (readerDone.load(std::memory_order_acquire) && readFrames.sizeApprox() == 0)
+                    break;
+                std::this_thread::sleep_for(std::chrono::microseconds(500));
+                continue;
+            }
+
+            const Clock::time_point start = Clock::now();
+            histograms[static_cast<std::size_t>(Stage::Queue)].record(start - frame->readTime);
+            const QRFrameDecoder::Stats before = decoder.stats();
+            frame->codeCount = decoder.decode(frame->image, frame->payloads);
+            const QRFrameDecoder::Stats& after = decoder.stats();
+            histograms[static_cast<std::size_t>(Stage::Binarize)].record(after.binarizeTime - before.binarizeTime);
+            histograms[static_cast<std::size_t>(Stage::Locate)].record(after.locateTime - before.locateTime);
+            histograms[static_cast<std::size_t>(Stage::Decode)].record(after.decodeTime - before.decodeTime);
+
+            // 放进队列后帧就可能被消费线程或者读帧线程拿走，先记下计数
+            processedCount.fetch_add(1, std::memory_order_relaxed);
+            decodedCodeCount.fetch_add(frame->codeCount, std::memory_order_relaxed);
+            decodedFrames.tryPush(frame);  // 队列容量不小于帧总数，不会失败
+        }
+    }
+    catch (const std::exception& e)
+    {
+        fail(e.what());
+    }
+    activeWorkers.fetch_sub(1, std::memory_order_release);
+}
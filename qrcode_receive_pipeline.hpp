@@ -0,0 +1,135 @@
+#pragma once
+
+#include "bounded_ring.hpp"
+#include "latency_histogram.hpp"
+#include "qrcode_frame_decoder.hpp"
+#include "qrcode_frame_source.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 接收端的解码流水线，和发送端的QRFramePipeline对称：
+// 读帧线程从帧源读帧 → 若干图像工作线程各自完成 二值化 → 找码 → 二维码解码 → 消费线程取出载荷交给wirehair。
+// 帧之间互不依赖，图像工作线程并行处理不同的帧，每个线程一个QRFrameDecoder（各自跟踪码的位置），
+// 同一帧的几个阶段留在同一个线程里，省去阶段之间的交接。wirehair解码器只在消费线程里使用（QRStreamAssembler）。
+// 帧对象预先分配好，在空闲、已读、已解码三个无锁有界队列之间循环使用，稳态下不分配内存；
+// 解出的帧可能乱序到达，块本来就互相独立。
+//
+// dropFrames时读帧线程从不等待：没有空闲帧就拿走最旧的一帧已读未处理的帧，还没有就拿走最旧的一帧已解码未取走的帧，
+// 它的内容作废，计入丢帧。所以不管哪个阶段慢，积压都不超过帧池的大小，读到的总是较新的画面。
+// 摄像头要这样；图片序列和录像不是实时的，不丢帧，读帧线程等空闲帧。
+class QRReceivePipeline
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Config
+    {
+        int workerCount = 2;     // 图像工作线程数
+        int queueDepth = 4;      // 帧池里工作线程和消费线程手上之外的帧数，即最多排队的帧数
+        bool dropFrames = true;  // 跟不上时丢掉最旧的帧，见上
+        bool tracking = true;    // 见QRFrameDecoder
+    };
+
+    struct Frame
+    {
+        QRGrayFrame image;
+        std::vector<std::vector<std::uint8_t>> payloads;  // 前codeCount项是解出的载荷
+        std::size_t codeCount = 0;
+        Clock::time_point readTime;  // 读完这一帧的时刻
+    };
+
+    // 各阶段每帧的延迟
+    enum class Stage
+    {
+        Read,      // 帧源的read()，摄像头的帧源里包括等下一帧到达
+        Queue,     // 读完到工作线程开始处理
+        Binarize,
+        Locate,    // 找定位图案、配对，跟踪的帧几乎为0
+        Decode,    // 采样、核对和二维码解码
+        Total,     // 读完到消费线程release()
+    };
+    static constexpr std::size_t kStageCount = 6;
+
+    struct Stats
+    {
+        std::uint64_t readFrames = 0;
+        std::uint64_t processedFrames = 0;  // 图像工作线程处理完的帧
+        std::uint64_t decodedCodes = 0;
+        std::uint64_t droppedFrames = 0;    // 没来得及处理就被读帧线程拿走的帧
+        std::uint64_t droppedResults = 0;   // 解完了但没来得及取走就被拿走的帧
+        std::uint64_t readerStalls = 0;     // 不丢帧时读帧线程等空闲帧的次数
+        std::size_t queuedFrames = 0;       // 已读、等待处理的帧数
+        std::size_t decodedFrames = 0;      // 已解码、等待取走的帧数
+    };
+
+    // 配置不合法时抛出std::domain_error。帧源在流水线销毁前必须一直有效
+    QRReceivePipeline(QRFrameSource& frameSource, const Config& config);
+    ~QRReceivePipeline();
+
+    QRReceivePipeline(const QRReceivePipeline&) = delete;
+    QRReceivePipeline& operator=(const QRReceivePipeline&) = delete;
+
+    void start();
+    // 停止帧源和读帧、图像工作线程，可以在任意线程调用，等这些线程结束后返回
+    void stop();
+
+    // 消费线程：取一帧已解码的帧，没有时返回nullptr。用完后必须release()
+    Frame* tryAcquire();
+    void release(Frame* frame);
+
+    Stats stats() const;
+
+    const LatencyHistogram& latency(Stage stage) const;
+
+    // 各图像工作线程的QRFrameDecoder统计之和，只在线程结束后（finished()或stop()之后）调用
+    QRFrameDecoder::Stats decoderStats() const;
+
+    // 帧源已经读完，而且解出的帧都已经取走
+    bool finished() const;
+
+    // 读帧或者处理出错后返回true，流水线不再产出新帧
+    bool failed() const;
+    std::string errorMessage() const;
+
+private:
+    void readerLoop();
+    void workerLoop(QRFrameDecoder& decoder);
+    // 取一个帧对象来读下一帧，stop()后返回nullptr
+    Frame* takeFrame();
+    void fail(std::string message);
+
+    QRFrameSource& source;
+    Config config;
+
+    std::vector<std::unique_ptr<Frame>> frames;
+    BoundedRing<Frame*> freeFrames;
+    BoundedRing<Frame*> readFrames;
+    BoundedRing<Frame*> decodedFrames;
+    std::vector<std::unique_ptr<QRFrameDecoder>> decoders;  // 与工作线程一一对应
+    std::array<LatencyHistogram, kStageCount> histograms;
+
+    std::thread reader;
+    std::vector<std::thread> workers;
+    std::atomic<bool> running{ false };
+    std::atomic<bool> readerDone{ false };  // 帧源读完，读帧线程已经退出
+    std::atomic<int> activeWorkers{ 0 };
+    std::atomic<std::uint64_t> readCount{ 0 };
+    std::atomic<std::uint64_t> processedCount{ 0 };
+    std::atomic<std::uint64_t> decodedCodeCount{ 0 };
+    std::atomic<std::uint64_t> droppedFrameCount{ 0 };
+    std::atomic<std::uint64_t> droppedResultCount{ 0 };
+    std::atomic<std::uint64_t> readerStallCount{ 0 };
+
+    mutable std::mutex errorMutex;
+    std::atomic<bool> hasFailed{ false };
+    std::string error;
+};
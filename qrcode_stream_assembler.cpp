@@ -0,0 +1,239 @@
+#include "qrcode_stream_assembler.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+QRStreamAssembler::QRStreamAssembler(std::filesystem::path outputPath) : path(std::move(outputPath))
+{
+}
+
+QRStreamAssembler::~QRStreamAssembler()
+{
+    for (Chunk& chunk : chunks)
+    {
+        if (chunk.decoder != nullptr)
+            wirehair_free(chunk.decoder);
+    }
+}
+
+QRStreamAssembler::BlockResult QRStreamAssembler::addPayload(const std::uint8_t* payload, std::size_t len)
+{
+    qrstream::BlockHeader header;
+    std::size_t headerLen = 0;
+    if (!qrstream::decodePayload(payload, len, block) ||
+            !qrstream::readBlock(block.data(), block.size(), header, headerLen))
+    {
+        state.invalidBlocks++;
+        return BlockResult::Invalid;
+    }
+    return addBlock(header, block.data(), headerLen, block.size());
+}
+
+QRStreamAssembler::BlockResult QRStreamAssembler::addBlock(const qrstream::BlockHeader& header,
+        const std::uint8_t* data, std::size_t headerLen, std::size_t len)
+{
+    if (state.started && header.sessionId != state.sessionId)
+    {
+        // 上一次发送或别的发送端的块，不用解码就丢掉
+        state.foreignBlocks++;
+        return BlockResult::Foreign;
+    }
+    if (header.hasSizes && !validSizes(header))
+    {
+        state.invalidBlocks++;
+        return BlockResult::Invalid;
+    }
+    if (!state.started)
+    {
+        // 只带配置哈希的块要等拿到一个带完整尺寸的块之后才能解码。
+        // 有多个分片时最后一片的大小推不出普通分片的大小，核对不了分片数，也先暂存
+        if (!header.hasSizes || (header.chunkCount > 1 && header.chunkIndex + 1 == header.chunkCount))
+        {
+            holdBlock(header, data, headerLen, len);
+            return BlockResult::Held;
+        }
+        startSession(header);
+    }
+    if (header.chunkIndex >= chunks.size())
+    {
+        state.invalidBlocks++;
+        return BlockResult::Invalid;
+    }
+
+    Chunk& chunk = chunks[header.chunkIndex];
+    bool created = false;
+    if (chunk.done)
+    {
+        state.duplicateBlocks++;
+        return BlockResult::Duplicate;
+    }
+    if (chunk.decoder == nullptr)
+    {
+        if (!header.hasSizes)
+        {
+            holdBlock(header, data, headerLen, len);
+            return BlockResult::Held;
+        }
+        chunk.decoder = wirehair_decoder_create(nullptr, header.messageBytes, header.blockBytes);
+        if (chunk.decoder == nullptr)
+            throw std::runtime_error("Failed to create wirehair decoder for chunk " +
+                    std::to_string(header.chunkIndex));
+        chunk.messageBytes = header.messageBytes;
+        chunk.configHash = header.configHash;
+        created = true;
+    }
+    if (header.configHash != chunk.configHash)
+    {
+        state.invalidBlocks++;
+        return BlockResult::Invalid;
+    }
+    if (!chunk.blockIds.insert(header.blockId).second)
+    {
+        state.duplicateBlocks++;
+        return BlockResult::Duplicate;
+    }
+
+    const WirehairResult result = wirehair_decode(chunk.decoder, header.blockId, data + headerLen,
+            static_cast<std::uint32_t>(len - headerLen - qrstream::kBlockCrcBytes));
+    state.acceptedBlocks++;
+    if (result == Wirehair_NeedMore)
+    {
+        if (created)
+            replayHeldBlocks(header.chunkIndex);
+        return chunk.done ? BlockResult::ChunkDone : BlockResult::Accepted;
+    }
+    if (result != Wirehair_Success)
+        throw std::runtime_error(std::string("Wirehair decode failed: ") + wirehair_result_string(result));
+    finishChunk(header.chunkIndex);
+    return BlockResult::ChunkDone;
+}
+
+void QRStreamAssembler::holdBlock(const qrstream::BlockHeader& header, const std::uint8_t* data, std::size_t headerLen,
+        std::size_t len)
+{
+    if (heldBlocks.size() == kMaxHeldBlocks)
+    {
+        heldBlocks.pop_front();
+        state.droppedHeldBlocks++;
+    }
+    heldBlocks.push_back({ header, headerLen, std::vector<std::uint8_t>(data, data + len) });
+    state.heldBlocks++;
+}
+
+void QRStreamAssembler::replayHeldBlocks(std::uint32_t chunkIndex)
+{
+    for (auto it = heldBlocks.begin(); it != heldBlocks.end();)
+    {
+        if (it->header.sessionId != state.sessionId)
+        {
+            it = heldBlocks.erase(it);
+            state.droppedHeldBlocks++;
+            continue;
+        }
+        if (it->header.chunkIndex != chunkIndex)
+        {
+            ++it;
+            continue;
+        }
+        // 解码器已经创建，这里不会再暂存或者递归补块
+        const HeldBlock held = std::move(*it);
+        it = heldBlocks.erase(it);
+        addBlock(held.header, held.data.data(), held.headerLen, held.data.size());
+    }
+}
+
+bool QRStreamAssembler::finished() const
+{
+    return complete;
+}
+
+QRStreamAssembler::Progress QRStreamAssembler::progress() const
+{
+    return state;
+}
+
+bool QRStreamAssembler::feedback(qrstream::Feedback& out) const
+{
+    if (!state.started)
+        return false;
+    out.sessionId = state.sessionId;
+    out.finishedChunks.resize(chunks.size());
+    for (std::size_t i = 0; i < chunks.size(); i++)
+        out.finishedChunks[i] = chunks[i].done;
+    return true;
+}
+
+bool QRStreamAssembler::validSizes(const qrstream::BlockHeader& header) const
+{
+    const qrstream::SessionSizes session{ state.chunkCount, state.fileBytes, chunkStride, blockBytes };
+    return qrstream::validBlockSizes(header, state.started ? &session : nullptr);
+}
+
+void QRStreamAssembler::startSession(const qrstream::BlockHeader& header)
+{
+    state.started = true;
+    state.sessionId = header.sessionId;
+    state.compression = header.compression;
+    state.chunkCount = header.chunkCount;
+    state.fileBytes = header.fileBytes;
+    chunkStride = header.messageBytes;
+    blockBytes = header.blockBytes;
+    chunks.resize(header.chunkCount);
+    output.open(path, std::ios::binary | std::ios::trunc);
+    if (!output)
+        throw std::runtime_error("Cannot create " + path.string());
+}
+
+void QRStreamAssembler::finishChunk(std::uint32_t chunkIndex)
+{
+    Chunk& chunk = chunks[chunkIndex];
+    recovered.resize(chunk.messageBytes);
+    const WirehairResult result = wirehair_recover(chunk.decoder, recovered.data(), chunk.messageBytes);
+    if (result != Wirehair_Success)
+        throw std::runtime_error(std::string("Wirehair recover failed: ") + wirehair_result_string(result));
+    wirehair_free(chunk.decoder);
+    chunk.decoder = nullptr;
+    std::unordered_set<std::uint32_t>().swap(chunk.blockIds);
+    chunk.done = true;
+    state.finishedChunks++;
+
+    if (state.compression == qrstream::Compression::None)
+    {
+        const std::uint64_t offset = qrstream::chunkOffset(chunkIndex, state.chunkCount, state.fileBytes,
+                chunk.messageBytes);
+        output.seekp(static_cast<std::streamoff>(offset));
+        writeOutput(recovered.data(), recovered.size());
+    }
+    else
+    {
+        // 压缩流只能按顺序解，前面还有分片没解完时先留着
+        chunk.pending.assign(recovered.begin(), recovered.end());
+        for (; fedChunks < state.chunkCount && chunks[fedChunks].done; fedChunks++)
+        {
+            Chunk& next = chunks[fedChunks];
+            decompressed.clear();
+            if (!decompressor.feed(next.pending.data(), next.pending.size(), decompressed))
+                throw std::runtime_error("Compressed stream is corrupt");
+            std::vector<std::uint8_t>().swap(next.pending);
+            writeOutput(decompressed.data(), decompressed.size());
+        }
+    }
+
+    if (state.finishedChunks < state.chunkCount)
+        return;
+    if (state.compression != qrstream::Compression::None && !decompressor.atFrameBoundary())
+        throw std::runtime_error("Compressed stream is truncated");
+    output.close();
+    if (!output)
+        throw std::runtime_error("Cannot write " + path.string());
+    complete = true;
+}
+
+void QRStreamAssembler::writeOutput(const std::uint8_t* data, std::size_t len)
+{
+    output.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(len));
+    if (!output)
+        throw std::runtime_error("Cannot write " + path.string());
+    state.writtenBytes += len;
+}
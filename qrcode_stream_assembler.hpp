@@ -0,0 +1,120 @@
+#pragma once
+
+#include "qrcode_compression.hpp"
+#include "qrcode_stream_frame.hpp"
+#include "wirehair.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <unordered_set>
+#include <vector>
+
+// 接收端的组装：把二维码载荷解开成块，交给所属分片的wirehair解码器，解完的分片写进输出文件。
+// 处理方式和网页接收端（opencv-js-qrcode/index.html）一样：
+// - 第一个带完整尺寸的块确定会话，之后别的会话的块直接丢掉
+// - 每个分片拿到一个带完整尺寸的块后创建解码器。之前只带配置哈希的块无法解码，先暂存起来（最多kMaxHeldBlocks个），
+//   解码器创建后再补上：同一帧里几个码的处理顺序不固定，带完整尺寸的块常常不是第一个被处理的
+// - 没压缩时分片解完就写到它在文件里的位置；压缩时按分片顺序喂给流式解压器，解出的数据追加到文件末尾，
+//   先解完的后面的分片暂存在内存里
+// 不是线程安全的，由一个线程独占使用。
+class QRStreamAssembler
+{
+public:
+    static constexpr std::size_t kMaxHeldBlocks = 256;
+
+    enum class BlockResult
+    {
+        Invalid,     // 封装或块格式不对、CRC不符，尺寸不可信（见validSizes），或者与分片的配置哈希不一致
+        Foreign,     // 别的会话的块
+        Held,        // 这个分片还没有拿到完整尺寸，块先暂存起来
+        Duplicate,   // 已经收到过的块，或者分片已经解完
+        Accepted,    // 交给了解码器，还需要更多块
+        ChunkDone,   // 这个块让分片解完了
+    };
+
+    struct Progress
+    {
+        bool started = false;                 // 会话是否已经确定，为false时下面的会话参数无效
+        std::uint16_t sessionId = 0;
+        qrstream::Compression compression = qrstream::Compression::None;
+        std::uint32_t chunkCount = 0;
+        std::uint64_t fileBytes = 0;          // 压缩时是压缩流的字节数
+        std::uint32_t finishedChunks = 0;
+        std::uint64_t writtenBytes = 0;       // 已经写进输出文件的字节数
+        std::uint64_t acceptedBlocks = 0;
+        std::uint64_t invalidBlocks = 0;
+        std::uint64_t foreignBlocks = 0;
+        std::uint64_t heldBlocks = 0;         // 暂存过的块，补上后也计入acceptedBlocks
+        std::uint64_t droppedHeldBlocks = 0;  // 暂存的块太多或者会话不对而丢掉的
+        std::uint64_t duplicateBlocks = 0;
+    };
+
+    // 输出文件在会话确定时才创建（已存在时覆盖）。调用者负责先调用wirehair_init()
+    explicit QRStreamAssembler(std::filesystem::path outputPath);
+    ~QRStreamAssembler();
+
+    QRStreamAssembler(const QRStreamAssembler&) = delete;
+    QRStreamAssembler& operator=(const QRStreamAssembler&) = delete;
+
+    // 处理一个二维码的载荷。创建解码器、恢复数据、解压或写文件失败时抛出std::runtime_error
+    BlockResult addPayload(const std::uint8_t* payload, std::size_t len);
+
+    // 所有分片都解完，文件已经写完并关闭
+    bool finished() const;
+
+    Progress progress() const;
+
+    // 回传给发送端的反馈，会话还没确定时返回false
+    bool feedback(qrstream::Feedback& out) const;
+
+private:
+    struct Chunk
+    {
+        WirehairCodec decoder = nullptr;
+        std::uint32_t messageBytes = 0;
+        std::uint8_t configHash = 0;
+        std::unordered_set<std::uint32_t> blockIds;  // 已经交给解码器的块
+        bool done = false;
+        std::vector<std::uint8_t> pending;           // 压缩时解完、等待前面的分片的数据
+    };
+
+    struct HeldBlock
+    {
+        qrstream::BlockHeader header;
+        std::size_t headerLen = 0;
+        std::vector<std::uint8_t> data;  // 整个块，含块头和CRC
+    };
+
+    // 处理一个已经通过CRC校验的块，data是整个块
+    BlockResult addBlock(const qrstream::BlockHeader& header, const std::uint8_t* data, std::size_t headerLen,
+            std::size_t len);
+    void holdBlock(const qrstream::BlockHeader& header, const std::uint8_t* data, std::size_t headerLen,
+            std::size_t len);
+    // 把暂存的、属于chunkIndex分片的块交给刚创建的解码器，别的会话的块丢掉
+    void replayHeldBlocks(std::uint32_t chunkIndex);
+    // 带完整尺寸的块的尺寸是否可信：不超过qrstream里的上限；会话确定前分片数要和普通分片的大小对得上，
+    // 确定后要和会话一致。块头只有CRC，不核对就按这些尺寸分配内存会被一个伪造的块耗尽
+    bool validSizes(const qrstream::BlockHeader& header) const;
+    // 用第一个带完整尺寸、不是最后一片（只有一片时除外）的块确定会话，创建输出文件
+    void startSession(const qrstream::BlockHeader& header);
+    // 分片解完：恢复数据，写文件或者喂给解压器
+    void finishChunk(std::uint32_t chunkIndex);
+    void writeOutput(const std::uint8_t* data, std::size_t len);
+
+    std::filesystem::path path;
+    std::ofstream output;
+    Progress state;
+    std::uint64_t chunkStride = 0;  // 普通分片的字节数，只有一片时是整个文件
+    std::uint32_t blockBytes = 0;
+    std::vector<Chunk> chunks;
+    std::deque<HeldBlock> heldBlocks;     // 还没有解码器的分片的块，按到达顺序
+    std::vector<std::uint8_t> block;      // 解开的块，复用
+    std::vector<std::uint8_t> recovered;  // 恢复出的分片，复用
+    qrstream::StreamDecompressor decompressor;
+    std::vector<std::uint8_t> decompressed;
+    std::uint32_t fedChunks = 0;          // 压缩时已经喂给解压器的分片数
+    bool complete = false;
+};
@@ -0,0 +1,496 @@
+#include "qrcode_stream_frame.hpp"
+
+#include <array>
+#include <cstring>
+
+namespace qrstream
+{
+
+namespace
+{
+
+constexpr char kBase64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// base64字符到6位值的反查表，非法字符为0xFF
+constexpr std::array<std::uint8_t, 256> kBase64Values = [] {
+    std::array<std::uint8_t, 256> table{};
+    for (auto& value : table)
+        value = 0xFF;
+    for (std::uint8_t i = 0; i < 64; i++)
+        table[static_cast<std::uint8_t>(kBase64Alphabet[i])] = i;
+    return table;
+}();
+
+// 与二维码字母数字模式的字符表顺序一致，字符的值就是它在表中的下标
+constexpr char kBase45Alphabet[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+constexpr std::array<std::uint8_t, 256> kBase45Values = [] {
+    std::array<std::uint8_t, 256> table{};
+    for (auto& value : table)
+        value = 0xFF;
+    for (std::uint8_t i = 0; i < 45; i++)
+        table[static_cast<std::uint8_t>(kBase45Alphabet[i])] = i;
+    return table;
+}();
+
+// 数字封装：每kNumericGroupBytes字节按大端当作一个整数，写成kNumericDigits[字节数]位十进制数（高位补0）。
+// 末尾不足一组的字节数与位数一一对应，解码时据位数还原字节数
+constexpr std::size_t kNumericGroupBytes = 7;
+constexpr std::size_t kNumericDigits[kNumericGroupBytes + 1] = { 0, 3, 5, 8, 10, 13, 15, 17 };
+
+// CRC-32C的反射多项式，逐字节查表
+constexpr std::array<std::uint32_t, 256> kCrc32cTable = [] {
+    std::array<std::uint32_t, 256> table{};
+    for (std::uint32_t i = 0; i < 256; i++)
+    {
+        std::uint32_t crc = i;
+        for (int k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78u : 0);
+        table[i] = crc;
+    }
+    return table;
+}();
+
+void writeLE32(std::uint32_t value, std::uint8_t* out)
+{
+    for (int i = 0; i < 4; i++)
+        out[i] = static_cast<std::uint8_t>(value >> (i * 8));
+}
+
+std::uint32_t readLE32(const std::uint8_t* in)
+{
+    return static_cast<std::uint32_t>(in[0]) | static_cast<std::uint32_t>(in[1]) << 8 |
+            static_cast<std::uint32_t>(in[2]) << 16 | static_cast<std::uint32_t>(in[3]) << 24;
+}
+
+std::size_t encodeBase64(const std::uint8_t* in, std::size_t len, std::uint8_t* out)
+{
+    std::uint8_t* start = out;
+    std::size_t i = 0;
+    for (; i + 3 <= len; i += 3)
+    {
+        const std::uint32_t v = static_cast<std::uint32_t>(in[i]) << 16 | static_cast<std::uint32_t>(in[i + 1]) << 8 |
+                in[i + 2];
+        *out++ = static_cast<std::uint8_t>(kBase64Alphabet[v >> 18]);
+        *out++ = static_cast<std::uint8_t>(kBase64Alphabet[(v >> 12) & 63]);
+        *out++ = static_cast<std::uint8_t>(kBase64Alphabet[(v >> 6) & 63]);
+        *out++ = static_cast<std::uint8_t>(kBase64Alphabet[v & 63]);
+    }
+    if (i < len)
+    {
+        const bool two = i + 1 < len;
+        const std::uint32_t v = static_cast<std::uint32_t>(in[i]) << 16 |
+                (two ? static_cast<std::uint32_t>(in[i + 1]) << 8 : 0);
+        *out++ = static_cast<std::uint8_t>(kBase64Alphabet[v >> 18]);
+        *out++ = static_cast<std::uint8_t>(kBase64Alphabet[(v >> 12) & 63]);
+        *out++ = static_cast<std::uint8_t>(two ? kBase64Alphabet[(v >> 6) & 63] : '=');
+        *out++ = '=';
+    }
+    return static_cast<std::size_t>(out - start);
+}
+
+bool decodeBase64(const std::uint8_t* in, std::size_t len, std::vector<std::uint8_t>& out)
+{
+    while (len > 0 && in[len - 1] == '=')
+        len--;
+    if (len % 4 == 1)
+        return false;
+    out.resize(len * 3 / 4);
+    std::uint32_t acc = 0;
+    int bits = 0;
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < len; i++)
+    {
+        const std::uint8_t value = kBase64Values[in[i]];
+        if (value == 0xFF)
+            return false;
+        acc = acc << 6 | value;
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out[n++] = static_cast<std::uint8_t>(acc >> bits);
+        }
+    }
+    out.resize(n);
+    return true;
+}
+
+std::size_t encodeBase45(const std::uint8_t* in, std::size_t len, std::uint8_t* out)
+{
+    std::uint8_t* start = out;
+    std::size_t i = 0;
+    for (; i + 2 <= len; i += 2)
+    {
+        std::uint32_t v = static_cast<std::uint32_t>(in[i]) << 8 | in[i + 1];
+        for (int k = 0; k < 3; k++, v /= 45)
+            *out++ = static_cast<std::uint8_t>(kBase45Alphabet[v % 45]);
+    }
+    if (i < len)
+    {
+        *out++ = static_cast<std::uint8_t>(kBase45Alphabet[in[i] % 45]);
+        *out++ = static_cast<std::uint8_t>(kBase45Alphabet[in[i] / 45]);
+    }
+    return static_cast<std::size_t>(out - start);
+}
+
+bool decodeBase45(const std::uint8_t* in, std::size_t len, std::vector<std::uint8_t>& out)
+{
+    if (len % 3 == 1)
+        return false;
+    out.resize(len / 3 * 2 + (len % 3 == 2 ? 1 : 0));
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < len; i += 3)
+    {
+        const std::size_t chars = len - i < 3 ? len - i : 3;
+        std::uint32_t v = 0;
+        for (std::size_t k = chars; k-- > 0;)
+        {
+            const std::uint8_t value = kBase45Values[in[i + k]];
+            if (value == 0xFF)
+                return false;
+            v = v * 45 + value;
+        }
+        if (chars == 3)
+        {
+            if (v > 0xFFFF)
+                return false;
+            out[n++] = static_cast<std::uint8_t>(v >> 8);
+        }
+        else if (v > 0xFF)
+        {
+            return false;
+        }
+        out[n++] = static_cast<std::uint8_t>(v);
+    }
+    return true;
+}
+
+std::size_t encodeNumeric(const std::uint8_t* in, std::size_t len, std::uint8_t* out)
+{
+    std::uint8_t* start = out;
+    for (std::size_t i = 0; i < len; i += kNumericGroupBytes)
+    {
+        const std::size_t bytes = len - i < kNumericGroupBytes ? len - i : kNumericGroupBytes;
+        std::uint64_t v = 0;
+        for (std::size_t k = 0; k < bytes; k++)
+            v = v << 8 | in[i + k];
+        const std::size_t digits = kNumericDigits[bytes];
+        for (std::size_t k = digits; k-- > 0; v /= 10)
+            out[k] = static_cast<std::uint8_t>('0' + v % 10);
+        out += digits;
+    }
+    return static_cast<std::size_t>(out - start);
+}
+
+bool decodeNumeric(const std::uint8_t* in, std::size_t len, std::vector<std::uint8_t>& out)
+{
+    constexpr std::size_t groupDigits = kNumericDigits[kNumericGroupBytes];
+    std::size_t tailBytes = 0;
+    while (tailBytes < kNumericGroupBytes && kNumericDigits[tailBytes] != len % groupDigits)
+        tailBytes++;
+    if (tailBytes == kNumericGroupBytes)
+        return false;
+    out.resize(len / groupDigits * kNumericGroupBytes + tailBytes);
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < len; i += groupDigits)
+    {
+        const std::size_t digits = len - i < groupDigits ? len - i : groupDigits;
+        const std::size_t bytes = digits == groupDigits ? kNumericGroupBytes : tailBytes;
+        std::uint64_t v = 0;
+        for (std::size_t k = 0; k < digits; k++)
+        {
+            if (in[i + k] < '0' || in[i + k] > '9')
+                return false;
+            v = v * 10 + static_cast<std::uint64_t>(in[i + k] - '0');
+        }
+        if (bytes < 8 && v >> (bytes * 8) != 0)
+            return false;
+        for (std::size_t k = bytes; k-- > 0; v >>= 8)
+            out[n + k] = static_cast<std::uint8_t>(v);
+        n += bytes;
+    }
+    return true;
+}
+
+} // namespace
+
+std::size_t varintBytes(std::uint64_t value)
+{
+    std::size_t n = 1;
+    for (; value >= 0x80; value >>= 7)
+        n++;
+    return n;
+}
+
+std::size_t writeVarint(std::uint64_t value, std::uint8_t* out)
+{
+    std::size_t n = 0;
+    for (; value >= 0x80; value >>= 7)
+        out[n++] = static_cast<std::uint8_t>(value | 0x80);
+    out[n++] = static_cast<std::uint8_t>(value);
+    return n;
+}
+
+bool readVarint(const std::uint8_t* in, std::size_t end, std::size_t& pos, std::uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 70; shift += 7)
+    {
+        if (pos >= end)
+            return false;
+        const std::uint8_t byte = in[pos++];
+        if (shift == 63 && byte > 0x01)
+            return false;
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool readVarint32(const std::uint8_t* in, std::size_t end, std::size_t& pos, std::uint32_t& value)
+{
+    std::uint64_t wide = 0;
+    if (!readVarint(in, end, pos, wide) || wide > UINT32_MAX)
+        return false;
+    value = static_cast<std::uint32_t>(wide);
+    return true;
+}
+
+
+std::uint8_t configHash(std::uint32_t messageBytes, std::uint32_t blockBytes)
+{
+    std::uint8_t sizes[8];
+    writeLE32(messageBytes, sizes);
+    writeLE32(blockBytes, sizes + 4);
+    const std::uint32_t crc = crc32c(sizes, sizeof(sizes));
+    return static_cast<std::uint8_t>(crc ^ crc >> 8 ^ crc >> 16 ^ crc >> 24);
+}
+
+std::uint64_t chunkOffset(std::uint32_t chunkIndex, std::uint32_t chunkCount, std::uint64_t fileBytes,
+        std::uint32_t chunkBytes)
+{
+    if (chunkIndex + 1 == chunkCount)
+        return fileBytes - chunkBytes;
+    return static_cast<std::uint64_t>(chunkIndex) * chunkBytes;
+}
+
+std::uint64_t chunkCountFor(std::uint64_t fileBytes, std::uint64_t chunkBytes, std::uint64_t blockBytes)
+{
+    std::uint64_t n = (fileBytes + chunkBytes - 1) / chunkBytes;
+    if (n > 1 && fileBytes - (n - 1) * chunkBytes <= blockBytes)
+        n--;
+    return n;
+}
+
+bool validBlockSizes(const BlockHeader& header, const SessionSizes* session)
+{
+    const std::uint64_t blocks = (std::uint64_t(header.messageBytes) + header.blockBytes - 1) / header.blockBytes;
+    if (header.fileBytes > kMaxFileBytes || header.chunkCount > kMaxChunkCount || blocks < 2 ||
+            blocks > kMaxChunkBlocks)
+        return false;
+    if (session != nullptr)
+    {
+        // 普通分片一样大，最后一片是剩下的字节
+        const std::uint64_t expected = header.chunkIndex + 1 == session->chunkCount ?
+                session->fileBytes - std::uint64_t(session->chunkCount - 1) * session->chunkBytes : session->chunkBytes;
+        return header.chunkCount == session->chunkCount && header.fileBytes == session->fileBytes &&
+                header.blockBytes == session->blockBytes && header.messageBytes == expected;
+    }
+    if (header.chunkCount == 1)
+        return header.messageBytes == header.fileBytes;
+    return header.chunkIndex + 1 == header.chunkCount ||
+            chunkCountFor(header.fileBytes, header.messageBytes, header.blockBytes) == header.chunkCount;
+}
+
+std::uint32_t crc32c(const std::uint8_t* data, std::size_t len)
+{
+    std::uint32_t crc = 0xFFFFFFFFu;
+    for (std::size_t i = 0; i < len; i++)
+        crc = (crc >> 8) ^ kCrc32cTable[(crc ^ data[i]) & 0xFF];
+    return ~crc;
+}
+
+std::size_t maxBlockOverhead(std::uint64_t fileBytes, std::uint32_t chunkCount, std::uint32_t maxChunkBytes,
+        std::uint32_t blockBytes)
+{
+    const std::uint32_t lastChunk = chunkCount > 0 ? chunkCount - 1 : 0;
+    return 1 + 2 + varintBytes(lastChunk) + varintBytes(kMaxBlockId) + varintBytes(chunkCount) +
+            varintBytes(fileBytes) + varintBytes(maxChunkBytes) + varintBytes(blockBytes) + kBlockCrcBytes;
+}
+
+std::size_t writeBlockHeader(const BlockHeader& header, std::uint8_t* out)
+{
+    std::size_t n = 0;
+    out[n++] = static_cast<std::uint8_t>(kBlockFormatVersion << 4 | static_cast<int>(header.compression) << 1 |
+            (header.hasSizes ? 1 : 0));
+    out[n++] = static_cast<std::uint8_t>(header.sessionId);
+    out[n++] = static_cast<std::uint8_t>(header.sessionId >> 8);
+    n += writeVarint(header.chunkIndex, out + n);
+    n += writeVarint(header.blockId, out + n);
+    if (header.hasSizes)
+    {
+        n += writeVarint(header.chunkCount, out + n);
+        n += writeVarint(header.fileBytes, out + n);
+        n += writeVarint(header.messageBytes, out + n);
+        n += writeVarint(header.blockBytes, out + n);
+    }
+    else
+    {
+        out[n++] = configHash(header.messageBytes, header.blockBytes);
+    }
+    return n;
+}
+
+std::size_t sealBlock(std::uint8_t* block, std::size_t len)
+{
+    writeLE32(crc32c(block, len), block + len);
+    return len + kBlockCrcBytes;
+}
+
+bool readBlock(const std::uint8_t* block, std::size_t len, BlockHeader& header, std::size_t& headerLen)
+{
+    // 先查长度：只有一个封装前缀的载荷解开是空块，block可能是空指针
+    if (len < 1 + 2 + 1 + 1 + 1 + kBlockCrcBytes)
+        return false;
+    const int compression = block[0] >> 1 & 0x07;
+    if (block[0] >> 4 != kBlockFormatVersion || compression > static_cast<int>(Compression::Lz4))
+        return false;
+    const std::size_t end = len - kBlockCrcBytes;
+    if (crc32c(block, end) != readLE32(block + end))
+        return false;
+
+    std::size_t pos = 1;
+    header.sessionId = static_cast<std::uint16_t>(block[pos] | block[pos + 1] << 8);
+    pos += 2;
+    header.compression = static_cast<Compression>(compression);
+    header.hasSizes = (block[0] & 1) != 0;
+    if (!readVarint32(block, end, pos, header.chunkIndex) || !readVarint32(block, end, pos, header.blockId))
+        return false;
+    if (header.hasSizes)
+    {
+        if (!readVarint32(block, end, pos, header.chunkCount) || !readVarint(block, end, pos, header.fileBytes) ||
+                !readVarint32(block, end, pos, header.messageBytes) ||
+                !readVarint32(block, end, pos, header.blockBytes))
+            return false;
+        // 尺寸自相矛盾的块按格式不对处理，接收端可以直接用这些尺寸分配内存
+        if (header.chunkIndex >= header.chunkCount || header.messageBytes > header.fileBytes ||
+                header.blockBytes == 0)
+            return false;
+        header.configHash = configHash(header.messageBytes, header.blockBytes);
+    }
+    else
+    {
+        if (pos >= end)
+            return false;
+        header.chunkCount = 0;
+        header.fileBytes = 0;
+        header.messageBytes = 0;
+        header.blockBytes = 0;
+        header.configHash = block[pos++];
+    }
+    headerLen = pos;
+    return true;
+}
+
+std::size_t payloadBytes(Framing framing, std::size_t blockLen)
+{
+    switch (framing)
+    {
+    case Framing::Raw:
+        return 1 + blockLen;
+    case Framing::Alphanumeric:
+        return 1 + blockLen / 2 * 3 + blockLen % 2 * 2;
+    case Framing::Numeric:
+        return 1 + blockLen / kNumericGroupBytes * kNumericDigits[kNumericGroupBytes] +
+                kNumericDigits[blockLen % kNumericGroupBytes];
+    case Framing::Base64:
+        break;
+    }
+    return (blockLen + 2) / 3 * 4;
+}
+
+std::size_t encodePayload(Framing framing, const std::uint8_t* block, std::size_t blockLen, std::uint8_t* out)
+{
+    switch (framing)
+    {
+    case Framing::Raw:
+        out[0] = kRawFramingTag;
+        std::memcpy(out + 1, block, blockLen);
+        return 1 + blockLen;
+    case Framing::Alphanumeric:
+        out[0] = kAlphanumericFramingTag;
+        return 1 + encodeBase45(block, blockLen, out + 1);
+    case Framing::Numeric:
+        out[0] = kNumericFramingTag;
+        return 1 + encodeNumeric(block, blockLen, out + 1);
+    case Framing::Base64:
+        break;
+    }
+    return encodeBase64(block, blockLen, out);
+}
+
+void writeFeedback(const Feedback& feedback, std::vector<std::uint8_t>& out)
+{
+    const auto chunks = feedback.finishedChunks.size();
+    out.assign(3 + 2 + varintBytes(chunks) + (chunks + 7) / 8 + kBlockCrcBytes, 0);
+    std::size_t n = 0;
+    out[n++] = 'Q';
+    out[n++] = 'F';
+    out[n++] = kFeedbackVersion;
+    out[n++] = static_cast<std::uint8_t>(feedback.sessionId);
+    out[n++] = static_cast<std::uint8_t>(feedback.sessionId >> 8);
+    n += writeVarint(chunks, out.data() + n);
+    for (std::size_t i = 0; i < chunks; i++)
+    {
+        if (feedback.finishedChunks[i])
+            out[n + i / 8] = static_cast<std::uint8_t>(out[n + i / 8] | 1 << (i % 8));
+    }
+    n += (chunks + 7) / 8;
+    sealBlock(out.data(), n);
+}
+
+bool readFeedback(const std::uint8_t* data, std::size_t len, Feedback& feedback)
+{
+    if (len < 3 + 2 + 1 + kBlockCrcBytes || data[0] != 'Q' || data[1] != 'F' || data[2] != kFeedbackVersion)
+        return false;
+    const std::size_t end = len - kBlockCrcBytes;
+    if (crc32c(data, end) != readLE32(data + end))
+        return false;
+    feedback.sessionId = static_cast<std::uint16_t>(data[3] | data[4] << 8);
+    std::size_t pos = 5;
+    std::uint32_t chunks = 0;
+    if (!readVarint32(data, end, pos, chunks) || end - pos != (static_cast<std::size_t>(chunks) + 7) / 8)
+        return false;
+    feedback.finishedChunks.assign(chunks, false);
+    for (std::uint32_t i = 0; i < chunks; i++)
+        feedback.finishedChunks[i] = (data[pos + i / 8] >> (i % 8) & 1) != 0;
+    return true;
+}
+
+bool decodePayload(const std::uint8_t* payload, std::size_t len, std::vector<std::uint8_t>& block)
+{
+    if (len == 0)
+        return false;
+    bool valid = false;
+    switch (payload[0])
+    {
+    case kRawFramingTag:
+        block.assign(payload + 1, payload + len);
+        valid = true;
+        break;
+    case kAlphanumericFramingTag:
+        valid = decodeBase45(payload + 1, len - 1, block);
+        break;
+    case kNumericFramingTag:
+        valid = decodeNumeric(payload + 1, len - 1, block);
+        break;
+    default:
+        valid = decodeBase64(payload, len, block);
+        break;
+    }
+    return valid;
+}
+
+} // namespace qrstream
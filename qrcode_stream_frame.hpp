@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 发送端、decoder_wasm和本地接收端共用的帧格式，不依赖Qt。
+//
+// 要发送的文件切成若干分片，每个分片是一个独立的wirehair消息（wirehair一个消息最多64000块）。
+// 一个二维码承载某个分片的一个wirehair块，块的布局（多字节整数都是小端，varint为LEB128）：
+//   [格式字节] [会话id: 2字节] [分片序号: varint] [blockId: varint] [尺寸] [块数据] [CRC-32C: 4字节]
+// - 格式字节：高4位为格式版本kBlockFormatVersion，第1、2位为压缩方式Compression，最低位表示尺寸部分是否完整
+// - 会话id：发送端每次启动随机选取，接收端据此丢掉上一次发送或别的发送端的块
+// - 尺寸：完整时为 [分片数: varint] [文件字节数: varint] [分片字节数: varint] [块字节数: varint]，
+//   否则只有1字节的配置哈希configHash()。发送端每个分片每kFullHeaderInterval个blockId带一次完整尺寸，
+//   其余的块只带哈希，接收端拿到过这个分片的完整尺寸后用哈希核对
+// - CRC-32C覆盖前面的全部字节，接收端不用经过wirehair解码就能丢掉识别错误的块
+// 分片在文件里的位置见chunkOffset()：除最后一片外各分片一样大，最后一片对齐到文件末尾。
+// 压缩时分片切的是压缩流（qrcode_compression.hpp），文件字节数也是压缩流的字节数。
+// 二维码载荷有四种封装：
+// - Raw：一个标记字节kRawFramingTag后直接跟块头和块数据，按字节模式原样承载，每字节8位
+// - Base64：对块头和块数据整体做base64，按字节模式承载，每6位数据占8位
+// - Alphanumeric：标记字符kAlphanumericFramingTag后跟base45文本（RFC 9285，每2字节3个字符），
+//   按字母数字模式承载，每16位数据占16.5位
+// - Numeric：标记字符kNumericFramingTag后跟十进制数字（每7字节17位数字），
+//   标记单独用一个字母数字段，数字用数字模式承载，每56位数据占56.7位
+// 后三种只含文本，适合只能输出文本的扫码器。各标记都不是base64字符，接收端据载荷的第一个字节自动区分，不需要额外配置。
+namespace qrstream
+{
+
+enum class Framing
+{
+    Base64,
+    Raw,
+    Alphanumeric,
+    Numeric,
+};
+
+enum class Compression
+{
+    None,
+    Lz4,    // LZ4压缩流，格式见qrcode_compression.hpp
+};
+
+constexpr std::uint8_t kRawFramingTag = 0x01;
+constexpr char kAlphanumericFramingTag = ':';
+constexpr char kNumericFramingTag = '-';
+
+constexpr std::uint8_t kBlockFormatVersion = 2;
+constexpr std::uint32_t kFullHeaderInterval = 8;
+constexpr std::uint32_t kMaxBlockId = (1u << 28) - 1;  // blockId的varint最多4字节
+constexpr std::size_t kMaxBlockHeaderBytes = 1 + 2 + 5 + 5 + 5 + 10 + 5 + 5;
+constexpr std::size_t kBlockCrcBytes = 4;
+// 块头里的尺寸没有认证，接收端按这些上限拒绝会话，不会按伪造的尺寸分配内存。发送端也不会超过
+constexpr std::uint64_t kMaxFileBytes = std::uint64_t(1) << 40;
+constexpr std::uint32_t kMaxChunkCount = 1u << 16;
+constexpr std::uint32_t kMaxChunkBlocks = 64000;  // wirehair一个消息最多的块数
+
+struct BlockHeader
+{
+    std::uint16_t sessionId = 0;
+    Compression compression = Compression::None;
+    std::uint32_t chunkIndex = 0;
+    std::uint32_t blockId = 0;       // 分片内的块编号
+    bool hasSizes = false;           // 是否带完整尺寸，为false时下面四个尺寸无效
+    std::uint32_t chunkCount = 0;
+    std::uint64_t fileBytes = 0;
+    std::uint32_t messageBytes = 0;  // 这个分片（一个wirehair消息）的字节数
+    std::uint32_t blockBytes = 0;    // wirehair的块大小（最后一个原始块可能更短）
+    std::uint8_t configHash = 0;     // configHash(messageBytes, blockBytes)，总是有效
+};
+
+// 分片和块字节数的1字节哈希
+std::uint8_t configHash(std::uint32_t messageBytes, std::uint32_t blockBytes);
+
+// 分片在文件里的起始位置，chunkBytes是这个分片的字节数
+std::uint64_t chunkOffset(std::uint32_t chunkIndex, std::uint32_t chunkCount, std::uint64_t fileBytes,
+        std::uint32_t chunkBytes);
+
+// fileBytes字节按每片chunkBytes字节切出的分片数。wirehair至少要2个原始块，只剩不到一个blockBytes字节块的最后一片
+// 并入前一片
+std::uint64_t chunkCountFor(std::uint64_t fileBytes, std::uint64_t chunkBytes, std::uint64_t blockBytes);
+
+// 一个会话的尺寸，取自开始会话的块头
+struct SessionSizes
+{
+    std::uint32_t chunkCount = 0;
+    std::uint64_t fileBytes = 0;
+    std::uint64_t chunkBytes = 0;  // 普通分片的字节数，即分片的间距，只有一片时是整个文件
+    std::uint32_t blockBytes = 0;
+};
+
+// 带完整尺寸的块头里的尺寸是否可信：不超过上面的上限；session不为nullptr时要和会话一致，
+// 分片大小和它的位置相符；会话开始前分片数要和发送端按这个分片大小的切法对得上。
+// 会话开始前多个分片的最后一片推不出普通分片的大小，核对不了分片数，也返回true，调用者不能用它开始会话
+bool validBlockSizes(const BlockHeader& header, const SessionSizes* session);
+
+// CRC-32C（Castagnoli多项式）
+std::uint32_t crc32c(const std::uint8_t* data, std::size_t len);
+
+// LEB128 varint：编码后的字节数；写到out（至少10字节）并返回字节数
+std::size_t varintBytes(std::uint64_t value);
+std::size_t writeVarint(std::uint64_t value, std::uint8_t* out);
+
+// 从in[pos, end)读一个varint并推进pos，越界或超出范围时返回false
+bool readVarint(const std::uint8_t* in, std::size_t end, std::size_t& pos, std::uint64_t& value);
+bool readVarint32(const std::uint8_t* in, std::size_t end, std::size_t& pos, std::uint32_t& value);
+
+// 一个会话里块头加CRC最多占用的字节数（按带完整尺寸、blockId不超过kMaxBlockId计算），用来确定块数据的大小。
+// maxChunkBytes是最大的分片字节数
+std::size_t maxBlockOverhead(std::uint64_t fileBytes, std::uint32_t chunkCount, std::uint32_t maxChunkBytes,
+        std::uint32_t blockBytes);
+
+// 把块头写到out，out至少要有kMaxBlockHeaderBytes字节，返回块头的字节数。
+// header.hasSizes为true时写完整尺寸，否则写由messageBytes和blockBytes算出的哈希（这时两者仍须有效）
+std::size_t writeBlockHeader(const BlockHeader& header, std::uint8_t* out);
+
+// block的前len字节是块头加块数据，在其后追加CRC，返回加上CRC后的字节数
+std::size_t sealBlock(std::uint8_t* block, std::size_t len);
+
+// 校验CRC并解析块头，块数据为block[headerLen, len - kBlockCrcBytes)。
+// 版本不认识、格式不对或CRC不符时返回false
+bool readBlock(const std::uint8_t* block, std::size_t len, BlockHeader& header, std::size_t& headerLen);
+
+// 按framing封装blockLen字节的块（块头、数据和CRC）后的载荷字节数（文本封装为字符数，含标记）
+std::size_t payloadBytes(Framing framing, std::size_t blockLen);
+
+// 按framing封装块，out至少要有payloadBytes(framing, blockLen)字节，返回写入的字节数。
+// 文本封装写入的是ASCII字符，不带结尾的'\0'
+std::size_t encodePayload(Framing framing, const std::uint8_t* block, std::size_t blockLen, std::uint8_t* out);
+
+// 接收端回传给发送端的反馈，一个UDP数据报：
+//   ['Q'] ['F'] [格式版本kFeedbackVersion] [会话id: 2字节] [分片数: varint] [位图: (分片数 + 7) / 8字节] [CRC-32C: 4字节]
+// 位图里第i个分片对应字节i / 8的第i % 8位，为1表示这个分片已经解完，发送端不用再发
+constexpr std::uint8_t kFeedbackVersion = 1;
+
+struct Feedback
+{
+    std::uint16_t sessionId = 0;
+    std::vector<bool> finishedChunks;  // 大小就是分片数
+};
+
+// 把反馈写成数据报，覆盖out原来的内容
+void writeFeedback(const Feedback& feedback, std::vector<std::uint8_t>& out);
+
+// 解析反馈数据报，格式不对或CRC不符时返回false
+bool readFeedback(const std::uint8_t* data, std::size_t len, Feedback& feedback);
+
+// 解开一个二维码的载荷，自动识别封装，整个块写入block（复用其容量）。封装格式不对时返回false，不检查块本身
+bool decodePayload(const std::uint8_t* payload, std::size_t len, std::vector<std::uint8_t>& block);
+
+} // namespace qrstream
@@ -0,0 +1,648 @@
+#include "latency_histogram.hpp"
+#include "qrcode_binarizer.hpp"
+#include "qrcode_camera_source.hpp"
+#include "qrcode_decoder.hpp"
+#include "qrcode_frame_decoder.hpp"
+#include "qrcode_frame_source.hpp"
+#include "qrcode_locator.hpp"
+#include "qrcode_receive_pipeline.hpp"
+#include "qrcode_stream_assembler.hpp"
+#include "qrcodegen.hpp"
+#include "wirehair.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <print>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <QCameraInfo>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QGuiApplication>
+#include <QHostAddress>
+#include <QStringList>
+#include <QTimer>
+#include <QUdpSocket>
+
+// 本地接收端：从图片序列、原始视频文件或摄像头读帧，解出每帧里的二维码，交给wirehair还原出文件。
+// 读帧和二维码解码在QRReceivePipeline的线程里，wirehair在接收线程里，主线程只跑Qt的事件循环
+// （摄像头的帧和反馈的UDP发送都在这里）。
+// 图片序列和原始视频不限速、不丢帧，按处理速度读完，可以用发送端--record录下的帧离线测试接收端的速度。
+
+using Clock = std::chrono::steady_clock;
+
+// 接收线程：从流水线取出解好的帧 → 组装文件，直到文件收完、帧源结束或者stop()。wirehair解码器只在这个线程里使用
+class QRReceiver {
+public:
+    QRReceiver(QRFrameSource &frameSource, const std::filesystem::path &outputPath,
+            const QRReceivePipeline::Config &config) :
+        source(frameSource), pipeline(frameSource, config), assembler(outputPath) {
+    }
+
+    ~QRReceiver() {
+        stop();
+    }
+
+    // onChunkDone在有分片解完时调用，onExit在接收线程结束前调用，都在接收线程里
+    void start(std::function<void()> onChunkDone, std::function<void()> onExit) {
+        pipeline.start();
+        worker = std::thread([this, onChunkDone = std::move(onChunkDone), onExit = std::move(onExit)] {
+            try {
+                run(onChunkDone);
+            } catch (const std::exception &e) {
+                std::lock_guard lock(mutex);
+                error = e.what();
+            }
+            pipeline.stop();
+            onExit();
+        });
+    }
+
+    // 可以在任意线程调用，等接收线程结束后返回
+    void stop() {
+        stopRequested = true;
+        if (worker.joinable() && worker.get_id() != std::this_thread::get_id())
+            worker.join();
+        pipeline.stop();
+    }
+
+    // 最新的反馈，会话还没确定时返回false。可以在任意线程调用
+    bool feedback(qrstream::Feedback &out) const {
+        std::lock_guard lock(mutex);
+        if (!hasFeedback)
+            return false;
+        out = latestFeedback;
+        return true;
+    }
+
+    std::string errorMessage() const {
+        std::lock_guard lock(mutex);
+        if (error.empty() && pipeline.failed())
+            return pipeline.errorMessage();
+        return error;
+    }
+
+    // 以下在接收线程结束后调用
+    bool finished() const {
+        return assembler.finished();
+    }
+
+    void printSummary(const std::filesystem::path &outputPath) const {
+        const QRFrameDecoder::Stats stats = pipeline.decoderStats();
+        const QRReceivePipeline::Stats pipelineStats = pipeline.stats();
+        const QRStreamAssembler::Progress progress = assembler.progress();
+        const double seconds = std::chrono::duration<double>(elapsed).count();
+        const auto frames = static_cast<double>(std::max<uint64_t>(stats.frames, 1));
+        auto perFrame = [frames](std::chrono::nanoseconds time) {
+            return std::chrono::duration<double, std::milli>(time).count() / frames;
+        };
+        std::println("Frames: {} read, {} decoded in {:.2f} s ({:.1f} fps), {} dropped by the source, {} before "
+                "decoding, {} after; {} QR codes decoded ({:.2f} per frame) from {} candidates, {} codewords corrected",
+                pipelineStats.readFrames, stats.frames, seconds,
+                seconds > 0 ? static_cast<double>(stats.frames) / seconds : 0.0, source.droppedFrames(),
+                pipelineStats.droppedFrames, pipelineStats.droppedResults, stats.decodedCodes,
+                static_cast<double>(stats.decodedCodes) / frames, stats.candidates, stats.correctedCodewords);
+        std::println("Per frame: binarize {:.3f} ms, locate {:.3f} ms, decode {:.3f} ms, assemble {:.3f} ms",
+                perFrame(stats.binarizeTime), perFrame(stats.locateTime), perFrame(stats.decodeTime),
+                perFrame(assembleTime));
+        std::println("Located: {} frames by tracking, {} by full detection", stats.trackedFrames, stats.redetections);
+        // 不丢帧时读帧线程等空闲帧的次数，多说明瓶颈在图像工作线程
+        std::println("Reader: stalled {} times waiting for a free frame", pipelineStats.readerStalls);
+        std::println("Blocks: {} accepted, {} held ({} dropped), {} duplicate, {} invalid, {} from other sessions",
+                progress.acceptedBlocks, progress.heldBlocks, progress.droppedHeldBlocks, progress.duplicateBlocks,
+                progress.invalidBlocks, progress.foreignBlocks);
+        if (!progress.started)
+            std::println("No block with a full header was received");
+        else if (assembler.finished())
+            std::println("Received {} bytes to {} (session {:04x}, {} chunks{})", progress.writtenBytes,
+                    outputPath.string(), progress.sessionId, progress.chunkCount,
+                    progress.compression == qrstream::Compression::Lz4 ?
+                            std::format(", {} bytes compressed", progress.fileBytes) : std::string());
+        else
+            std::println("Incomplete: {}/{} chunks, {} bytes written to {}", progress.finishedChunks,
+                    progress.chunkCount, progress.writtenBytes, outputPath.string());
+    }
+
+    // 各阶段每帧延迟的分位数；buckets时再逐行输出直方图的各个桶
+    void printLatency(bool buckets) const {
+        using Stage = QRReceivePipeline::Stage;
+        const std::array<std::pair<const char *, const LatencyHistogram *>, 7> stages = { {
+            { "read", &pipeline.latency(Stage::Read) },
+            { "queue", &pipeline.latency(Stage::Queue) },
+            { "binarize", &pipeline.latency(Stage::Binarize) },
+            { "locate", &pipeline.latency(Stage::Locate) },
+            { "decode", &pipeline.latency(Stage::Decode) },
+            { "assemble", &assembleLatency },
+            { "total", &pipeline.latency(Stage::Total) },
+        } };
+        auto millis = [](std::chrono::nanoseconds time) {
+            return std::chrono::duration<double, std::milli>(time).count();
+        };
+        std::println("{:<9} {:>8} {:>9} {:>9} {:>9} {:>9} {:>9}  (ms)", "stage", "frames", "mean", "p50", "p90",
+                "p99", "max");
+        for (const auto &[name, histogram] : stages)
+            std::println("{:<9} {:>8} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f}", name, histogram->count(),
+                    millis(histogram->mean()), millis(histogram->percentile(0.5)),
+                    millis(histogram->percentile(0.9)), millis(histogram->percentile(0.99)),
+                    millis(histogram->max()));
+        if (!buckets)
+            return;
+        for (const auto &[name, histogram] : stages) {
+            std::string line;
+            for (int i = 0; i < LatencyHistogram::kBuckets; i++) {
+                if (histogram->bucketCount(i) != 0)
+                    line += std::format(" <{}us:{}", LatencyHistogram::bucketLimit(i).count(),
+                            histogram->bucketCount(i));
+            }
+            std::println("{:<9}{}", name, line);
+        }
+    }
+
+private:
+    void run(const std::function<void()> &onChunkDone) {
+        const Clock::time_point start = Clock::now();
+        Clock::time_point lastReport = start;
+        while (!stopRequested && !assembler.finished()) {
+            QRReceivePipeline::Frame *frame = pipeline.tryAcquire();
+            if (!frame) {
+                if (pipeline.finished() || pipeline.failed())
+                    break;
+                std::this_thread::sleep_for(std::chrono::microseconds(500));
+                continue;
+            }
+            const Clock::time_point assembleStart = Clock::now();
+            bool chunkDone = false;
+            for (size_t i = 0; i < frame->codeCount; i++) {
+                if (assembler.addPayload(frame->payloads[i].data(), frame->payloads[i].size()) ==
+                        QRStreamAssembler::BlockResult::ChunkDone)
+                    chunkDone = true;
+            }
+            pipeline.release(frame);
+            const Clock::time_point now = Clock::now();
+            assembleTime += now - assembleStart;
+            assembleLatency.record(now - assembleStart);
+
+            // 会话确定后马上有反馈可发，之后只在分片解完时更新
+            if (chunkDone || (!hasFeedback && assembler.progress().started)) {
+                std::lock_guard lock(mutex);
+                hasFeedback = assembler.feedback(latestFeedback);
+            }
+            if (chunkDone)
+                onChunkDone();
+            if (now - lastReport >= std::chrono::seconds(1)) {
+                printProgress(now - start);
+                lastReport = now;
+            }
+        }
+        elapsed = Clock::now() - start;
+    }
+
+    void printProgress(Clock::duration time) const {
+        const QRReceivePipeline::Stats stats = pipeline.stats();
+        const QRStreamAssembler::Progress progress = assembler.progress();
+        const double seconds = std::chrono::duration<double>(time).count();
+        // 知道总帧数时（图片序列）显示处理到了第几帧；丢帧包括摄像头来不及取、被新帧覆盖的。
+        // 不丢帧时读帧线程等空闲帧的次数一直增加，说明瓶颈在图像工作线程；排队的帧数是已读未处理、已解码未取走的
+        const size_t totalFrames = source.frameCount();
+        std::println("{:.0f} s: {}{} frames ({:.1f} fps, {} dropped, {} reader stalls, queues {} read/{} decoded), "
+                "{} codes, {} blocks, chunks {}/{}, {} bytes written", seconds, stats.processedFrames,
+                totalFrames != 0 ? std::format("/{}", totalFrames) : std::string(),
+                static_cast<double>(stats.processedFrames) / seconds,
+                source.droppedFrames() + stats.droppedFrames + stats.droppedResults, stats.readerStalls,
+                stats.queuedFrames, stats.decodedFrames, stats.decodedCodes, progress.acceptedBlocks,
+                progress.finishedChunks, progress.chunkCount, progress.writtenBytes);
+    }
+
+    QRFrameSource &source;
+    QRReceivePipeline pipeline;
+    QRStreamAssembler assembler;  // 只在接收线程里使用
+    std::thread worker;
+    std::atomic<bool> stopRequested{ false };
+    std::chrono::nanoseconds assembleTime{ 0 };
+    LatencyHistogram assembleLatency;
+    Clock::duration elapsed{ 0 };
+
+    mutable std::mutex mutex;  // 保护反馈和错误信息
+    qrstream::Feedback latestFeedback;
+    bool hasFeedback = false;
+    std::string error;
+};
+
+// 解码器的往返测试：每个版本和纠错等级用encodeBinary编码若干个正好装满这个版本的随机载荷，
+// 随机翻转整个码上的一些模块后解码，统计还原出原载荷的比例、解出错误载荷的次数和平均解码耗时。
+// 翻转的模块数按纠错能力（各块可纠正的码字数之和）的比例取，错误在各块之间分布不均，满额时常有块超出
+static void printDecodeReport()
+{
+    constexpr int kTrials = 50;
+    constexpr std::array<int, 11> versions = { 1, 2, 5, 7, 10, 15, 20, 25, 30, 35, 40 };
+    constexpr std::array<double, 4> errorShares = { 0, 0.25, 0.5, 1 };
+    constexpr const char *kEccNames[] = { "L", "M", "Q", "H" };
+
+    std::mt19937 rng(1);
+    QRDecoder decoder;
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> decoded;
+    qrcodegen::BitMatrix modules;
+    std::println("{:>7} {:>3} {:>5} {:>8} {:>7} {:>7} {:>7} {:>7} {:>6} {:>9} {:>9}", "version", "ecc", "side",
+            "capacity", "0%", "25%", "50%", "100%", "wrong", "us clean", "us 50%");
+    for (const int version : versions)
+    {
+        for (int e = 0; e < 4; e++)
+        {
+            const auto ecc = static_cast<qrcodegen::QrCode::Ecc>(e);
+            const qrcodegen::QrCode::BlockLayout layout = qrcodegen::QrCode::getBlockLayout(version, ecc);
+            const int capacity = layout.numBlocks * (layout.blockEccLen / 2);
+            const int side = version * 4 + 17;
+            payload.resize(static_cast<size_t>(qrcodegen::QrCode::getMaxBytePayload(version, ecc)));
+            std::array<int, errorShares.size()> recovered{};
+            std::array<std::chrono::nanoseconds, errorShares.size()> decodeTime{};
+            int wrong = 0;
+            std::uniform_int_distribution<int> coordinate(0, side - 1);
+            for (int trial = 0; trial < kTrials; trial++)
+            {
+                for (uint8_t &byte : payload)
+                    byte = static_cast<uint8_t>(rng());
+                const qrcodegen::QrCode qr = qrcodegen::QrCode::encodeBinary(payload, ecc);
+                for (size_t s = 0; s < errorShares.size(); s++)
+                {
+                    modules.reset(side);
+                    for (int y = 0; y < side; y++)
+                        std::copy_n(qr.getRow(y), modules.getWordsPerRow(), modules.getRow(y));
+                    const auto flips = static_cast<int>(capacity * errorShares[s]);
+                    for (int i = 0; i < flips;)
+                    {
+                        const int x = coordinate(rng);
+                        const int y = coordinate(rng);
+                        if (modules.get(x, y) != qr.getModule(x, y))
+                            continue;
+                        modules.set(x, y, !modules.get(x, y));
+                        i++;
+                    }
+
+                    const auto start = Clock::now();
+                    const bool ok = decoder.decode(modules, decoded);
+                    decodeTime[s] += Clock::now() - start;
+                    if (ok && decoded == payload)
+                        recovered[s]++;
+                    else if (ok)
+                        wrong++;
+                }
+            }
+
+            auto percent = [](int count) {
+                return 100.0 * count / kTrials;
+            };
+            auto micros = [](std::chrono::nanoseconds time) {
+                return std::chrono::duration<double, std::micro>(time).count() / kTrials;
+            };
+            std::println("{:>7} {:>3} {:>5} {:>8} {:>6.1f}% {:>6.1f}% {:>6.1f}% {:>6.1f}% {:>6} {:>9.1f} {:>9.1f}",
+                    version, kEccNames[e], side, capacity, percent(recovered[0]), percent(recovered[1]),
+                    percent(recovered[2]), percent(recovered[3]), wrong, micros(decodeTime[0]),
+                    micros(decodeTime[2]));
+        }
+    }
+}
+
+// 合成一帧kBenchmarkWidth×kBenchmarkHeight的BGRA图，2×2平铺版本15的码，每模块5像素，四周各留4个模块的空白，
+// 加上从左到右变暗一半的光照和±8的噪声
+constexpr int kBenchmarkWidth = 1920;
+constexpr int kBenchmarkHeight = 1080;
+constexpr int kBenchmarkTiles = 2;
+
+static std::vector<uint8_t> renderBenchmarkFrame()
+{
+    constexpr int kModulePixels = 5;
+
+    std::mt19937 rng(1);
+    std::vector<uint8_t> payload(static_cast<size_t>(
+            qrcodegen::QrCode::getMaxBytePayload(15, qrcodegen::QrCode::Ecc::LOW)));
+    std::vector<qrcodegen::QrCode> codes;
+    for (int i = 0; i < kBenchmarkTiles * kBenchmarkTiles; i++)
+    {
+        for (uint8_t &byte : payload)
+            byte = static_cast<uint8_t>(rng());
+        codes.push_back(qrcodegen::QrCode::encodeBinary(payload, qrcodegen::QrCode::Ecc::LOW));
+    }
+    const int side = (codes[0].getSize() + 8) * kModulePixels;
+    std::vector<uint8_t> bgra(static_cast<size_t>(kBenchmarkWidth) * kBenchmarkHeight * 4);
+    for (int y = 0; y < kBenchmarkHeight; y++)
+    {
+        for (int x = 0; x < kBenchmarkWidth; x++)
+        {
+            const int tile = x / side + y / side * kBenchmarkTiles;
+            const int moduleX = x % side / kModulePixels - 4;
+            const int moduleY = y % side / kModulePixels - 4;
+            const bool dark = x < side * kBenchmarkTiles && y < side * kBenchmarkTiles &&
+                    codes[static_cast<size_t>(tile)].getModule(moduleX, moduleY);
+            const double light = 1 - 0.5 * x / kBenchmarkWidth;
+            const int noise = static_cast<int>(rng() % 17) - 8;
+            const auto value = static_cast<uint8_t>(std::clamp(static_cast<int>((dark ? 40 : 230) * light) + noise,
+                    0, 255));
+            uint8_t *pixel = &bgra[(static_cast<size_t>(y) * kBenchmarkWidth + static_cast<size_t>(x)) * 4];
+            pixel[0] = pixel[1] = pixel[2] = value;
+            pixel[3] = 255;
+        }
+    }
+    return bgra;
+}
+
+static QRGrayFrame benchmarkGrayFrame(const std::vector<uint8_t> &bgra)
+{
+    QRGrayFrame frame;
+    frame.width = kBenchmarkWidth;
+    frame.height = kBenchmarkHeight;
+    frame.pixels.resize(static_cast<size_t>(kBenchmarkWidth) * kBenchmarkHeight);
+    QRBinarizer::grayFromBgra(bgra.data(), frame.pixels.size(), frame.pixels.data());
+    return frame;
+}
+
+// 二值化的吞吐量：在合成帧上分别计时灰度转换、二值化和找定位图案，输出每帧耗时和每秒处理的像素数
+static void printBinarizeBenchmark()
+{
+    constexpr int kFrames = 200;
+
+    const std::vector<uint8_t> bgra = renderBenchmarkFrame();
+    QRGrayFrame frame = benchmarkGrayFrame(bgra);
+    QRBinarizer binarizer;
+    QRBinaryImage image;
+    std::vector<QRLocator::FinderPattern> patterns;
+    auto measure = [](auto &&stage) {
+        const auto start = Clock::now();
+        for (int i = 0; i < kFrames; i++)
+            stage();
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count() / kFrames;
+    };
+    const double grayTime = measure([&] { QRBinarizer::grayFromBgra(bgra.data(), frame.pixels.size(),
+            frame.pixels.data()); });
+    const double binarizeTime = measure([&] { binarizer.binarize(frame, image); });
+    const double locateTime = measure([&] { QRLocator::findFinderPatterns(image, patterns); });
+
+    const double megapixels = kBenchmarkWidth * kBenchmarkHeight / 1e6;
+    std::println("{}x{} frame, {} frames, {} instructions", kBenchmarkWidth, kBenchmarkHeight, kFrames,
+            QRBinarizer::instructionSet());
+    std::println("{:<16} {:>9} {:>12}", "stage", "ms/frame", "Mpixel/s");
+    std::println("{:<16} {:>9.3f} {:>12.0f}", "BGRA to gray", grayTime, megapixels / grayTime * 1000);
+    std::println("{:<16} {:>9.3f} {:>12.0f}", "binarize", binarizeTime, megapixels / binarizeTime * 1000);
+    std::println("{:<16} {:>9.3f} {:>12.0f}", "finder patterns", locateTime, megapixels / locateTime * 1000);
+    std::println("Found {} finder patterns, expected {}", patterns.size(), kBenchmarkTiles * kBenchmarkTiles * 3);
+}
+
+// 跟踪模式的收益：同一张合成帧反复解码，画面不动，比较每帧都完整检测和只在第一帧检测之后按变换采样的耗时
+static void printTrackingBenchmark()
+{
+    constexpr int kFrames = 100;
+
+    const QRGrayFrame frame = benchmarkGrayFrame(renderBenchmarkFrame());
+    std::vector<std::vector<uint8_t>> payloads;
+    std::println("{}x{} frame, {} frames, {} QR codes", kBenchmarkWidth, kBenchmarkHeight, kFrames,
+            kBenchmarkTiles * kBenchmarkTiles);
+    std::println("{:<16} {:>10} {:>10} {:>10} {:>13} {:>9}", "mode", "binarize", "locate", "decode", "locate+decode",
+            "codes");
+    for (const bool tracking : { false, true })
+    {
+        QRFrameDecoder decoder(tracking);
+        for (int i = 0; i < kFrames; i++)
+            decoder.decode(frame, payloads);
+        const QRFrameDecoder::Stats &stats = decoder.stats();
+        auto perFrame = [](std::chrono::nanoseconds time) {
+            return std::chrono::duration<double, std::milli>(time).count() / kFrames;
+        };
+        std::println("{:<16} {:>7.3f} ms {:>7.3f} ms {:>7.3f} ms {:>10.3f} ms {:>9.2f}",
+                tracking ? "tracking" : "full detection", perFrame(stats.binarizeTime), perFrame(stats.locateTime),
+                perFrame(stats.decodeTime), perFrame(stats.locateTime + stats.decodeTime),
+                static_cast<double>(stats.decodedCodes) / kFrames);
+    }
+}
+
+int main(int argc, char *argv[]) try
+{
+    const WirehairResult initResult = wirehair_init();
+    if (initResult != Wirehair_Success)
+    {
+        std::println(stderr, "Wirehair initialization failed: {}", wirehair_result_string(initResult));
+        return -1;
+    }
+
+    // 用不用摄像头决定了创建哪种Qt应用对象，所以先直接解析argv
+    QCommandLineParser parser;
+    QCommandLineOption outputOption("output", "File to write the received data to (default received.bin).", "path",
+            "received.bin");
+    QCommandLineOption imagesOption("images", "Read frames from the images in a directory, in file name order, "
+            "such as those written by the sender's --record.", "dir");
+    QCommandLineOption rawOption("raw", "Read frames from a headerless raw video file, such as one exported with "
+            "ffmpeg -f rawvideo; needs --raw-size.", "path");
+    QCommandLineOption rawSizeOption("raw-size", "Frame size of --raw as WIDTHxHEIGHT.", "size");
+    QCommandLineOption rawFormatOption("raw-format", "Pixel format of --raw: gray (default), rgb24 or yuv420p.",
+            "format", "gray");
+    QCommandLineOption cameraOption("camera", "Capture frames from the camera with this index in --list-cameras.",
+            "index");
+    QCommandLineOption listCamerasOption("list-cameras", "List the available cameras, then exit.");
+    QCommandLineOption decodeReportOption("decode-report", "Decode randomly damaged QR codes of each version and "
+            "error correction level, print the recovery rate and decode time, then exit.");
+    QCommandLineOption binarizeBenchmarkOption("binarize-benchmark", "Time gray conversion, binarization and the "
+            "finder pattern search on a synthetic 1080p frame, then exit.");
+    QCommandLineOption trackingBenchmarkOption("tracking-benchmark", "Decode a still synthetic 1080p frame "
+            "repeatedly with and without tracking, print the per-frame cost of each, then exit.");
+    QCommandLineOption noTrackingOption("no-tracking", "Search every frame for finder patterns instead of reusing "
+            "the geometry of the codes found in earlier frames.");
+    QCommandLineOption workersOption("workers", "Number of threads decoding QR codes from frames (default: the "
+            "hardware threads minus two, at least one).", "count");
+    QCommandLineOption histogramOption("latency-histogram", "After the per-stage latency percentiles, also print "
+            "every bucket of each latency histogram.");
+    QCommandLineOption feedbackOption("feedback", "Report finished chunks to the sender's --feedback-port over UDP, "
+            "as HOST:PORT.", "address");
+    parser.addOption(outputOption);
+    parser.addOption(imagesOption);
+    parser.addOption(rawOption);
+    parser.addOption(rawSizeOption);
+    parser.addOption(rawFormatOption);
+    parser.addOption(cameraOption);
+    parser.addOption(listCamerasOption);
+    parser.addOption(noTrackingOption);
+    parser.addOption(workersOption);
+    parser.addOption(histogramOption);
+    parser.addOption(feedbackOption);
+    parser.addOption(decodeReportOption);
+    parser.addOption(binarizeBenchmarkOption);
+    parser.addOption(trackingBenchmarkOption);
+    QStringList arguments;
+    for (int i = 0; i < argc; i++)
+        arguments << QString::fromLocal8Bit(argv[i]);
+    if (!parser.parse(arguments))
+    {
+        std::println(stderr, "{}", parser.errorText().toStdString());
+        return -1;
+    }
+
+    if (parser.isSet(decodeReportOption))
+    {
+        printDecodeReport();
+        return 0;
+    }
+    if (parser.isSet(binarizeBenchmarkOption))
+    {
+        printBinarizeBenchmark();
+        return 0;
+    }
+    if (parser.isSet(trackingBenchmarkOption))
+    {
+        printTrackingBenchmark();
+        return 0;
+    }
+
+    const bool useCamera = parser.isSet(cameraOption) || parser.isSet(listCamerasOption);
+    const int sources = (parser.isSet(imagesOption) ? 1 : 0) + (parser.isSet(rawOption) ? 1 : 0) +
+            (parser.isSet(cameraOption) ? 1 : 0);
+    if (sources != 1 && !parser.isSet(listCamerasOption))
+    {
+        std::println(stderr, "Give exactly one of --images, --raw or --camera");
+        return -1;
+    }
+
+    QRReceivePipeline::Config pipelineConfig;
+    pipelineConfig.workerCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 2);
+    if (parser.isSet(workersOption))
+    {
+        bool workersValid = false;
+        pipelineConfig.workerCount = parser.value(workersOption).toInt(&workersValid);
+        if (!workersValid || pipelineConfig.workerCount < 1)
+        {
+            std::println(stderr, "Invalid value for --workers: {}", parser.value(workersOption).toStdString());
+            return -1;
+        }
+    }
+    // 只有摄像头是实时的，跟不上时丢旧帧；文件帧源等处理线程
+    pipelineConfig.dropFrames = parser.isSet(cameraOption);
+    pipelineConfig.tracking = !parser.isSet(noTrackingOption);
+
+    QHostAddress feedbackHost;
+    quint16 feedbackPort = 0;
+    if (parser.isSet(feedbackOption))
+    {
+        const QString address = parser.value(feedbackOption);
+        const int colon = address.lastIndexOf(':');
+        bool portValid = false;
+        const int port = colon > 0 ? address.mid(colon + 1).toInt(&portValid) : 0;
+        if (!portValid || port < 1 || port > 65535 || !feedbackHost.setAddress(address.left(colon)))
+        {
+            std::println(stderr, "Invalid value for --feedback: {}", address.toStdString());
+            return -1;
+        }
+        feedbackPort = static_cast<quint16>(port);
+    }
+
+    // 摄像头要用QGuiApplication，其余的不需要图形环境
+    std::unique_ptr<QCoreApplication> app;
+    if (useCamera)
+        app = std::make_unique<QGuiApplication>(argc, argv);
+    else
+        app = std::make_unique<QCoreApplication>(argc, argv);
+
+    const QList<QCameraInfo> cameras = useCamera ? QCameraInfo::availableCameras() : QList<QCameraInfo>();
+    if (parser.isSet(listCamerasOption))
+    {
+        for (int i = 0; i < cameras.size(); i++)
+            std::println("{}: {} ({})", i, cameras[i].description().toStdString(),
+                    cameras[i].deviceName().toStdString());
+        return 0;
+    }
+
+    std::unique_ptr<QRFrameSource> source;
+    if (parser.isSet(imagesOption))
+    {
+        source = std::make_unique<QRImageSequenceSource>(parser.value(imagesOption).toStdWString());
+    }
+    else if (parser.isSet(rawOption))
+    {
+        const QStringList size = parser.value(rawSizeOption).split('x');
+        bool widthValid = false, heightValid = false;
+        int width = 0, height = 0;
+        if (size.size() == 2)
+        {
+            width = size[0].toInt(&widthValid);
+            height = size[1].toInt(&heightValid);
+        }
+        if (!widthValid || !heightValid)
+        {
+            std::println(stderr, "Invalid value for --raw-size: {}", parser.value(rawSizeOption).toStdString());
+            return -1;
+        }
+        const QString format = parser.value(rawFormatOption);
+        QRRawVideoSource::PixelFormat pixelFormat = QRRawVideoSource::PixelFormat::Gray;
+        if (format == "rgb24")
+            pixelFormat = QRRawVideoSource::PixelFormat::Rgb24;
+        else if (format == "yuv420p")
+            pixelFormat = QRRawVideoSource::PixelFormat::Yuv420p;
+        else if (format != "gray")
+        {
+            std::println(stderr, "Unknown raw format: {}", format.toStdString());
+            return -1;
+        }
+        source = std::make_unique<QRRawVideoSource>(parser.value(rawOption).toStdWString(), width, height,
+                pixelFormat);
+    }
+    else
+    {
+        bool indexValid = false;
+        const int index = parser.value(cameraOption).toInt(&indexValid);
+        if (!indexValid || index < 0 || index >= cameras.size())
+        {
+            std::println(stderr, "No camera with index {}", parser.value(cameraOption).toStdString());
+            return -1;
+        }
+        source = std::make_unique<QRCameraSource>(cameras[index]);
+    }
+
+    const std::filesystem::path outputPath = parser.value(outputOption).toStdWString();
+    QRReceiver receiver(*source, outputPath, pipelineConfig);
+
+    // 反馈在主线程发送：分片解完时马上发一次，之后每秒重发，UDP丢了也不要紧
+    QUdpSocket feedbackSocket;
+    std::vector<uint8_t> datagram;
+    auto sendFeedback = [&] {
+        qrstream::Feedback feedback;
+        if (feedbackPort == 0 || !receiver.feedback(feedback))
+            return;
+        qrstream::writeFeedback(feedback, datagram);
+        feedbackSocket.writeDatagram(reinterpret_cast<const char *>(datagram.data()),
+                static_cast<qint64>(datagram.size()), feedbackHost, feedbackPort);
+    };
+    QTimer feedbackTimer;
+    QObject::connect(&feedbackTimer, &QTimer::timeout, sendFeedback);
+    if (feedbackPort != 0)
+        feedbackTimer.start(1000);
+
+    QCoreApplication *application = app.get();
+    receiver.start([application, &sendFeedback] { QMetaObject::invokeMethod(application, sendFeedback); },
+            [application] { QMetaObject::invokeMethod(application, &QCoreApplication::quit, Qt::QueuedConnection); });
+    app->exec();
+    receiver.stop();
+    // 最后一次反馈告诉发送端全部分片都已收到，它就不用再发了
+    sendFeedback();
+
+    const std::string error = receiver.errorMessage();
+    if (!error.empty())
+    {
+        std::println(stderr, "Error: {}", error);
+        return -1;
+    }
+    receiver.printSummary(outputPath);
+    receiver.printLatency(parser.isSet(histogramOption));
+    return receiver.finished() ? 0 : 1;
+}
+catch (std::exception &e)
+{
+    std::println(stderr, "Exception: {}", e.what());
+    return -1;
+}
@@ -1,60 +1,55 @@
-#include "qrcodegen.hpp"
+#include "mapped_file.hpp"
+#include "qrcode_compression.hpp"
+#include "qrcode_frame_pipeline.hpp"
+#include "qrcode_frame_scheduler.hpp"
+#include "qrcode_frame_view.hpp"
+#include "qrcode_payload_encoder.hpp"
 #include "wirehair.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
 #include <print>
+#include <thread>
 #include <vector>
 #include <iostream>
-#include <sstream>
 #include <random>
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
 #include <QMainWindow>
-#include <QSvgWidget>
+#include <QSurfaceFormat>
 #include <QVBoxLayout>
 #include <QWidget>
-#include <QByteArray>
 #include <QTimer>
 #include <QLabel>
+#include <QNetworkDatagram>
+#include <QUdpSocket>
 
 using std::vector, std::cout, std::endl;
-using namespace qrcodegen;
 
 
-static std::string toSvgString(const QrCode &qr, int border)
+// 命令行可调的发送参数
+struct SenderOptions
 {
-    if (border < 0)
-        throw std::domain_error("Border must be non-negative");
-    if (border > INT_MAX / 2 || border * 2 > INT_MAX - qr.getSize())
-        throw std::overflow_error("Border too large");
-
-    std::ostringstream sb;
-    sb << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
-    sb << "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n";
-    sb << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\" viewBox=\"0 0 ";
-    sb << (qr.getSize() + border * 2) << " " << (qr.getSize() + border * 2) << "\" stroke=\"none\">\n";
-    sb << "\t<rect width=\"100%\" height=\"100%\" fill=\"#FFFFFF\"/>\n";
-    sb << "\t<path d=\"";
-    for (int y = 0; y < qr.getSize(); y++)
-    {
-        for (int x = 0; x < qr.getSize(); x++)
-        {
-            if (qr.getModule(x, y))
-            {
-                if (x != 0 || y != 0)
-                    sb << " ";
-                sb << "M" << (x + border) << "," << (y + border) << "h1v1h-1z";
-            }
-        }
-    }
-    sb << "\" fill=\"#000000\"/>\n";
-    sb << "</svg>\n";
-    return sb.str();
-}
+    bool useGL = true;           // true：纹理上传显示；false：QPainter绘制QImage
+    int refreshesPerFrame = 3;   // 每帧停留的显示刷新次数
+    int modulePixels = 0;        // 每个模块的物理像素数，0为自动放大到铺满窗口
+    QRFramePipeline::Config pipeline;  // 块大小、平铺、静区、编码线程和队列深度
+    quint16 feedbackPort = 0;    // 接收端反馈的UDP端口，0为不接收反馈
+};
 
 class QRCodeWindow : public QMainWindow {
     Q_OBJECT
 public:
-    QRCodeWindow(QWidget *parent = nullptr) : QMainWindow(parent) {
+    explicit QRCodeWindow(const SenderOptions &senderOptions, QWidget *parent = nullptr) :
+        QMainWindow(parent), options(senderOptions) {
         setWindowTitle("QR Code Viewer");
         resize(1000, 1100);
         
@@ -63,109 +58,363 @@ public:
         
         layout = new QVBoxLayout(centralWidget);
         
-        svgWidget = new QSvgWidget(centralWidget);
-        layout->addWidget(svgWidget);
+        if (options.useGL)
+            frameView = new QRGLFrameWidget(centralWidget);
+        else
+            frameView = new QRRasterFrameWidget(centralWidget);
+        layout->addWidget(frameView->widget());
         
         statusLabel = new QLabel(centralWidget);
         layout->addWidget(statusLabel);
 
-        layout->setStretch(0, 10);  // svgWidget占10份
+        layout->setStretch(0, 10);  // frameView占10份
         layout->setStretch(1, 1);   // statusLabel占1份
         
-        timer = new QTimer(this);
-        connect(timer, &QTimer::timeout, this, &QRCodeWindow::updateQRCode);
+        frameView->setModulePixels(options.modulePixels);
+
+        scheduler = new QRFrameScheduler(frameView, options.refreshesPerFrame, this);
+        scheduler->setFrameSource([this] { return presentNextFrame(); });
+
+        // 状态栏低频刷新，避免每帧触发标签重新布局
+        statusTimer = new QTimer(this);
+        connect(statusTimer, &QTimer::timeout, this, &QRCodeWindow::updateStatus);
     }
     
-    void startDisplay(const vector<uint8_t>& _message, int _packetSize) {
-        this->message = _message;
-        this->packetSize = _packetSize;
-        currentBlockId = 0;
-        
-        encoder = wirehair_encoder_create(nullptr, &message[0], message.size(), packetSize);
-        if (!encoder) {
-            statusLabel->setText("Failed to create encoder");
+    // data在窗口关闭前必须一直有效
+    void startDisplay(const uint8_t *data, size_t size) {
+        try {
+            pipeline = std::make_unique<QRFramePipeline>(data, size, options.pipeline);
+        } catch (const std::exception &e) {
+            statusLabel->setText(e.what());
             return;
         }
         
-        timer->start(50); // 刷新率
+        if (options.feedbackPort != 0) {
+            feedbackSocket = new QUdpSocket(this);
+            if (!feedbackSocket->bind(QHostAddress::Any, options.feedbackPort)) {
+                statusLabel->setText(QString("Cannot listen for feedback on UDP port %1: %2")
+                        .arg(options.feedbackPort).arg(feedbackSocket->errorString()));
+                return;
+            }
+            connect(feedbackSocket, &QUdpSocket::readyRead, this, &QRCodeWindow::readFeedback);
+        }
+
+        pipeline->start();
+        scheduler->start();
+        statusTimer->start(500);
+        statusClock.start();
     }
     
 private slots:
-    void updateQRCode() {
-        if (!encoder) return;
-
-
-
-        // +0: blockId
-        // +4: data total size
-        // +8: block size
-        // +12: block data
-        vector<uint8_t> block(packetSize + 4 + 4 + 4);
-
-        auto *blockPtr = (uint32_t*)&block[0];
-        *blockPtr = currentBlockId;
-        uint32_t writeLen = 0;
-
-        auto *dataTotalSizePtr = (uint32_t*)&block[4];
-        *dataTotalSizePtr = (uint32_t)message.size();
-
-        auto *blockSizePtr = (uint32_t*)&block[8];
-        *blockSizePtr = packetSize;
-        
-        WirehairResult encodeResult = wirehair_encode(
-            encoder,
-            currentBlockId,
-            &block[4 + 4 + 4],
-            packetSize,
-            &writeLen
-        );
-        
-        if (encodeResult != Wirehair_Success) {
-            statusLabel->setText(QString("Encode failed at block %1").arg(currentBlockId));
-            timer->stop();
+    void updateStatus() {
+        if (pipeline->failed()) {
+            statusLabel->setText(QString::fromStdString(pipeline->errorMessage()));
+            scheduler->stop();
+            statusTimer->stop();
+            return;
+        }
+        const QRFramePipeline::Stats queue = pipeline->stats();
+        if (pipeline->finished()) {
+            // 发送计划结束，最后一帧留在屏幕上
+            statusLabel->setText(QString("Done: sent %1 blocks of %2 chunks in %3 passes, %4 chunks confirmed by "
+                                         "the receiver")
+                    .arg(queue.sentBlocks).arg(pipeline->chunkCount()).arg(queue.pass)
+                    .arg(queue.acknowledgedChunks));
+            scheduler->stop();
+            statusTimer->stop();
             return;
         }
-        block.resize(writeLen + 4 + 4 + 4);
-
-        // 将block编码为base64
-        QByteArray qarrayBlock((const char *)block.data(), (int)block.size());
-        auto base64block = qarrayBlock.toBase64();
-        auto vecBase64block = std::vector<uint8_t>(base64block.begin(), base64block.end());
 
-        // 创建二维码
-        // QrCode qr = QrCode::encodeBinary(block, QrCode::Ecc::LOW);
-        QrCode qr = QrCode::encodeBinary(vecBase64block, QrCode::Ecc::LOW);
-        
-        // 转换为SVG
-        auto svg = toSvgString(qr, 10);
-        
-        // 更新显示
-        QByteArray svgData(svg.c_str());
-        svgWidget->load(svgData);
-        
-        // 更新状态
-        statusLabel->setText(QString("Block ID: %1, Size: %2 bytes").arg(currentBlockId).arg(vecBase64block.size()));
-        
-        currentBlockId++;
+        const QRFrameScheduler::Stats &stats = scheduler->stats();
+        const double seconds = static_cast<double>(statusClock.restart()) / 1000.0;
+        const double fps = seconds > 0 ? static_cast<double>(stats.presentedFrames - lastPresented) / seconds : 0;
+        lastPresented = stats.presentedFrames;
+        statusLabel->setText(QString("Session %16, block ID: %1 (x%13, version %14, %15-byte blocks), "
+                                     "Size: %2 bytes | %3 fps @ %4 Hz, dropped refreshes: %5, late frames: %6, "
+                                     "starved: %7\n"
+                                     "queue: %8/%9, produced: %10, producer stalls: %11, consumer stalls: %12 | "
+                                     "chunk %17/%18, pass %19, confirmed %20")
+                .arg(lastBlockId).arg(frameBytes)
+                .arg(fps, 0, 'f', 1).arg(scheduler->refreshRate(), 0, 'f', 1)
+                .arg(stats.droppedRefreshes).arg(stats.lateFrames).arg(stats.starvedTicks)
+                .arg(queue.queueDepth).arg(queue.queueCapacity).arg(queue.producedFrames)
+                .arg(queue.producerStalls).arg(queue.consumerStalls)
+                .arg(lastBlockCount).arg(pipeline->qrVersion()).arg(pipeline->packetSize())
+                .arg(pipeline->sessionId(), 4, 16, QChar('0'))
+                .arg(lastChunk + 1).arg(pipeline->chunkCount())
+                .arg(queue.pass).arg(queue.acknowledgedChunks));
     }
     
+    // 接收端回传的反馈：确认解完的分片不再发送
+    void readFeedback() {
+        qrstream::Feedback feedback;
+        while (feedbackSocket->hasPendingDatagrams()) {
+            const QByteArray datagram = feedbackSocket->receiveDatagram().data();
+            if (!qrstream::readFeedback(reinterpret_cast<const uint8_t *>(datagram.constData()),
+                        static_cast<size_t>(datagram.size()), feedback) ||
+                    feedback.sessionId != pipeline->sessionId() ||
+                    feedback.finishedChunks.size() != pipeline->chunkCount())
+                continue;
+            for (uint32_t i = 0; i < pipeline->chunkCount(); i++) {
+                if (feedback.finishedChunks[i])
+                    pipeline->acknowledgeChunk(i);
+            }
+        }
+    }
+
 private:
+    // 帧源：从流水线取一帧已渲染好的帧交给显示控件，显示控件复制后立即归还
+    bool presentNextFrame() {
+        QRFramePipeline::Frame *frame = pipeline->tryAcquire();
+        if (frame == nullptr)
+            return false;
+        frameView->showFrame(frame->image);
+        lastChunk = frame->chunkIndex;
+        lastBlockId = frame->firstBlockId;
+        lastBlockCount = frame->blockCount;
+        frameBytes = frame->payloadBytes;
+        pipeline->release(frame);
+        return true;
+    }
+    
+    SenderOptions options;
     QWidget *centralWidget;
     QVBoxLayout *layout;
-    QSvgWidget *svgWidget;
+    QRFrameView *frameView;
     QLabel *statusLabel;
-    QTimer *timer;
+    QRFrameScheduler *scheduler;
+    QTimer *statusTimer;
+    QUdpSocket *feedbackSocket = nullptr;
+    QElapsedTimer statusClock;
+    quint64 lastPresented = 0;
     
-    vector<uint8_t> message;
-    int packetSize;
-    unsigned currentBlockId;
-    WirehairCodec encoder;
+    std::unique_ptr<QRFramePipeline> pipeline;
+    uint32_t lastChunk = 0;
+    uint32_t lastBlockId = 0;
+    int lastBlockCount = 0;
+    size_t frameBytes = 0;
 };
 
 #include "qrcode_stream_sender.moc"
 
+// 对比各种封装的载荷密度：每个块需要的版本、每个模块承载的wirehair数据位数、码里剩余的填充位数和单个码的编码耗时。
+// 块头和CRC按带完整尺寸的块计算，分片数和分片大小取上限，可能比流水线预留的多一两个字节。
+// 指定了目标版本时，每种封装的块大小取该版本能装下的最大值
+static void printDensityReport(const QRFramePipeline::Config &config, uint64_t fileBytes)
+{
+    struct Scheme
+    {
+        const char *name;
+        qrstream::Framing framing;
+    };
+    constexpr std::array<Scheme, 4> schemes = { {
+        { "base64", qrstream::Framing::Base64 },
+        { "raw", qrstream::Framing::Raw },
+        { "alnum", qrstream::Framing::Alphanumeric },
+        { "numeric", qrstream::Framing::Numeric },
+    } };
+    constexpr int kCodes = 200;
+
+    constexpr const char *kEccNames[] = { "L", "M", "Q", "H" };
+
+    std::vector<uint8_t> block;
+    std::mt19937 rng(1);
+    qrcodegen::QrCode qr = qrcodegen::QrEncoderContext::makeOutput();
+    double base64BitsPerModule = 0;
+    auto blockOverhead = [&config, fileBytes](size_t packetLen) {
+        const uint64_t stride = static_cast<uint64_t>(config.chunkBlocks) * packetLen;
+        const auto chunks = static_cast<uint32_t>((fileBytes + stride - 1) / stride);
+        const auto largest = static_cast<uint32_t>(std::min(fileBytes, stride + packetLen));
+        return qrstream::maxBlockOverhead(fileBytes, chunks, largest, static_cast<uint32_t>(packetLen));
+    };
+
+    if (config.qrVersion != 0)
+        std::println("Target version {}, ECC {}", config.qrVersion, kEccNames[static_cast<int>(config.ecc)]);
+    else
+        std::println("Packet: {} bytes, ECC {}", config.packetSize, kEccNames[static_cast<int>(config.ecc)]);
+    std::println("{:<8} {:>7} {:>6} {:>7} {:>8} {:>6} {:>13} {:>12} {:>9}", "framing", "version", "side", "packet",
+            "payload", "spare", "bits/module", "vs base64", "us/code");
+    for (const Scheme &scheme : schemes)
+    {
+        size_t packetLen = static_cast<size_t>(config.packetSize);
+        size_t blockLen = packetLen + blockOverhead(packetLen);
+        int version = config.qrVersion;
+        if (version != 0)
+        {
+            blockLen = QRPayloadEncoder::maxBlockBytes(scheme.framing, version, config.ecc);
+            packetLen = blockLen - blockOverhead(blockLen);
+        }
+        else
+        {
+            version = QRPayloadEncoder::minVersion(scheme.framing, blockLen, config.ecc);
+        }
+        const int side = version * 4 + 17;
+        const int spareBits = qrcodegen::QrCode::getNumDataCodewords(version, config.ecc) * 8 -
+                QRPayloadEncoder::payloadBits(scheme.framing, blockLen, version);
+        block.resize(blockLen);
+        QRPayloadEncoder encoder(scheme.framing, config.ecc);
+        size_t payloadLen = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kCodes; i++)
+        {
+            for (uint8_t &byte : block)
+                byte = static_cast<uint8_t>(rng());
+            payloadLen = encoder.encode(block.data(), blockLen, version, qr);
+        }
+        const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+        const double bitsPerModule = static_cast<double>(packetLen * 8) / (side * side);
+        if (scheme.framing == qrstream::Framing::Base64)
+            base64BitsPerModule = bitsPerModule;
+        std::println("{:<8} {:>7} {:>6} {:>7} {:>8} {:>6} {:>13.3f} {:>11.1f}% {:>9.0f}", scheme.name, version, side,
+                packetLen, payloadLen, spareBits, bitsPerModule, bitsPerModule / base64BitsPerModule * 100,
+                elapsed.count() / kCodes);
+    }
+}
+
+// 掩码和惩罚分数的自检：每个版本、每个纠错等级各取kGrids个未加掩码的网格（编码的和随机的各一半），
+// 用按字处理的代码和逐模块的参考实现分别试8种掩码，输出两者每个网格的耗时。
+// 有一处加掩码的结果、分数或者选中的掩码不一致时返回false
+static bool printMaskBenchmark()
+{
+    constexpr int kGrids = 8;
+    constexpr std::array<qrcodegen::QrCode::Ecc, 4> kEccs = { qrcodegen::QrCode::Ecc::LOW,
+            qrcodegen::QrCode::Ecc::MEDIUM, qrcodegen::QrCode::Ecc::QUARTILE, qrcodegen::QrCode::Ecc::HIGH };
+
+    std::println("{} grids per version and ECC level, 8 masks each", kGrids);
+    std::println("{:>7} {:>6} {:>12} {:>15} {:>8} {:>11}", "version", "side", "us/grid", "reference us", "speedup",
+            "mismatches");
+    int totalMismatches = 0;
+    std::chrono::nanoseconds totalTime{ 0 }, totalReferenceTime{ 0 };
+    for (int version = qrcodegen::QrCode::MIN_VERSION; version <= qrcodegen::QrCode::MAX_VERSION; version++)
+    {
+        int mismatches = 0;
+        std::chrono::nanoseconds time{ 0 }, referenceTime{ 0 };
+        for (const qrcodegen::QrCode::Ecc ecc : kEccs)
+        {
+            const qrcodegen::QrCode::MaskScoringCheck check = qrcodegen::QrCode::checkMaskScoring(version, ecc,
+                    kGrids);
+            mismatches += check.mismatches;
+            time += check.time;
+            referenceTime += check.referenceTime;
+        }
+        totalMismatches += mismatches;
+        totalTime += time;
+        totalReferenceTime += referenceTime;
+        const double grids = static_cast<double>(kGrids * kEccs.size());
+        const double micros = std::chrono::duration<double, std::micro>(time).count() / grids;
+        const double referenceMicros = std::chrono::duration<double, std::micro>(referenceTime).count() / grids;
+        std::println("{:>7} {:>6} {:>12.1f} {:>15.1f} {:>7.1f}x {:>11}", version, version * 4 + 17, micros,
+                referenceMicros, referenceMicros / micros, mismatches);
+    }
+    std::println("Total: {:.0f} ms, reference {:.0f} ms, {} mismatches",
+            std::chrono::duration<double, std::milli>(totalTime).count(),
+            std::chrono::duration<double, std::milli>(totalReferenceTime).count(), totalMismatches);
+    return totalMismatches == 0;
+}
+
+// 估算压缩前后的端到端传输时间：压缩耗时 + 显示第一轮全部块（原始块数的overheadTarget倍）的时间 + 解压耗时。
+// 显示时间按每帧平铺的码数和每帧停留的刷新次数、60Hz刷新率计算，是接收端一块不漏时的下限；
+// 块大小和密度报告一样按带完整尺寸的块头预留
+static void printCompressionReport(const SenderOptions &options, const uint8_t *data, size_t len)
+{
+    constexpr double kRefreshRate = 60;
+    const QRFramePipeline::Config &config = options.pipeline;
+    size_t packetLen = static_cast<size_t>(config.packetSize);
+    if (config.qrVersion != 0)
+    {
+        const size_t blockLen = QRPayloadEncoder::maxBlockBytes(config.framing, config.qrVersion, config.ecc);
+        const size_t overhead = qrstream::kMaxBlockHeaderBytes + qrstream::kBlockCrcBytes;
+        packetLen = blockLen > overhead ? blockLen - overhead : 1;
+    }
+    const auto codesPerFrame = static_cast<size_t>(config.tileColumns * config.tileRows);
+    auto sendSeconds = [&](size_t bytes) {
+        const double blocks = std::ceil(static_cast<double>((bytes + packetLen - 1) / packetLen) *
+                config.overheadTarget);
+        const double frames = std::ceil(blocks / static_cast<double>(codesPerFrame));
+        return frames * options.refreshesPerFrame / kRefreshRate;
+    };
+
+    std::vector<uint8_t> compressed;
+    const auto start = std::chrono::steady_clock::now();
+    qrstream::compressStream(data, len, compressed);
+    const auto compressEnd = std::chrono::steady_clock::now();
+    // 按分片大小分段喂入，和接收端逐个分片解压一样
+    qrstream::StreamDecompressor decompressor;
+    std::vector<uint8_t> restored;
+    const size_t piece = static_cast<size_t>(config.chunkBlocks) * packetLen;
+    for (size_t pos = 0; pos < compressed.size(); pos += piece)
+    {
+        if (!decompressor.feed(compressed.data() + pos, std::min(piece, compressed.size() - pos), restored))
+            break;
+    }
+    const auto decompressEnd = std::chrono::steady_clock::now();
+    if (restored.size() != len || !std::equal(restored.begin(), restored.end(), data))
+        throw std::runtime_error("Compression round trip failed");
+
+    const std::chrono::duration<double, std::milli> compressMs = compressEnd - start;
+    const std::chrono::duration<double, std::milli> decompressMs = decompressEnd - compressEnd;
+    const double ratio = static_cast<double>(len) / static_cast<double>(compressed.size());
+    std::println("Packet: {} bytes, {} codes per frame, {} refreshes per frame at {:.0f} Hz", packetLen,
+            codesPerFrame, options.refreshesPerFrame, kRefreshRate);
+    std::println("{:<6} {:>12} {:>7} {:>12} {:>10} {:>12} {:>10}", "mode", "sent bytes", "ratio", "compress ms",
+            "send s", "decompress ms", "total s");
+    std::println("{:<6} {:>12} {:>7.2f} {:>12.1f} {:>10.1f} {:>12.1f} {:>10.1f}", "none", len, 1.0, 0.0,
+            sendSeconds(len), 0.0, sendSeconds(len));
+    std::println("{:<6} {:>12} {:>7.2f} {:>12.1f} {:>10.1f} {:>12.1f} {:>10.1f}", "lz4", compressed.size(), ratio,
+            compressMs.count(), sendSeconds(compressed.size()), decompressMs.count(),
+            (compressMs.count() + decompressMs.count()) / 1000 + sendSeconds(compressed.size()));
+}
+
+// 不显示窗口，把流水线渲染的每一帧按每个模块scale×scale像素存成PGM图片（frame_000000.pgm起），
+// 供接收端--images离线测试。按发送计划的第一轮录制，计划结束后返回
+static void recordFrames(const QRFramePipeline::Config &config, const uint8_t *data, size_t size,
+        const std::filesystem::path &directory, int scale)
+{
+    std::filesystem::create_directories(directory);
+    QRFramePipeline pipeline(data, size, config);
+    pipeline.start();
+    vector<uint8_t> line;
+    uint64_t frames = 0;
+    int width = 0, height = 0;
+    while (!pipeline.finished())
+    {
+        if (pipeline.failed())
+            throw std::runtime_error(pipeline.errorMessage());
+        QRFramePipeline::Frame *frame = pipeline.tryAcquire();
+        if (frame == nullptr)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        const QRModuleImage &image = frame->image;
+        width = image.width * scale;
+        height = image.height * scale;
+        const std::filesystem::path path = directory / std::format("frame_{:06}.pgm", frames++);
+        std::ofstream out(path, std::ios::binary);
+        out << "P5\n" << width << ' ' << height << "\n255\n";
+        line.resize(static_cast<size_t>(width));
+        for (int y = 0; y < image.height; y++)
+        {
+            const uint8_t *modules = image.pixels.data() + static_cast<size_t>(y) * static_cast<size_t>(image.width);
+            for (int x = 0; x < width; x++)
+                line[static_cast<size_t>(x)] = modules[x / scale];
+            for (int i = 0; i < scale; i++)
+                out.write(reinterpret_cast<const char *>(line.data()), static_cast<std::streamsize>(line.size()));
+        }
+        pipeline.release(frame);
+        if (!out)
+            throw std::runtime_error("Cannot write " + path.string());
+    }
+    pipeline.stop();
+    std::println("Recorded {} frames of {}x{} pixels to {}", frames, width, height, directory.string());
+}
+
 extern std::string send_message;
 
+// 测试数据的字节数
+constexpr uint32_t kMessageBytes = 1024 * 50;
+
 int main(int argc, char *argv[]) try
 {
     const WirehairResult initResult = wirehair_init();
@@ -181,11 +430,258 @@ int main(int argc, char *argv[]) try
     //     cout << "!!! Example usage failed" << endl;
     //     return -2;
     // }
+
+    // 显示方式的选项要在创建QApplication之前生效，所以先直接解析argv
+    QCommandLineParser parser;
+    QCommandLineOption displayOption("display", "Frame display mode: gl (texture upload, default) or raster.",
+            "mode", "gl");
+    QCommandLineOption softwareGLOption("software-gl",
+            "Render with the software OpenGL rasterizer (Mesa llvmpipe), for machines without a GPU.");
+    QCommandLineOption refreshesOption("refreshes-per-frame",
+            "Number of display refreshes each QR code stays on screen (default 3).", "n", "3");
+    QCommandLineOption threadsOption("encode-threads", "Number of background encoding threads (default 2).",
+            "n", "2");
+    QCommandLineOption queueOption("queue-depth", "Number of frames rendered ahead of display (default 8).",
+            "n", "8");
+    QCommandLineOption tilesOption("tiles", "QR codes per frame as COLUMNSxROWS, each carrying its own block "
+            "(default 1x1).", "grid", "1x1");
+    QCommandLineOption framingOption("framing", "How blocks are carried in each QR code: raw (default, byte mode), "
+            "or base64, alnum (base45) or numeric for scanners that only return text.", "mode", "raw");
+    QCommandLineOption packetSizeOption("packet-size", "Wirehair block size in bytes; the QR version is the "
+            "smallest that fits (default 600).", "bytes", "600");
+    QCommandLineOption qrVersionOption("qr-version", "Target QR version (1-40); the block size becomes the largest "
+            "that fits, overriding --packet-size (default 0, off).", "n", "0");
+    QCommandLineOption eccOption("ecc", "Error correction level: L (default), M, Q or H.", "level", "L");
+    QCommandLineOption fileOption("file", "File to send; it is mapped into memory rather than read, so it can be "
+            "larger than RAM (default: built-in test text).", "path");
+    QCommandLineOption chunkBlocksOption("chunk-blocks", "Wirehair blocks per chunk; larger files are sent as "
+            "several chunks, each decoded on its own (2-63999, default 16000).", "n", "16000");
+    QCommandLineOption activeChunksOption("active-chunks", "Number of chunks sent interleaved at a time; a "
+            "chunk gives its place to the next one once it has sent its blocks for the pass (default 4).", "n", "4");
+    QCommandLineOption overheadOption("overhead", "Blocks sent per chunk in the first pass, as a multiple of its "
+            "source blocks: source blocks first, then repair blocks (default 1.05).", "ratio", "1.05");
+    QCommandLineOption loopOption("loop", "Keep sending repair blocks after the first pass instead of stopping.");
+    QCommandLineOption feedbackOption("feedback-port", "UDP port on which receivers report finished chunks; "
+            "confirmed chunks are no longer sent, and sending continues until all are confirmed (default 0, "
+            "off).", "port", "0");
+    QCommandLineOption compressOption("compress", "Compress the data before fountain encoding: none (default) or "
+            "lz4. Text, logs and JSON usually shrink several times, and so does the number of frames.", "mode",
+            "none");
+    QCommandLineOption compressionReportOption("compression-report",
+            "Compress and decompress the data, print the estimated transfer time with and without compression, "
+            "then exit.");
+    QCommandLineOption recordOption("record", "Render the first pass to PGM images in a directory instead of "
+            "showing a window, at --module-pixels per module (4 when 0), for offline receiver tests.", "dir");
+    QCommandLineOption densityReportOption("density-report",
+            "Print the QR version, bits per module and encode time of each framing, then exit.");
+    QCommandLineOption maskBenchmarkOption("mask-benchmark", "Mask and score encoded and random grids of every "
+            "version and ECC level with the word-at-a-time code and the per-module reference, print the timings, "
+            "then exit; fails if any score or chosen mask differs.");
+    QCommandLineOption modulePixelsOption("module-pixels",
+            "Screen pixels per module; 0 scales the frame to fill the window (default 0).", "n", "0");
+    QCommandLineOption quietZoneOption("quiet-zone", "Quiet zone around each QR code, in modules (default 10).",
+            "n", "10");
+    parser.addOption(displayOption);
+    parser.addOption(softwareGLOption);
+    parser.addOption(refreshesOption);
+    parser.addOption(threadsOption);
+    parser.addOption(queueOption);
+    parser.addOption(tilesOption);
+    parser.addOption(framingOption);
+    parser.addOption(modulePixelsOption);
+    parser.addOption(quietZoneOption);
+    parser.addOption(packetSizeOption);
+    parser.addOption(qrVersionOption);
+    parser.addOption(eccOption);
+    parser.addOption(fileOption);
+    parser.addOption(overheadOption);
+    parser.addOption(loopOption);
+    parser.addOption(feedbackOption);
+    parser.addOption(chunkBlocksOption);
+    parser.addOption(activeChunksOption);
+    parser.addOption(compressOption);
+    parser.addOption(compressionReportOption);
+    parser.addOption(recordOption);
+    parser.addOption(densityReportOption);
+    parser.addOption(maskBenchmarkOption);
+    QStringList arguments;
+    for (int i = 0; i < argc; i++)
+        arguments << QString::fromLocal8Bit(argv[i]);
+    if (!parser.parse(arguments))
+    {
+        std::println(stderr, "{}", parser.errorText().toStdString());
+        return -1;
+    }
+    const QString displayMode = parser.value(displayOption);
+    if (displayMode != "gl" && displayMode != "raster")
+    {
+        std::println(stderr, "Unknown display mode: {}", displayMode.toStdString());
+        return -1;
+    }
+    SenderOptions options;
+    options.useGL = displayMode == "gl";
+    // 解析不小于minimum的整数选项，非法时打印错误并返回false
+    auto parseInt = [&parser](const QCommandLineOption &option, int minimum, int &value) {
+        bool valid = false;
+        value = parser.value(option).toInt(&valid);
+        if (valid && value >= minimum)
+            return true;
+        std::println(stderr, "Invalid value for --{}: {}", option.names().first().toStdString(),
+                parser.value(option).toStdString());
+        return false;
+    };
+    if (!parseInt(refreshesOption, 1, options.refreshesPerFrame) ||
+            !parseInt(threadsOption, 1, options.pipeline.workerCount) ||
+            !parseInt(queueOption, 1, options.pipeline.queueDepth) ||
+            !parseInt(modulePixelsOption, 0, options.modulePixels) ||
+            !parseInt(quietZoneOption, 0, options.pipeline.quietZone) ||
+            !parseInt(packetSizeOption, 1, options.pipeline.packetSize) ||
+            !parseInt(qrVersionOption, 0, options.pipeline.qrVersion) ||
+            !parseInt(chunkBlocksOption, 2, options.pipeline.chunkBlocks) ||
+            !parseInt(activeChunksOption, 1, options.pipeline.activeChunks))
+        return -1;
+    if (options.pipeline.chunkBlocks > 63999)
+    {
+        std::println(stderr, "Invalid value for --chunk-blocks: {}", options.pipeline.chunkBlocks);
+        return -1;
+    }
+    bool overheadValid = false;
+    options.pipeline.overheadTarget = parser.value(overheadOption).toDouble(&overheadValid);
+    if (!overheadValid || !(options.pipeline.overheadTarget >= 1.0))
+    {
+        std::println(stderr, "Invalid value for --overhead: {}", parser.value(overheadOption).toStdString());
+        return -1;
+    }
+    int feedbackPort = 0;
+    if (!parseInt(feedbackOption, 0, feedbackPort))
+        return -1;
+    if (feedbackPort > 65535)
+    {
+        std::println(stderr, "Invalid value for --feedback-port: {}", feedbackPort);
+        return -1;
+    }
+    options.feedbackPort = static_cast<quint16>(feedbackPort);
+    // 有反馈时一直发送到接收端确认所有分片
+    options.pipeline.loop = parser.isSet(loopOption) || options.feedbackPort != 0;
+    if (options.pipeline.qrVersion > qrcodegen::QrCode::MAX_VERSION)
+    {
+        std::println(stderr, "Invalid value for --qr-version: {}", options.pipeline.qrVersion);
+        return -1;
+    }
+    const QString ecc = parser.value(eccOption).toUpper();
+    if (ecc == "L")
+        options.pipeline.ecc = qrcodegen::QrCode::Ecc::LOW;
+    else if (ecc == "M")
+        options.pipeline.ecc = qrcodegen::QrCode::Ecc::MEDIUM;
+    else if (ecc == "Q")
+        options.pipeline.ecc = qrcodegen::QrCode::Ecc::QUARTILE;
+    else if (ecc == "H")
+        options.pipeline.ecc = qrcodegen::QrCode::Ecc::HIGH;
+    else
+    {
+        std::println(stderr, "Unknown error correction level: {}", ecc.toStdString());
+        return -1;
+    }
+    const QString framing = parser.value(framingOption);
+    if (framing == "raw")
+        options.pipeline.framing = qrstream::Framing::Raw;
+    else if (framing == "base64")
+        options.pipeline.framing = qrstream::Framing::Base64;
+    else if (framing == "alnum")
+        options.pipeline.framing = qrstream::Framing::Alphanumeric;
+    else if (framing == "numeric")
+        options.pipeline.framing = qrstream::Framing::Numeric;
+    else
+    {
+        std::println(stderr, "Unknown framing: {}", framing.toStdString());
+        return -1;
+    }
+    const QStringList tiles = parser.value(tilesOption).split('x');
+    bool columnsValid = false, rowsValid = false;
+    if (tiles.size() == 2)
+    {
+        options.pipeline.tileColumns = tiles[0].toInt(&columnsValid);
+        options.pipeline.tileRows = tiles[1].toInt(&rowsValid);
+    }
+    if (!columnsValid || !rowsValid || options.pipeline.tileColumns < 1 || options.pipeline.tileRows < 1)
+    {
+        std::println(stderr, "Invalid value for --tiles: {}", parser.value(tilesOption).toStdString());
+        return -1;
+    }
+    const QString compress = parser.value(compressOption);
+    if (compress == "none")
+        options.pipeline.compression = qrstream::Compression::None;
+    else if (compress == "lz4")
+        options.pipeline.compression = qrstream::Compression::Lz4;
+    else
+    {
+        std::println(stderr, "Unknown compression: {}", compress.toStdString());
+        return -1;
+    }
+    if (parser.isSet(maskBenchmarkOption))
+        return printMaskBenchmark() ? 0 : 1;
+    // 要发送的数据：映射的文件，或者重复拼接的测试文本，压缩时换成压缩流。它们都要活过窗口
+    std::unique_ptr<MappedFile> file;
+    vector<uint8_t> message;
+    if (parser.isSet(fileOption))
+    {
+        file = std::make_unique<MappedFile>(parser.value(fileOption).toStdWString());
+    }
+    else
+    {
+        while (send_message.size() < kMessageBytes)
+            send_message += send_message;
+        message.assign(send_message.begin(), send_message.end());
+        message.resize(kMessageBytes);
+    }
+    const uint8_t *data = file ? file->data() : message.data();
+    size_t dataBytes = file ? file->size() : message.size();
+
+    if (parser.isSet(compressionReportOption))
+    {
+        printCompressionReport(options, data, dataBytes);
+        return 0;
+    }
+    vector<uint8_t> compressed;
+    if (options.pipeline.compression == qrstream::Compression::Lz4)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        qrstream::compressStream(data, dataBytes, compressed);
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::println("Compressed {} bytes to {} bytes ({:.2f}x) in {:.0f} ms", dataBytes, compressed.size(),
+                static_cast<double>(dataBytes) / static_cast<double>(compressed.size()), elapsed.count());
+        data = compressed.data();
+        dataBytes = compressed.size();
+    }
+
+    if (parser.isSet(densityReportOption))
+    {
+        printDensityReport(options.pipeline, dataBytes);
+        return 0;
+    }
+    if (parser.isSet(recordOption))
+    {
+        if (options.pipeline.loop)
+        {
+            std::println(stderr, "--record cannot be combined with --loop or --feedback-port");
+            return -1;
+        }
+        recordFrames(options.pipeline, data, dataBytes, parser.value(recordOption).toStdWString(),
+                options.modulePixels > 0 ? options.modulePixels : 4);
+        return 0;
+    }
+    if (parser.isSet(softwareGLOption))
+    {
+        QCoreApplication::setAttribute(Qt::AA_UseSoftwareOpenGL);  // Windows：opengl32sw.dll
+        qputenv("LIBGL_ALWAYS_SOFTWARE", "1");                     // Linux：Mesa llvmpipe
+    }
+
+    // 缓冲交换跟随垂直同步
+    QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+    format.setSwapInterval(1);
+    QSurfaceFormat::setDefaultFormat(format);
+
     QApplication app(argc, argv);
-    
-    // 准备测试数据
-    constexpr int kPacketSize = 600;
-    constexpr int kMessageBytes = 1024 * 50;
 
 //     std::string send_message = R"(
 // Triton 旨在通过提供一种可以编译为高效的 CUDA 本地代码的高级抽象，使编写高性能 GPU 代码变得更加容易。在这篇文章中，我将深入探讨 Triton 的内部机制，并探索 Triton 程序如何在幕后编译为 CUDA 内核（具体来说是 CUBIN）Cuda Compilation在深入了解 triton 之前，了解使用 nvcc 的 cuda 编译过程是有用的。以下来自 NVIDIA 文档的图表展示了整个 cuda 编译为可执行代码的过程。
@@ -198,20 +694,16 @@ int main(int argc, char *argv[]) try
 // )";
 
 
-    while (send_message.size() < kMessageBytes)
-    {
-        send_message += send_message;
-    }
-
-    vector<uint8_t> message(send_message.begin(), send_message.end());
-    message.resize(kMessageBytes);
-    
     // 创建并显示窗口
-    QRCodeWindow window;
-    window.show();
+    QRCodeWindow window(options);
+    // 平铺多个码时铺满屏幕，充分利用显示器的像素
+    if (options.pipeline.tileColumns * options.pipeline.tileRows > 1)
+        window.showMaximized();
+    else
+        window.show();
     
     // 开始显示二维码
-    window.startDisplay(message, kPacketSize);
+    window.startDisplay(data, dataBytes);
     
     return app.exec();
 }
@@ -22,23 +22,354 @@
  */
 
 #include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cassert>
 #include <climits>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <sstream>
+#include <thread>
 #include <utility>
 #include "qrcodegen.hpp"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QRCODEGEN_RS_SSE2
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define QRCODEGEN_RS_NEON
+#endif
+
 using std::int8_t;
 using std::uint8_t;
+using std::uint64_t;
 using std::size_t;
 using std::vector;
 
 
 namespace qrcodegen {
 
+namespace {
+
+constexpr int8_t ECC_CODEWORDS_PER_BLOCK[4][41] = {
+	// Version: (note that index 0 is for padding, and is set to an illegal value)
+	//0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40    Error correction level
+	{-1,  7, 10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28, 30, 28, 28, 28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},  // Low
+	{-1, 10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28, 26, 26, 26, 26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28},  // Medium
+	{-1, 13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28, 28, 26, 30, 28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},  // Quartile
+	{-1, 17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28, 28, 26, 28, 30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},  // High
+};
+
+constexpr int8_t NUM_ERROR_CORRECTION_BLOCKS[4][41] = {
+	// Version: (note that index 0 is for padding, and is set to an illegal value)
+	//0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40    Error correction level
+	{-1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 4,  4,  4,  4,  4,  6,  6,  6,  6,  7,  8,  8,  9,  9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25},  // Low
+	{-1, 1, 1, 1, 2, 2, 4, 4, 4, 5, 5,  5,  8,  9,  9, 10, 10, 11, 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49},  // Medium
+	{-1, 1, 1, 2, 2, 4, 4, 6, 6, 8, 8,  8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},  // Quartile
+	{-1, 1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},  // High
+};
+
+
+// Per-version geometry and capacity, generated at compile time from the two tables above.
+struct VersionTables {
+	int rawDataModules[41];  // See QrCode::getNumRawDataModules()
+	int dataCodewords[4][41];  // See QrCode::getNumDataCodewords()
+	int numAlign[41];  // Number of alignment pattern positions per axis
+	int alignPositions[41][7];  // Ascending alignment pattern positions
+};
+
+constexpr VersionTables makeVersionTables() {
+	VersionTables t = {};
+	for (int ver = 1; ver <= 40; ver++) {
+		int raw = (16 * ver + 128) * ver + 64;
+		if (ver >= 2) {
+			int numAlign = ver / 7 + 2;
+			raw -= (25 * numAlign - 10) * numAlign - 55;
+			if (ver >= 7)
+				raw -= 36;
+		}
+		t.rawDataModules[ver] = raw;
+		for (int e = 0; e < 4; e++)
+			t.dataCodewords[e][ver] = raw / 8 - ECC_CODEWORDS_PER_BLOCK[e][ver] * NUM_ERROR_CORRECTION_BLOCKS[e][ver];
+		
+		if (ver >= 2) {
+			int numAlign = ver / 7 + 2;
+			int step = (ver * 8 + numAlign * 3 + 5) / (numAlign * 4 - 4) * 2;
+			for (int i = numAlign - 1, pos = ver * 4 + 17 - 7; i >= 1; i--, pos -= step)
+				t.alignPositions[ver][i] = pos;
+			t.alignPositions[ver][0] = 6;
+			t.numAlign[ver] = numAlign;
+		}
+	}
+	return t;
+}
+
+constexpr VersionTables VERSION_TABLES = makeVersionTables();
+static_assert(VERSION_TABLES.rawDataModules[1] == 208 && VERSION_TABLES.rawDataModules[40] == 29648);
+static_assert(VERSION_TABLES.dataCodewords[0][40] == 2956 && VERSION_TABLES.dataCodewords[3][1] == 9);
+
+
+// Exponent and logarithm tables for GF(2^8/0x11D) with generator 0x02. The exponent
+// table is doubled so that exp[log[x] + log[y]] needs no reduction modulo 255.
+struct GaloisTables {
+	uint8_t exp[512];
+	uint8_t log[256];
+};
+
+constexpr GaloisTables makeGaloisTables() {
+	GaloisTables t = {};
+	int x = 1;
+	for (int i = 0; i < 255; i++) {
+		t.exp[i] = static_cast<uint8_t>(x);
+		t.exp[i + 255] = static_cast<uint8_t>(x);
+		t.log[x] = static_cast<uint8_t>(i);
+		x = (x << 1) ^ ((x >> 7) * 0x11D);
+	}
+	t.exp[510] = t.exp[0];
+	t.exp[511] = t.exp[1];
+	return t;
+}
+
+constexpr GaloisTables GF = makeGaloisTables();
+
+
+// For a generator polynomial of some degree, row f holds the divisor coefficients multiplied
+// by f, zero padded to 32 bytes. One shift register step then becomes a single 32-byte XOR.
+struct DivisorMultiples {
+	alignas(16) uint8_t rows[256][32];
+};
+
+
+/* 
+ * A small fixed set of threads that runs the iterations of one loop at a time. The calling
+ * thread takes part in the loop too. If another thread is already using the pool, run()
+ * executes the whole loop on the calling thread instead of waiting.
+ */
+class WorkerPool final {
+	
+	public: static WorkerPool &instance() {
+		static WorkerPool pool(std::min(std::max(static_cast<int>(std::thread::hardware_concurrency()), 1), 8) - 1);
+		return pool;
+	}
+	
+	
+	public: explicit WorkerPool(int numThreads) {
+		for (int i = 0; i < numThreads; i++)
+			threads.emplace_back([this]() { workerLoop(); });
+	}
+	
+	
+	public: ~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread &t : threads)
+			t.join();
+	}
+	
+	
+	// Calls task(i) once for every i in [0, count), and returns after all calls have finished.
+	// The task is passed by reference without type erasure, so no memory is allocated. If any
+	// call throws, the first exception is rethrown here on the calling thread, after all calls finish.
+	public: template<typename F>
+	void run(int count, F &task) {
+		std::unique_lock<std::mutex> busy(runMutex, std::try_to_lock);
+		if (!busy.owns_lock() || threads.empty()) {
+			for (int i = 0; i < count; i++)
+				task(i);
+			return;
+		}
+		Job job = {[](void *arg, int i) { (*static_cast<F*>(arg))(i); }, &task};
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			current = &job;
+			jobCount = count;
+			nextIndex = 0;
+			pending = count;
+			generation++;
+		}
+		wake.notify_all();
+		work(job, count);
+		// Wait until no worker can still touch this job, so the next one starts from a clean slate
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return pending == 0 && active == 0; });
+		current = nullptr;
+		std::exception_ptr thrown = std::exchange(error, nullptr);
+		if (thrown)
+			std::rethrow_exception(thrown);
+	}
+	
+	
+	private: struct Job {
+		void (*call)(void *arg, int i);
+		void *arg;
+	};
+	
+	
+	private: void workerLoop() {
+		unsigned long seen = 0;
+		while (true) {
+			const Job *job;
+			int count;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return stopping || (generation != seen && current != nullptr); });
+				if (stopping)
+					return;
+				seen = generation;
+				job = current;
+				count = jobCount;
+				active++;
+			}
+			work(*job, count);
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--active == 0)
+				done.notify_all();
+		}
+	}
+	
+	
+	// Claims and runs iterations until none are left. An exception from an iteration is kept for
+	// run() rather than escaping a worker thread, and the remaining iterations still run.
+	private: void work(const Job &job, int count) {
+		for (int i; (i = nextIndex.fetch_add(1)) < count; ) {
+			std::exception_ptr thrown;
+			try {
+				job.call(job.arg, i);
+			} catch (...) {
+				thrown = std::current_exception();
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			if (thrown && !error)
+				error = thrown;
+			if (--pending == 0)
+				done.notify_all();
+		}
+	}
+	
+	
+	private: std::vector<std::thread> threads;
+	private: std::mutex runMutex;  // Held by the thread whose loop is running
+	private: std::mutex mutex;  // Guards the fields below
+	private: std::condition_variable wake;
+	private: std::condition_variable done;
+	private: const Job *current = nullptr;
+	private: int jobCount = 0;
+	private: std::atomic<int> nextIndex{0};
+	private: int pending = 0;  // Iterations not yet finished
+	private: int active = 0;  // Workers that have picked up the current job
+	private: std::exception_ptr error;  // First exception thrown by an iteration of the current job
+	private: unsigned long generation = 0;
+	private: bool stopping = false;
+	
+};
+
+}
+
+
+
+/*---- Class BitMatrix ----*/
+
+BitMatrix::BitMatrix() :
+	size(0),
+	wordsPerRow(0) {}
+
+
+BitMatrix::BitMatrix(int sz) :
+		BitMatrix() {
+	reset(sz);
+}
+
+
+void BitMatrix::reset(int sz) {
+	if (sz < 0)
+		throw std::domain_error("Size out of range");
+	size = sz;
+	wordsPerRow = (sz + 63) / 64;
+	words.assign(static_cast<size_t>(wordsPerRow) * static_cast<size_t>(sz), 0);
+}
+
+
+int BitMatrix::getSize() const {
+	return size;
+}
+
+
+void BitMatrix::reserve(int sz) {
+	if (sz < 0)
+		throw std::domain_error("Size out of range");
+	words.reserve(static_cast<size_t>((sz + 63) / 64) * static_cast<size_t>(sz));
+}
+
+
+int BitMatrix::getWordsPerRow() const {
+	return wordsPerRow;
+}
+
+
+bool BitMatrix::get(int x, int y) const {
+	assert(0 <= x && x < size && 0 <= y && y < size);
+	return ((getRow(y)[x >> 6] >> (x & 63)) & 1) != 0;
+}
+
+
+void BitMatrix::set(int x, int y, bool val) {
+	assert(0 <= x && x < size && 0 <= y && y < size);
+	uint64_t &word = getRow(y)[x >> 6];
+	uint64_t bit = uint64_t(1) << (x & 63);
+	if (val)
+		word |= bit;
+	else
+		word &= ~bit;
+}
+
+
+const uint64_t *BitMatrix::getRow(int y) const {
+	return &words[static_cast<size_t>(y) * static_cast<size_t>(wordsPerRow)];
+}
+
+
+uint64_t *BitMatrix::getRow(int y) {
+	return &words[static_cast<size_t>(y) * static_cast<size_t>(wordsPerRow)];
+}
+
+
+void BitMatrix::transposeTo(BitMatrix &out) const {
+	out.reset(size);
+	for (int by = 0; by < wordsPerRow; by++) {
+		for (int bx = 0; bx < wordsPerRow; bx++) {
+			// Gather the 64*64 block whose rows start at 64*by and whose columns start at 64*bx
+			uint64_t block[64] = {};
+			for (int i = 0; i < 64 && by * 64 + i < size; i++)
+				block[i] = getRow(by * 64 + i)[bx];
+			
+			// Transpose it in place by swapping ever smaller off-diagonal sub-blocks
+			uint64_t m = 0x00000000FFFFFFFFULL;
+			for (int j = 32; j != 0; j >>= 1, m ^= m << j) {
+				for (int k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+					uint64_t t = ((block[k] >> j) ^ block[k | j]) & m;
+					block[k] ^= t << j;
+					block[k | j] ^= t;
+				}
+			}
+			
+			for (int i = 0; i < 64 && bx * 64 + i < size; i++)
+				out.getRow(bx * 64 + i)[by] = block[i];
+		}
+	}
+}
+
+
+
 /*---- Class QrSegment ----*/
 
 QrSegment::Mode::Mode(int mode, int cc0, int cc1, int cc2) :
@@ -70,8 +401,7 @@ QrSegment QrSegment::makeBytes(const vector<uint8_t> &data) {
 	if (data.size() > static_cast<unsigned int>(INT_MAX))
 		throw std::length_error("Data too long");
 	BitBuffer bb;
-	for (uint8_t b : data)
-		bb.appendBits(b, 8);
+	bb.appendBytes(data.data(), data.size());
 	return QrSegment(Mode::BYTE, static_cast<int>(data.size()), std::move(bb));
 }
 
@@ -160,14 +490,20 @@ QrSegment QrSegment::makeEci(long assignVal) {
 
 QrSegment::QrSegment(const Mode &md, int numCh, const std::vector<bool> &dt) :
 		mode(&md),
-		numChars(numCh),
-		data(dt) {
+		numChars(numCh) {
 	if (numCh < 0)
 		throw std::domain_error("Invalid value");
+	data.reserve(dt.size());
+	for (bool b : dt)
+		data.appendBits(b ? 1 : 0, 1);
 }
 
 
 QrSegment::QrSegment(const Mode &md, int numCh, std::vector<bool> &&dt) :
+		QrSegment(md, numCh, static_cast<const std::vector<bool> &>(dt)) {}
+
+
+QrSegment::QrSegment(const Mode &md, int numCh, BitBuffer &&dt) :
 		mode(&md),
 		numChars(numCh),
 		data(std::move(dt)) {
@@ -222,7 +558,7 @@ int QrSegment::getNumChars() const {
 }
 
 
-const std::vector<bool> &QrSegment::getData() const {
+const BitBuffer &QrSegment::getData() const {
 	return data;
 }
 
@@ -257,47 +593,32 @@ QrCode QrCode::encodeBinary(const vector<uint8_t> &data, Ecc ecl) {
 
 
 QrCode QrCode::encodeSegments(const vector<QrSegment> &segs, Ecc ecl,
-		int minVersion, int maxVersion, int mask, bool boostEcl) {
+		int minVersion, int maxVersion, int mask, bool boostEcl, bool parallelMask) {
 	if (!(MIN_VERSION <= minVersion && minVersion <= maxVersion && maxVersion <= MAX_VERSION) || mask < -1 || mask > 7)
 		throw std::invalid_argument("Invalid value");
 	
-	// Find the minimal version number to use
+	// Find the minimal version number to use. The bit count only depends on
+	// which of the three character count field widths the version uses
+	std::array<int,3> usedBits = {
+		QrSegment::getTotalBits(segs, 1),
+		QrSegment::getTotalBits(segs, 10),
+		QrSegment::getTotalBits(segs, 27),
+	};
 	int version, dataUsedBits;
-	for (version = minVersion; ; version++) {
-		int dataCapacityBits = getNumDataCodewords(version, ecl) * 8;  // Number of data bits available
-		dataUsedBits = QrSegment::getTotalBits(segs, version);
-		if (dataUsedBits != -1 && dataUsedBits <= dataCapacityBits)
-			break;  // This version number is found to be suitable
-		if (version >= maxVersion) {  // All versions in the range could not fit the given data
-			std::ostringstream sb;
-			if (dataUsedBits == -1)
-				sb << "Segment too long";
-			else {
-				sb << "Data length = " << dataUsedBits << " bits, ";
-				sb << "Max capacity = " << dataCapacityBits << " bits";
-			}
-			throw data_too_long(sb.str());
-		}
-	}
-	assert(dataUsedBits != -1);
-	
-	// Increase the error correction level while the data still fits in the current version number
-	for (Ecc newEcl : {Ecc::MEDIUM, Ecc::QUARTILE, Ecc::HIGH}) {  // From low to high
-		if (boostEcl && dataUsedBits <= getNumDataCodewords(version, newEcl) * 8)
-			ecl = newEcl;
-	}
+	selectVersion(usedBits, ecl, minVersion, maxVersion, boostEcl, version, dataUsedBits);
 	
 	// Concatenate all segments to create the data bit string
+	size_t dataCapacityBits = static_cast<size_t>(getNumDataCodewords(version, ecl)) * 8;
 	BitBuffer bb;
+	bb.reserve(dataCapacityBits);
 	for (const QrSegment &seg : segs) {
 		bb.appendBits(static_cast<uint32_t>(seg.getMode().getModeBits()), 4);
 		bb.appendBits(static_cast<uint32_t>(seg.getNumChars()), seg.getMode().numCharCountBits(version));
-		bb.insert(bb.end(), seg.getData().begin(), seg.getData().end());
+		bb.appendBuffer(seg.getData());
 	}
 	assert(bb.size() == static_cast<unsigned int>(dataUsedBits));
 	
 	// Add terminator and pad up to a byte if applicable
-	size_t dataCapacityBits = static_cast<size_t>(getNumDataCodewords(version, ecl)) * 8;
 	assert(bb.size() <= dataCapacityBits);
 	bb.appendBits(0, std::min(4, static_cast<int>(dataCapacityBits - bb.size())));
 	bb.appendBits(0, (8 - static_cast<int>(bb.size() % 8)) % 8);
@@ -307,41 +628,113 @@ QrCode QrCode::encodeSegments(const vector<QrSegment> &segs, Ecc ecl,
 	for (uint8_t padByte = 0xEC; bb.size() < dataCapacityBits; padByte ^= 0xEC ^ 0x11)
 		bb.appendBits(padByte, 8);
 	
-	// Pack bits into bytes in big endian
-	vector<uint8_t> dataCodewords(bb.size() / 8);
-	for (size_t i = 0; i < bb.size(); i++)
-		dataCodewords.at(i >> 3) |= (bb.at(i) ? 1 : 0) << (7 - (i & 7));
+	// The bits are already packed into bytes in big endian, so create the QR Code object
+	return QrCode(version, ecl, bb.getBytes(), mask, parallelMask);
+}
+
+
+void QrCode::selectVersion(const std::array<int,3> &usedBits, Ecc &ecl, int minVersion, int maxVersion,
+		bool boostEcl, int &version, int &dataUsedBits) {
+	// The capacity grows with the version, so binary search each character count width range in turn
+	static constexpr int RANGE_FIRST[3] = {1, 10, 27};
+	static constexpr int RANGE_LAST [3] = {9, 26, 40};
+	const int *capacity = VERSION_TABLES.dataCodewords[static_cast<int>(ecl)];
+	version = -1;
+	for (int r = 0; r < 3 && version == -1; r++) {
+		int lo = std::max(RANGE_FIRST[r], minVersion);
+		int hi = std::min(RANGE_LAST[r], maxVersion);
+		int bits = usedBits[static_cast<size_t>(r)];
+		if (lo > hi || bits == -1)
+			continue;
+		const int *found = std::lower_bound(capacity + lo, capacity + hi + 1, (bits + 7) / 8);
+		if (found != capacity + hi + 1) {
+			version = static_cast<int>(found - capacity);
+			dataUsedBits = bits;
+		}
+	}
+	if (version == -1) {  // All versions in the range could not fit the given data
+		dataUsedBits = usedBits[static_cast<size_t>((maxVersion + 7) / 17)];
+		std::ostringstream sb;
+		if (dataUsedBits == -1)
+			sb << "Segment too long";
+		else {
+			sb << "Data length = " << dataUsedBits << " bits, ";
+			sb << "Max capacity = " << capacity[maxVersion] * 8 << " bits";
+		}
+		throw data_too_long(sb.str());
+	}
+	assert(dataUsedBits <= capacity[version] * 8);
 	
-	// Create the QR Code object
-	return QrCode(version, ecl, dataCodewords, mask);
+	// Increase the error correction level while the data still fits in the current version number
+	for (Ecc newEcl : {Ecc::MEDIUM, Ecc::QUARTILE, Ecc::HIGH}) {  // From low to high
+		if (boostEcl && dataUsedBits <= getNumDataCodewords(version, newEcl) * 8)
+			ecl = newEcl;
+	}
 }
 
 
-QrCode::QrCode(int ver, Ecc ecl, const vector<uint8_t> &dataCodewords, int msk) :
+QrCode::QrCode(int ver, Ecc ecl, const vector<uint8_t> &dataCodewords, int msk, bool parallelMask) :
 		// Initialize fields and check arguments
 		version(ver),
 		errorCorrectionLevel(ecl) {
-	if (ver < MIN_VERSION || ver > MAX_VERSION)
+	build(dataCodewords.data(), dataCodewords.size(), msk, parallelMask, nullptr);
+}
+
+
+QrCode::QrCode() :
+		version(MIN_VERSION),
+		size(MIN_VERSION * 4 + 17),
+		errorCorrectionLevel(Ecc::LOW),
+		mask(0),
+		modules(MIN_VERSION * 4 + 17) {}
+
+
+void QrCode::build(const uint8_t *dataCodewords, size_t dataLen, int msk, bool parallelMask,
+		QrEncoderContext *ctx) {
+	if (version < MIN_VERSION || version > MAX_VERSION)
 		throw std::domain_error("Version value out of range");
 	if (msk < -1 || msk > 7)
 		throw std::domain_error("Mask value out of range");
-	size = ver * 4 + 17;
-	size_t sz = static_cast<size_t>(size);
-	modules    = vector<vector<bool> >(sz, vector<bool>(sz));  // Initially all light
-	isFunction = vector<vector<bool> >(sz, vector<bool>(sz));
+	size = version * 4 + 17;
+	vector<uint8_t> localCodewords;
+	BitMatrix localColumns;
+	vector<uint8_t> &allCodewords = ctx != nullptr ? ctx->allCodewords : localCodewords;
+	BitMatrix &columns = ctx != nullptr ? ctx->columns : localColumns;
 	
 	// Compute ECC, draw modules
-	drawFunctionPatterns();
-	const vector<uint8_t> allCodewords = addEccAndInterleave(dataCodewords);
-	drawCodewords(allCodewords);
+	modules = QrVersionTemplate::get(version).getFunctionPattern();  // Reuses the existing storage
+	allCodewords.resize(static_cast<size_t>(getNumRawDataModules(version) / 8));
+	addEccAndInterleave(dataCodewords, dataLen, allCodewords.data());
+	drawCodewords(allCodewords.data(), allCodewords.size());
 	
 	// Do masking
-	if (msk == -1) {  // Automatically choose best mask
+	if (msk == -1 && parallelMask && version >= PARALLEL_MASK_MIN_VERSION) {
+		// Score each candidate on its own copy of the unmasked grid
+		std::array<long,8> penalties;
+		auto scoreMask = [this, ctx, &penalties](int i) {
+			size_t k = static_cast<size_t>(i);
+			if (ctx != nullptr) {
+				QrCode &trial = ctx->trials[k];
+				trial = *this;  // Reuses the trial's storage
+				trial.applyMask(i);
+				trial.drawFormatBits(i);
+				penalties[k] = trial.getPenaltyScore(ctx->trialColumns[k]);
+			} else {
+				QrCode trial(*this);
+				BitMatrix trialColumns;
+				trial.applyMask(i);
+				trial.drawFormatBits(i);
+				penalties[k] = trial.getPenaltyScore(trialColumns);
+			}
+		};
+		WorkerPool::instance().run(8, scoreMask);
+		msk = static_cast<int>(std::min_element(penalties.cbegin(), penalties.cend()) - penalties.cbegin());
+	} else if (msk == -1) {  // Automatically choose best mask
 		long minPenalty = LONG_MAX;
 		for (int i = 0; i < 8; i++) {
 			applyMask(i);
 			drawFormatBits(i);
-			long penalty = getPenaltyScore();
+			long penalty = getPenaltyScore(columns);
 			if (penalty < minPenalty) {
 				msk = i;
 				minPenalty = penalty;
@@ -353,9 +746,6 @@ QrCode::QrCode(int ver, Ecc ecl, const vector<uint8_t> &dataCodewords, int msk)
 	mask = msk;
 	applyMask(msk);  // Apply the final choice of mask
 	drawFormatBits(msk);  // Overwrite old format bits
-	
-	isFunction.clear();
-	isFunction.shrink_to_fit();
 }
 
 
@@ -384,6 +774,13 @@ bool QrCode::getModule(int x, int y) const {
 }
 
 
+const uint64_t *QrCode::getRow(int y) const {
+	if (y < 0 || y >= size)
+		throw std::domain_error("Row out of range");
+	return modules.getRow(y);
+}
+
+
 void QrCode::drawFunctionPatterns() {
 	// Draw horizontal and vertical timing patterns
 	for (int i = 0; i < size; i++) {
@@ -397,13 +794,13 @@ void QrCode::drawFunctionPatterns() {
 	drawFinderPattern(3, size - 4);
 	
 	// Draw numerous alignment patterns
-	const vector<int> alignPatPos = getAlignmentPatternPositions();
-	size_t numAlign = alignPatPos.size();
+	std::array<int,7> alignPatPos;
+	size_t numAlign = static_cast<size_t>(getAlignmentPatternPositions(alignPatPos));
 	for (size_t i = 0; i < numAlign; i++) {
 		for (size_t j = 0; j < numAlign; j++) {
 			// Don't draw on the three finder corners
 			if (!((i == 0 && j == 0) || (i == 0 && j == numAlign - 1) || (i == numAlign - 1 && j == 0)))
-				drawAlignmentPattern(alignPatPos.at(i), alignPatPos.at(j));
+				drawAlignmentPattern(alignPatPos[i], alignPatPos[j]);
 		}
 	}
 	
@@ -483,89 +880,162 @@ void QrCode::drawAlignmentPattern(int x, int y) {
 
 
 void QrCode::setFunctionModule(int x, int y, bool isDark) {
-	size_t ux = static_cast<size_t>(x);
-	size_t uy = static_cast<size_t>(y);
-	modules   .at(uy).at(ux) = isDark;
-	isFunction.at(uy).at(ux) = true;
+	modules.set(x, y, isDark);
+	if (isFunction.getSize() != 0)
+		isFunction.set(x, y, true);
 }
 
 
 bool QrCode::module(int x, int y) const {
-	return modules.at(static_cast<size_t>(y)).at(static_cast<size_t>(x));
+	return modules.get(x, y);
 }
 
 
-vector<uint8_t> QrCode::addEccAndInterleave(const vector<uint8_t> &data) const {
-	if (data.size() != static_cast<unsigned int>(getNumDataCodewords(version, errorCorrectionLevel)))
+void QrCode::addEccAndInterleave(const uint8_t *data, size_t len, uint8_t *result) const {
+	if (len != static_cast<unsigned int>(getNumDataCodewords(version, errorCorrectionLevel)))
 		throw std::invalid_argument("Invalid argument");
 	
 	// Calculate parameter numbers
-	int numBlocks = NUM_ERROR_CORRECTION_BLOCKS[static_cast<int>(errorCorrectionLevel)][version];
-	int blockEccLen = ECC_CODEWORDS_PER_BLOCK  [static_cast<int>(errorCorrectionLevel)][version];
-	int rawCodewords = getNumRawDataModules(version) / 8;
-	int numShortBlocks = numBlocks - rawCodewords % numBlocks;
-	int shortBlockLen = rawCodewords / numBlocks;
-	
-	// Split data into blocks and append ECC to each block
-	vector<vector<uint8_t> > blocks;
-	const vector<uint8_t> rsDiv = reedSolomonComputeDivisor(blockEccLen);
+	const BlockLayout layout = getBlockLayout(version, errorCorrectionLevel);
+	int numBlocks = layout.numBlocks;
+	int blockEccLen = layout.blockEccLen;
+	int numShortBlocks = layout.numShortBlocks;
+	int shortDataLen = layout.shortBlockLen - blockEccLen;
+	
+	// Split data into blocks, compute the ECC of each block, and scatter both straight
+	// to their interleaved (not concatenated) positions. Column c of the data holds byte c
+	// of every block, except that short blocks have no byte at column shortDataLen.
+	uint8_t ecc[MAX_ECC_CODEWORDS_PER_BLOCK];
 	for (int i = 0, k = 0; i < numBlocks; i++) {
-		vector<uint8_t> dat(data.cbegin() + k, data.cbegin() + (k + shortBlockLen - blockEccLen + (i < numShortBlocks ? 0 : 1)));
-		k += static_cast<int>(dat.size());
-		const vector<uint8_t> ecc = reedSolomonComputeRemainder(dat, rsDiv);
-		if (i < numShortBlocks)
-			dat.push_back(0);
-		dat.insert(dat.end(), ecc.cbegin(), ecc.cend());
-		blocks.push_back(std::move(dat));
+		int datLen = shortDataLen + (i < numShortBlocks ? 0 : 1);
+		const uint8_t *dat = &data[static_cast<size_t>(k)];
+		k += datLen;
+		for (int j = 0; j < shortDataLen; j++)
+			result[static_cast<size_t>(j * numBlocks + i)] = dat[j];
+		if (i >= numShortBlocks)
+			result[static_cast<size_t>(shortDataLen * numBlocks + i - numShortBlocks)] = dat[shortDataLen];
+		reedSolomonComputeRemainder(dat, static_cast<size_t>(datLen), blockEccLen, ecc);
+		for (int j = 0; j < blockEccLen; j++)
+			result[len + static_cast<size_t>(j * numBlocks + i)] = ecc[j];
+	}
+}
+
+
+void QrCode::drawCodewords(const uint8_t *data, size_t len) {
+	if (len != static_cast<unsigned int>(getNumRawDataModules(version) / 8))
+		throw std::invalid_argument("Invalid argument");
+	
+	// Scatter each bit to the module precomputed by the zigzag scan. Data modules are
+	// light in the function pattern, so only the dark bits need to be written.
+	const uint32_t *pos = QrVersionTemplate::get(version).getCodewordBitPositions().data();
+	uint64_t *words = modules.getRow(0);
+	for (size_t i = 0; i < len; i++, pos += 8) {
+		unsigned int b = data[i];
+		for (int j = 0; j < 8; j++) {
+			uint32_t p = pos[j];
+			words[p >> 6] |= static_cast<uint64_t>((b >> (7 - j)) & 1) << (p & 63);
+		}
+	}
+	// If this QR Code has any remainder bits (0 to 7), they were assigned as
+	// 0/false/light by the function pattern and are left unchanged by this method
+}
+
+
+void QrCode::applyMask(int msk) {
+	if (msk < 0 || msk > 7)
+		throw std::domain_error("Mask value out of range");
+	const BitMatrix &pattern = QrVersionTemplate::get(version).getMaskPattern(msk);
+	size_t numWords = static_cast<size_t>(size) * static_cast<size_t>(modules.getWordsPerRow());
+	uint64_t *words = modules.getRow(0);
+	const uint64_t *pat = pattern.getRow(0);
+	for (size_t i = 0; i < numWords; i++)
+		words[i] ^= pat[i];
+}
+
+
+long QrCode::getPenaltyScore(BitMatrix &columns) const {
+	long result = 0;
+	int wordsPerRow = modules.getWordsPerRow();
+	
+	// Adjacent modules in row/column having same color, and finder-like patterns
+	modules.transposeTo(columns);
+	for (int i = 0; i < size; i++) {
+		result += getLinePenalty(modules.getRow(i));
+		result += getLinePenalty(columns.getRow(i));
 	}
 	
-	// Interleave (not concatenate) the bytes from every block into a single sequence
-	vector<uint8_t> result;
-	for (size_t i = 0; i < blocks.at(0).size(); i++) {
-		for (size_t j = 0; j < blocks.size(); j++) {
-			// Skip the padding byte in short blocks
-			if (i != static_cast<unsigned int>(shortBlockLen - blockEccLen) || j >= static_cast<unsigned int>(numShortBlocks))
-				result.push_back(blocks.at(j).at(i));
+	// 2*2 blocks of modules having same color. Bit x of sameRight is set iff modules x and x+1 of
+	// the row have the same color; only x < size - 1 is counted
+	uint64_t lastWordMask = ((size - 1) & 63) == 0 ? ~uint64_t(0) : (uint64_t(1) << ((size - 1) & 63)) - 1;
+	int lastWord = (size - 2) >> 6;
+	for (int y = 0; y < size - 1; y++) {
+		const uint64_t *upper = modules.getRow(y);
+		const uint64_t *lower = modules.getRow(y + 1);
+		for (int i = 0; i <= lastWord; i++) {
+			uint64_t upperNext = (upper[i] >> 1) | (i + 1 < wordsPerRow ? upper[i + 1] << 63 : 0);
+			uint64_t lowerNext = (lower[i] >> 1) | (i + 1 < wordsPerRow ? lower[i + 1] << 63 : 0);
+			uint64_t same = ~(upper[i] ^ upperNext) & ~(lower[i] ^ lowerNext) & ~(upper[i] ^ lower[i]);
+			if (i == lastWord)
+				same &= lastWordMask;
+			result += std::popcount(same) * PENALTY_N2;
 		}
 	}
-	assert(result.size() == static_cast<unsigned int>(rawCodewords));
+	
+	// Balance of dark and light modules
+	int dark = 0;
+	for (int y = 0; y < size; y++) {
+		const uint64_t *row = modules.getRow(y);
+		for (int i = 0; i < wordsPerRow; i++)
+			dark += std::popcount(row[i]);
+	}
+	int total = size * size;  // Note that size is odd, so dark/total != 1/2
+	// Compute the smallest integer k >= 0 such that (45-5k)% <= dark/total <= (55+5k)%
+	int k = static_cast<int>((std::abs(dark * 20L - total * 10L) + total - 1) / total) - 1;
+	assert(0 <= k && k <= 9);
+	result += k * PENALTY_N4;
+	assert(0 <= result && result <= 2568888L);  // Non-tight upper bound based on default values of PENALTY_N1, ..., N4
 	return result;
 }
 
 
-void QrCode::drawCodewords(const vector<uint8_t> &data) {
-	if (data.size() != static_cast<unsigned int>(getNumRawDataModules(version) / 8))
-		throw std::invalid_argument("Invalid argument");
+long QrCode::getLinePenalty(const uint64_t *line) const {
+	long result = 0;
+	std::array<int,7> runHistory = {};
+	bool runColor = false;  // The line is preceded by a light border
+	int runStart = 0;
 	
-	size_t i = 0;  // Bit index into the data
-	// Do the funny zigzag scan
-	for (int right = size - 1; right >= 1; right -= 2) {  // Index of right column in each column pair
-		if (right == 6)
-			right = 5;
-		for (int vert = 0; vert < size; vert++) {  // Vertical counter
-			for (int j = 0; j < 2; j++) {
-				size_t x = static_cast<size_t>(right - j);  // Actual x coordinate
-				bool upward = ((right + 1) & 2) == 0;
-				size_t y = static_cast<size_t>(upward ? size - 1 - vert : vert);  // Actual y coordinate
-				if (!isFunction.at(y).at(x) && i < data.size() * 8) {
-					modules.at(y).at(x) = getBit(data.at(i >> 3), 7 - static_cast<int>(i & 7));
-					i++;
-				}
-				// If this QR Code has any remainder bits (0 to 7), they were assigned as
-				// 0/false/light by the constructor and are left unchanged by this method
-			}
+	// Visit each color change, found as the set bits of line XOR (line shifted by one module)
+	int wordsPerRow = modules.getWordsPerRow();
+	for (int i = 0; i < wordsPerRow; i++) {
+		uint64_t changes = line[i] ^ (line[i] << 1 | (i > 0 ? line[i - 1] >> 63 : 0));
+		if (i == wordsPerRow - 1 && (size & 63) != 0)
+			changes &= (uint64_t(1) << (size & 63)) - 1;  // Ignore the change into the zero padding
+		for (; changes != 0; changes &= changes - 1) {
+			int x = i * 64 + std::countr_zero(changes);
+			int runLength = x - runStart;
+			if (runLength >= 5)
+				result += PENALTY_N1 + (runLength - 5);
+			finderPenaltyAddHistory(runLength, runHistory);
+			if (!runColor)
+				result += finderPenaltyCountPatterns(runHistory) * PENALTY_N3;
+			runColor = !runColor;
+			runStart = x;
 		}
 	}
-	assert(i == data.size() * 8);
+	int runLength = size - runStart;
+	if (runLength >= 5)
+		result += PENALTY_N1 + (runLength - 5);
+	result += finderPenaltyTerminateAndCount(runColor, runLength, runHistory) * PENALTY_N3;
+	return result;
 }
 
 
-void QrCode::applyMask(int msk) {
+void QrCode::applyMaskReference(int msk) {
 	if (msk < 0 || msk > 7)
 		throw std::domain_error("Mask value out of range");
-	size_t sz = static_cast<size_t>(size);
-	for (size_t y = 0; y < sz; y++) {
-		for (size_t x = 0; x < sz; x++) {
+	const BitMatrix &isFunc = QrVersionTemplate::get(version).getFunctionModules();
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
 			bool invert;
 			switch (msk) {
 				case 0:  invert = (x + y) % 2 == 0;                    break;
@@ -578,13 +1048,14 @@ void QrCode::applyMask(int msk) {
 				case 7:  invert = ((x + y) % 2 + x * y % 3) % 2 == 0;  break;
 				default:  throw std::logic_error("Unreachable");
 			}
-			modules.at(y).at(x) = modules.at(y).at(x) ^ (invert & !isFunction.at(y).at(x));
+			if (invert && !isFunc.get(x, y))
+				modules.set(x, y, !modules.get(x, y));
 		}
 	}
 }
 
 
-long QrCode::getPenaltyScore() const {
+long QrCode::getPenaltyScoreReference() const {
 	long result = 0;
 	
 	// Adjacent modules in row having same color, and finder-like patterns
@@ -645,9 +1116,9 @@ long QrCode::getPenaltyScore() const {
 	
 	// Balance of dark and light modules
 	int dark = 0;
-	for (const vector<bool> &row : modules) {
-		for (bool color : row) {
-			if (color)
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			if (module(x, y))
 				dark++;
 		}
 	}
@@ -661,40 +1132,112 @@ long QrCode::getPenaltyScore() const {
 }
 
 
-vector<int> QrCode::getAlignmentPatternPositions() const {
-	if (version == 1)
-		return vector<int>();
-	else {
-		int numAlign = version / 7 + 2;
-		int step = (version * 8 + numAlign * 3 + 5) / (numAlign * 4 - 4) * 2;
-		vector<int> result;
-		for (int i = 0, pos = size - 7; i < numAlign - 1; i++, pos -= step)
-			result.insert(result.begin(), pos);
-		result.insert(result.begin(), 6);
-		return result;
-	}
+int QrCode::getAlignmentPatternPositions(std::array<int,7> &result) const {
+	int numAlign = VERSION_TABLES.numAlign[version];
+	std::copy_n(VERSION_TABLES.alignPositions[version], numAlign, result.begin());
+	return numAlign;
 }
 
 
 int QrCode::getNumRawDataModules(int ver) {
 	if (ver < MIN_VERSION || ver > MAX_VERSION)
 		throw std::domain_error("Version number out of range");
-	int result = (16 * ver + 128) * ver + 64;
-	if (ver >= 2) {
-		int numAlign = ver / 7 + 2;
-		result -= (25 * numAlign - 10) * numAlign - 55;
-		if (ver >= 7)
-			result -= 36;
-	}
-	assert(208 <= result && result <= 29648);
-	return result;
+	return VERSION_TABLES.rawDataModules[ver];
 }
 
 
 int QrCode::getNumDataCodewords(int ver, Ecc ecl) {
-	return getNumRawDataModules(ver) / 8
-		- ECC_CODEWORDS_PER_BLOCK    [static_cast<int>(ecl)][ver]
-		* NUM_ERROR_CORRECTION_BLOCKS[static_cast<int>(ecl)][ver];
+	if (ver < MIN_VERSION || ver > MAX_VERSION)
+		throw std::domain_error("Version number out of range");
+	return VERSION_TABLES.dataCodewords[static_cast<int>(ecl)][ver];
+}
+
+
+int QrCode::getMaxBytePayload(int ver, Ecc ecl) {
+	int capacityBits = getNumDataCodewords(ver, ecl) * 8;  // Also checks the version
+	int ccbits = QrSegment::Mode::BYTE.numCharCountBits(ver);
+	return std::min((capacityBits - 4 - ccbits) / 8, (1 << ccbits) - 1);
+}
+
+
+QrCode::BlockLayout QrCode::getBlockLayout(int ver, Ecc ecl) {
+	if (ver < MIN_VERSION || ver > MAX_VERSION)
+		throw std::domain_error("Version number out of range");
+	BlockLayout result;
+	result.numBlocks = NUM_ERROR_CORRECTION_BLOCKS[static_cast<int>(ecl)][ver];
+	result.blockEccLen = ECC_CODEWORDS_PER_BLOCK[static_cast<int>(ecl)][ver];
+	result.rawCodewords = getNumRawDataModules(ver) / 8;
+	result.dataCodewords = getNumDataCodewords(ver, ecl);
+	result.numShortBlocks = result.numBlocks - result.rawCodewords % result.numBlocks;
+	result.shortBlockLen = result.rawCodewords / result.numBlocks;
+	return result;
+}
+
+
+QrCode::MaskScoringCheck QrCode::checkMaskScoring(int ver, Ecc ecl, int grids) {
+	if (ver < MIN_VERSION || ver > MAX_VERSION)
+		throw std::domain_error("Version number out of range");
+	using Clock = std::chrono::steady_clock;
+	MaskScoringCheck result = {grids, 0, {}, {}};
+	std::mt19937 rng(static_cast<unsigned int>(ver * 4 + static_cast<int>(ecl)));
+	const BitMatrix &isFunc = QrVersionTemplate::get(ver).getFunctionModules();
+	vector<uint8_t> data(static_cast<size_t>(getNumDataCodewords(ver, ecl)));
+	BitMatrix columns;
+	for (int g = 0; g < grids; g++) {
+		// Draw the grid with mask 0, then undo the mask
+		for (uint8_t &b : data)
+			b = static_cast<uint8_t>(rng());
+		QrCode grid(ver, ecl, data, 0);
+		grid.applyMask(0);
+		if (g % 2 == 1) {
+			static constexpr unsigned int DARK_PER_8[3] = {4, 1, 7};
+			unsigned int darkPer8 = DARK_PER_8[g / 2 % 3];
+			for (int y = 0; y < grid.size; y++) {
+				for (int x = 0; x < grid.size; x++) {
+					if (!isFunc.get(x, y))
+						grid.modules.set(x, y, rng() % 8 < darkPer8);
+				}
+			}
+		}
+		
+		std::array<long,8> penalties;
+		std::array<long,8> referencePenalties;
+		QrCode trial = grid;
+		Clock::time_point start = Clock::now();
+		for (int i = 0; i < 8; i++) {
+			trial.applyMask(i);
+			trial.drawFormatBits(i);
+			penalties[static_cast<size_t>(i)] = trial.getPenaltyScore(columns);
+			trial.applyMask(i);
+		}
+		Clock::time_point middle = Clock::now();
+		for (int i = 0; i < 8; i++) {
+			trial.applyMaskReference(i);
+			trial.drawFormatBits(i);
+			referencePenalties[static_cast<size_t>(i)] = trial.getPenaltyScoreReference();
+			trial.applyMaskReference(i);
+		}
+		Clock::time_point end = Clock::now();
+		result.time += middle - start;
+		result.referenceTime += end - middle;
+		
+		// Compare the masked grids and the scores, then the masks that build() would choose
+		for (int i = 0; i < 8; i++) {
+			QrCode masked = grid;
+			masked.applyMask(i);
+			trial = grid;
+			trial.applyMaskReference(i);
+			size_t numWords = static_cast<size_t>(grid.size) * static_cast<size_t>(grid.modules.getWordsPerRow());
+			if (!std::equal(masked.modules.getRow(0), masked.modules.getRow(0) + numWords, trial.modules.getRow(0)))
+				result.mismatches++;
+			if (penalties[static_cast<size_t>(i)] != referencePenalties[static_cast<size_t>(i)])
+				result.mismatches++;
+		}
+		if (std::min_element(penalties.cbegin(), penalties.cend()) - penalties.cbegin() !=
+				std::min_element(referencePenalties.cbegin(), referencePenalties.cend()) - referencePenalties.cbegin())
+			result.mismatches++;
+	}
+	return result;
 }
 
 
@@ -723,37 +1266,79 @@ vector<uint8_t> QrCode::reedSolomonComputeDivisor(int degree) {
 }
 
 
-vector<uint8_t> QrCode::reedSolomonComputeRemainder(const vector<uint8_t> &data, const vector<uint8_t> &divisor) {
-	vector<uint8_t> result(divisor.size());
-	for (uint8_t b : data) {  // Polynomial division
-		uint8_t factor = b ^ result.at(0);
-		result.erase(result.begin());
-		result.push_back(0);
-		for (size_t i = 0; i < result.size(); i++)
-			result.at(i) ^= reedSolomonMultiply(divisor.at(i), factor);
+void QrCode::reedSolomonComputeRemainder(const uint8_t *data, size_t len, int degree, uint8_t *result) {
+	if (degree < 1 || degree > MAX_ECC_CODEWORDS_PER_BLOCK)
+		throw std::domain_error("Degree out of range");
+	
+	static std::once_flag built[MAX_ECC_CODEWORDS_PER_BLOCK + 1];
+	static DivisorMultiples multiples[MAX_ECC_CODEWORDS_PER_BLOCK + 1];
+	DivisorMultiples &mul = multiples[degree];
+	std::call_once(built[degree], [degree, &mul]() {
+		const vector<uint8_t> divisor = reedSolomonComputeDivisor(degree);
+		for (int f = 0; f < 256; f++) {
+			for (int i = 0; i < 32; i++) {
+				mul.rows[f][i] = i < degree ?
+					reedSolomonMultiply(divisor[static_cast<size_t>(i)], static_cast<uint8_t>(f)) : 0;
+			}
+		}
+	});
+	
+	// Polynomial division as a shift register: each step drops the leading byte,
+	// shifts the rest towards the front, and adds a multiple of the divisor.
+#if defined(QRCODEGEN_RS_SSE2)
+	__m128i lo = _mm_setzero_si128();
+	__m128i hi = _mm_setzero_si128();
+	for (size_t i = 0; i < len; i++) {
+		uint8_t factor = static_cast<uint8_t>(data[i] ^ (_mm_cvtsi128_si32(lo) & 0xFF));
+		lo = _mm_or_si128(_mm_srli_si128(lo, 1), _mm_slli_si128(hi, 15));
+		hi = _mm_srli_si128(hi, 1);
+		lo = _mm_xor_si128(lo, _mm_load_si128(reinterpret_cast<const __m128i *>(&mul.rows[factor][ 0])));
+		hi = _mm_xor_si128(hi, _mm_load_si128(reinterpret_cast<const __m128i *>(&mul.rows[factor][16])));
 	}
-	return result;
+	alignas(16) uint8_t reg[32];
+	_mm_store_si128(reinterpret_cast<__m128i *>(&reg[ 0]), lo);
+	_mm_store_si128(reinterpret_cast<__m128i *>(&reg[16]), hi);
+#elif defined(QRCODEGEN_RS_NEON)
+	uint8x16_t lo = vdupq_n_u8(0);
+	uint8x16_t hi = vdupq_n_u8(0);
+	const uint8x16_t zero = vdupq_n_u8(0);
+	for (size_t i = 0; i < len; i++) {
+		uint8_t factor = static_cast<uint8_t>(data[i] ^ vgetq_lane_u8(lo, 0));
+		lo = vextq_u8(lo, hi, 1);
+		hi = vextq_u8(hi, zero, 1);
+		lo = veorq_u8(lo, vld1q_u8(&mul.rows[factor][ 0]));
+		hi = veorq_u8(hi, vld1q_u8(&mul.rows[factor][16]));
+	}
+	uint8_t reg[32];
+	vst1q_u8(&reg[ 0], lo);
+	vst1q_u8(&reg[16], hi);
+#else
+	uint8_t reg[32] = {};
+	for (size_t i = 0; i < len; i++) {
+		uint8_t factor = static_cast<uint8_t>(data[i] ^ reg[0]);
+		std::memmove(&reg[0], &reg[1], 31);
+		reg[31] = 0;
+		for (int j = 0; j < degree; j++)
+			reg[j] ^= mul.rows[factor][j];
+	}
+#endif
+	std::memcpy(result, reg, static_cast<size_t>(degree));
 }
 
 
 uint8_t QrCode::reedSolomonMultiply(uint8_t x, uint8_t y) {
-	// Russian peasant multiplication
-	int z = 0;
-	for (int i = 7; i >= 0; i--) {
-		z = (z << 1) ^ ((z >> 7) * 0x11D);
-		z ^= ((y >> i) & 1) * x;
-	}
-	assert(z >> 8 == 0);
-	return static_cast<uint8_t>(z);
+	if (x == 0 || y == 0)
+		return 0;
+	return GF.exp[GF.log[x] + GF.log[y]];
 }
 
 
 int QrCode::finderPenaltyCountPatterns(const std::array<int,7> &runHistory) const {
-	int n = runHistory.at(1);
+	int n = runHistory[1];
 	assert(n <= size * 3);
-	bool core = n > 0 && runHistory.at(2) == n && runHistory.at(3) == n * 3 && runHistory.at(4) == n && runHistory.at(5) == n;
-	return (core && runHistory.at(0) >= n * 4 && runHistory.at(6) >= n ? 1 : 0)
-	     + (core && runHistory.at(6) >= n * 4 && runHistory.at(0) >= n ? 1 : 0);
+	bool core = n > 0 && runHistory[2] == n && runHistory[3] == n * 3 && runHistory[4] == n && runHistory[5] == n;
+	return (core && runHistory[0] >= n * 4 && runHistory[6] >= n ? 1 : 0)
+	     + (core && runHistory[6] >= n * 4 && runHistory[0] >= n ? 1 : 0);
 }
 
 
@@ -769,10 +1354,10 @@ int QrCode::finderPenaltyTerminateAndCount(bool currentRunColor, int currentRunL
 
 
 void QrCode::finderPenaltyAddHistory(int currentRunLength, std::array<int,7> &runHistory) const {
-	if (runHistory.at(0) == 0)
+	if (runHistory[0] == 0)
 		currentRunLength += size;  // Add light border to initial run
 	std::copy_backward(runHistory.cbegin(), runHistory.cend() - 1, runHistory.end());
-	runHistory.at(0) = currentRunLength;
+	runHistory[0] = currentRunLength;
 }
 
 
@@ -789,23 +1374,206 @@ const int QrCode::PENALTY_N3 = 40;
 const int QrCode::PENALTY_N4 = 10;
 
 
-const int8_t QrCode::ECC_CODEWORDS_PER_BLOCK[4][41] = {
-	// Version: (note that index 0 is for padding, and is set to an illegal value)
-	//0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40    Error correction level
-	{-1,  7, 10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28, 30, 28, 28, 28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},  // Low
-	{-1, 10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28, 26, 26, 26, 26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28},  // Medium
-	{-1, 13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28, 28, 26, 30, 28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},  // Quartile
-	{-1, 17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28, 28, 26, 28, 30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30},  // High
-};
+/*---- Class QrVersionTemplate ----*/
+
+const QrVersionTemplate &QrVersionTemplate::get(int ver) {
+	if (ver < QrCode::MIN_VERSION || ver > QrCode::MAX_VERSION)
+		throw std::domain_error("Version number out of range");
+	static std::once_flag built[QrCode::MAX_VERSION + 1];
+	static std::unique_ptr<const QrVersionTemplate> templates[QrCode::MAX_VERSION + 1];
+	size_t i = static_cast<size_t>(ver);
+	std::call_once(built[i], [ver, i]() {
+		templates[i].reset(new QrVersionTemplate(ver));
+	});
+	return *templates[i];
+}
+
+
+QrVersionTemplate::QrVersionTemplate(int ver) :
+		version(ver) {
+	// Draw the function patterns on a blank QR Code, marking the function modules as they go
+	QrCode shell;
+	shell.version = ver;
+	shell.size = ver * 4 + 17;
+	shell.modules.reset(shell.size);
+	shell.isFunction.reset(shell.size);
+	shell.drawFunctionPatterns();
+	functionPattern = std::move(shell.modules);
+	functionModules = std::move(shell.isFunction);
+	int size = shell.size;
+	int wordsPerRow = functionModules.getWordsPerRow();
+	
+	// Mask patterns, restricted to data modules
+	for (int i = 0; i < 8; i++) {
+		BitMatrix &pat = maskPatterns[static_cast<size_t>(i)];
+		pat.reset(size);
+		for (int y = 0; y < size; y++) {
+			for (int x = 0; x < size; x++) {
+				bool invert;
+				switch (i) {
+					case 0:  invert = (x + y) % 2 == 0;                    break;
+					case 1:  invert = y % 2 == 0;                          break;
+					case 2:  invert = x % 3 == 0;                          break;
+					case 3:  invert = (x + y) % 3 == 0;                    break;
+					case 4:  invert = (x / 3 + y / 2) % 2 == 0;            break;
+					case 5:  invert = x * y % 2 + x * y % 3 == 0;          break;
+					case 6:  invert = (x * y % 2 + x * y % 3) % 2 == 0;    break;
+					case 7:  invert = ((x + y) % 2 + x * y % 3) % 2 == 0;  break;
+					default:  throw std::logic_error("Unreachable");
+				}
+				pat.set(x, y, invert && !functionModules.get(x, y));
+			}
+		}
+	}
+	
+	// Do the funny zigzag scan once, recording where each codeword bit goes
+	size_t numBits = static_cast<size_t>(QrCode::getNumRawDataModules(ver) / 8 * 8);
+	codewordBitPositions.reserve(numBits);
+	for (int right = size - 1; right >= 1; right -= 2) {  // Index of right column in each column pair
+		if (right == 6)
+			right = 5;
+		for (int vert = 0; vert < size; vert++) {  // Vertical counter
+			for (int j = 0; j < 2; j++) {
+				int x = right - j;  // Actual x coordinate
+				bool upward = ((right + 1) & 2) == 0;
+				int y = upward ? size - 1 - vert : vert;  // Actual y coordinate
+				if (!functionModules.get(x, y) && codewordBitPositions.size() < numBits) {
+					uint32_t word = static_cast<uint32_t>(y * wordsPerRow + (x >> 6));
+					codewordBitPositions.push_back(word << 6 | static_cast<uint32_t>(x & 63));
+				}
+			}
+		}
+	}
+	assert(codewordBitPositions.size() == numBits);
+}
+
+
+int QrVersionTemplate::getVersion() const {
+	return version;
+}
+
+
+int QrVersionTemplate::getSize() const {
+	return functionPattern.getSize();
+}
+
+
+const BitMatrix &QrVersionTemplate::getFunctionPattern() const {
+	return functionPattern;
+}
+
+
+const BitMatrix &QrVersionTemplate::getFunctionModules() const {
+	return functionModules;
+}
+
+
+const BitMatrix &QrVersionTemplate::getMaskPattern(int msk) const {
+	if (msk < 0 || msk > 7)
+		throw std::domain_error("Mask value out of range");
+	return maskPatterns[static_cast<size_t>(msk)];
+}
+
+
+const std::vector<uint32_t> &QrVersionTemplate::getCodewordBitPositions() const {
+	return codewordBitPositions;
+}
+
+
+
+/*---- Class QrEncoderContext ----*/
+
+QrEncoderContext::QrEncoderContext() :
+		trials(8, QrCode()) {
+	int maxSize = QrCode::MAX_VERSION * 4 + 17;
+	dataCodewords.reserve(static_cast<size_t>(QrCode::getNumDataCodewords(QrCode::MAX_VERSION, QrCode::Ecc::LOW)) * 8);
+	allCodewords.reserve(static_cast<size_t>(QrCode::getNumRawDataModules(QrCode::MAX_VERSION) / 8));
+	columns.reserve(maxSize);
+	for (size_t i = 0; i < trials.size(); i++) {
+		trials[i].modules.reserve(maxSize);
+		trialColumns[i].reserve(maxSize);
+	}
+}
+
+
+QrCode QrEncoderContext::makeOutput() {
+	QrCode result;
+	result.modules.reserve(QrCode::MAX_VERSION * 4 + 17);
+	return result;
+}
+
+
+void QrEncoderContext::encodeBinary(const uint8_t *data, size_t len, QrCode::Ecc ecl, QrCode &out,
+		int minVersion, int maxVersion, int mask, bool boostEcl, bool parallelMask) {
+	if (!(QrCode::MIN_VERSION <= minVersion && minVersion <= maxVersion && maxVersion <= QrCode::MAX_VERSION) || mask < -1 || mask > 7)
+		throw std::invalid_argument("Invalid value");
+	if (len > static_cast<unsigned int>(INT_MAX))
+		throw std::length_error("Data too long");
+	
+	// Same bit counts as QrSegment::getTotalBits() for one byte mode segment
+	const QrSegment::Mode &mode = QrSegment::Mode::BYTE;
+	std::array<int,3> usedBits;
+	for (size_t i = 0; i < usedBits.size(); i++) {
+		int ccbits = mode.numCharCountBits(i == 0 ? 1 : i == 1 ? 10 : 27);
+		bool fits = len < (size_t(1) << ccbits) && len <= static_cast<size_t>(INT_MAX - 4 - ccbits) / 8;
+		usedBits[i] = fits ? 4 + ccbits + static_cast<int>(len) * 8 : -1;
+	}
+	int version, dataUsedBits;
+	QrCode::selectVersion(usedBits, ecl, minVersion, maxVersion, boostEcl, version, dataUsedBits);
+	
+	// Write the segment header, data, terminator and padding straight into the codewords
+	size_t capacityBits = static_cast<size_t>(QrCode::getNumDataCodewords(version, ecl)) * 8;
+	BitBuffer &bb = dataCodewords;
+	bb.clear();
+	bb.appendBits(static_cast<uint32_t>(mode.getModeBits()), 4);
+	bb.appendBits(static_cast<uint32_t>(len), mode.numCharCountBits(version));
+	bb.appendBytes(data, len);
+	assert(bb.size() == static_cast<unsigned int>(dataUsedBits));
+	bb.appendBits(0, static_cast<int>(std::min<size_t>(4, capacityBits - bb.size())));
+	bb.appendBits(0, (8 - static_cast<int>(bb.size() % 8)) % 8);
+	for (uint8_t padByte = 0xEC; bb.size() < capacityBits; padByte ^= 0xEC ^ 0x11)
+		bb.appendBits(padByte, 8);
+	
+	out.version = version;
+	out.errorCorrectionLevel = ecl;
+	out.build(bb.getBytes().data(), bb.getBytes().size(), mask, parallelMask, this);
+}
+
+
+
+void QrEncoderContext::encodeSegments(const vector<QrSegment> &segs, QrCode::Ecc ecl, QrCode &out,
+		int minVersion, int maxVersion, int mask, bool boostEcl, bool parallelMask) {
+	if (!(QrCode::MIN_VERSION <= minVersion && minVersion <= maxVersion && maxVersion <= QrCode::MAX_VERSION) || mask < -1 || mask > 7)
+		throw std::invalid_argument("Invalid value");
+	
+	std::array<int,3> usedBits = {
+		QrSegment::getTotalBits(segs, 1),
+		QrSegment::getTotalBits(segs, 10),
+		QrSegment::getTotalBits(segs, 27),
+	};
+	int version, dataUsedBits;
+	QrCode::selectVersion(usedBits, ecl, minVersion, maxVersion, boostEcl, version, dataUsedBits);
+	
+	// Same bit string as QrCode::encodeSegments(), built in the reused codeword buffer
+	size_t capacityBits = static_cast<size_t>(QrCode::getNumDataCodewords(version, ecl)) * 8;
+	BitBuffer &bb = dataCodewords;
+	bb.clear();
+	for (const QrSegment &seg : segs) {
+		bb.appendBits(static_cast<uint32_t>(seg.getMode().getModeBits()), 4);
+		bb.appendBits(static_cast<uint32_t>(seg.getNumChars()), seg.getMode().numCharCountBits(version));
+		bb.appendBuffer(seg.getData());
+	}
+	assert(bb.size() == static_cast<unsigned int>(dataUsedBits));
+	bb.appendBits(0, static_cast<int>(std::min<size_t>(4, capacityBits - bb.size())));
+	bb.appendBits(0, (8 - static_cast<int>(bb.size() % 8)) % 8);
+	for (uint8_t padByte = 0xEC; bb.size() < capacityBits; padByte ^= 0xEC ^ 0x11)
+		bb.appendBits(padByte, 8);
+	
+	out.version = version;
+	out.errorCorrectionLevel = ecl;
+	out.build(bb.getBytes().data(), bb.getBytes().size(), mask, parallelMask, this);
+}
 
-const int8_t QrCode::NUM_ERROR_CORRECTION_BLOCKS[4][41] = {
-	// Version: (note that index 0 is for padding, and is set to an illegal value)
-	//0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40    Error correction level
-	{-1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 4,  4,  4,  4,  4,  6,  6,  6,  6,  7,  8,  8,  9,  9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25},  // Low
-	{-1, 1, 1, 1, 2, 2, 4, 4, 4, 5, 5,  5,  8,  9,  9, 10, 10, 11, 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49},  // Medium
-	{-1, 1, 1, 2, 2, 4, 4, 6, 6, 8, 8,  8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},  // Quartile
-	{-1, 1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},  // High
-};
 
 
 data_too_long::data_too_long(const std::string &msg) :
@@ -815,15 +1583,105 @@ data_too_long::data_too_long(const std::string &msg) :
 
 /*---- Class BitBuffer ----*/
 
-BitBuffer::BitBuffer()
-	: std::vector<bool>() {}
+namespace {
+
+uint64_t loadBigEndian64(const uint8_t *p) {
+	uint64_t result = 0;
+	for (int i = 0; i < 8; i++)
+		result = (result << 8) | p[i];
+	return result;
+}
+
+
+void storeBigEndian64(uint8_t *p, uint64_t val) {
+	for (int i = 7; i >= 0; i--, val >>= 8)
+		p[i] = static_cast<uint8_t>(val);
+}
+
+}
+
+
+BitBuffer::BitBuffer() :
+	bitLength(0) {}
 
 
 void BitBuffer::appendBits(std::uint32_t val, int len) {
 	if (len < 0 || len > 31 || val >> len != 0)
 		throw std::domain_error("Value out of range");
-	for (int i = len - 1; i >= 0; i--)  // Append bit by bit
-		this->push_back(((val >> i) & 1) != 0);
+	while (len > 0) {  // Fill the partial last byte, then whole bytes
+		int used = static_cast<int>(bitLength & 7);
+		if (used == 0)
+			bytes.push_back(0);
+		int n = std::min(8 - used, len);
+		len -= n;
+		bytes.back() |= static_cast<uint8_t>(((val >> len) & ((1U << n) - 1)) << (8 - used - n));
+		bitLength += static_cast<size_t>(n);
+	}
+}
+
+
+void BitBuffer::appendBytes(const uint8_t *data, size_t len) {
+	if (len == 0)
+		return;
+	int shift = static_cast<int>(bitLength & 7);
+	size_t start = bytes.size();
+	if (shift == 0) {
+		bytes.resize(start + len);
+		std::memcpy(&bytes[start], data, len);
+	} else {
+		// Each source byte straddles the partial last byte and a new one
+		bytes.resize(start + len);
+		uint8_t *dst = &bytes[start - 1];
+		uint8_t carry = *dst;
+		size_t i = 0;
+		for (; i + 8 <= len; i += 8) {
+			uint64_t w = loadBigEndian64(&data[i]);
+			storeBigEndian64(&dst[i], static_cast<uint64_t>(carry) << 56 | w >> shift);
+			carry = static_cast<uint8_t>(w << (8 - shift));
+		}
+		for (; i < len; i++) {
+			dst[i] = static_cast<uint8_t>(carry | data[i] >> shift);
+			carry = static_cast<uint8_t>(data[i] << (8 - shift));
+		}
+		dst[len] = carry;
+	}
+	bitLength += len * 8;
+}
+
+
+void BitBuffer::appendBuffer(const BitBuffer &other) {
+	size_t wholeBytes = other.bitLength / 8;
+	appendBytes(other.bytes.data(), wholeBytes);
+	int rest = static_cast<int>(other.bitLength & 7);
+	if (rest > 0)
+		appendBits(static_cast<uint32_t>(other.bytes[wholeBytes] >> (8 - rest)), rest);
+}
+
+
+size_t BitBuffer::size() const {
+	return bitLength;
+}
+
+
+bool BitBuffer::getBit(size_t index) const {
+	assert(index < bitLength);
+	return ((bytes[index >> 3] >> (7 - (index & 7))) & 1) != 0;
+}
+
+
+const vector<uint8_t> &BitBuffer::getBytes() const {
+	return bytes;
+}
+
+
+void BitBuffer::clear() {
+	bytes.clear();
+	bitLength = 0;
+}
+
+
+void BitBuffer::reserve(size_t numBits) {
+	bytes.reserve((numBits + 7) / 8);
 }
 
 }
@@ -24,6 +24,8 @@
 #pragma once
 
 #include <array>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <stdexcept>
 #include <string>
@@ -32,6 +34,129 @@
 
 namespace qrcodegen {
 
+/* 
+ * A square grid of bits, stored row-major and packed into 64-bit words. Each row starts on a
+ * word boundary; bit x of a row is bit (x % 64) of word (x / 64), and the padding bits at
+ * the end of every row are kept at zero so that whole-word operations need no masking.
+ * Coordinates passed to get() and set() are not range-checked.
+ */
+class BitMatrix final {
+	
+	/*---- Constructors ----*/
+	
+	// Creates an empty matrix of size 0.
+	public: BitMatrix();
+	
+	
+	// Creates a matrix of the given size with all bits cleared.
+	public: explicit BitMatrix(int sz);
+	
+	
+	/*---- Methods ----*/
+	
+	// Changes the size to sz and clears all bits, reusing the existing storage where possible.
+	public: void reset(int sz);
+	
+	
+	// Returns the width and height of this matrix.
+	public: int getSize() const;
+	
+	
+	// Makes room for a matrix of the given size, so that later resets up to that size do not allocate.
+	public: void reserve(int sz);
+	
+	
+	// Returns the number of 64-bit words in each row, which is (size + 63) / 64.
+	public: int getWordsPerRow() const;
+	
+	
+	// Returns the bit at the given coordinates, which must be in range.
+	public: bool get(int x, int y) const;
+	
+	
+	// Sets the bit at the given coordinates, which must be in range.
+	public: void set(int x, int y, bool val);
+	
+	
+	// Returns the words of row y, which must be in range.
+	public: const std::uint64_t *getRow(int y) const;
+	public: std::uint64_t *getRow(int y);
+	
+	
+	// Writes the transpose of this matrix into out, which is resized to match. Works on 64*64 bit blocks.
+	public: void transposeTo(BitMatrix &out) const;
+	
+	
+	/*---- Fields ----*/
+	
+	private: int size;
+	private: int wordsPerRow;
+	private: std::vector<std::uint64_t> words;
+	
+};
+
+
+
+/* 
+ * An appendable sequence of bits (0s and 1s). Mainly used by QrSegment.
+ * The bits are packed into bytes in big endian order, so a buffer whose length is a multiple
+ * of 8 is directly a sequence of QR Code codewords. Unused low bits of the last byte are zero.
+ */
+class BitBuffer final {
+	
+	/*---- Constructor ----*/
+	
+	// Creates an empty bit buffer (length 0).
+	public: BitBuffer();
+	
+	
+	
+	/*---- Methods ----*/
+	
+	// Appends the given number of low-order bits of the given value
+	// to this buffer. Requires 0 <= len <= 31 and val < 2^len.
+	public: void appendBits(std::uint32_t val, int len);
+	
+	
+	// Appends the given len bytes, most significant bit first. Copies with memcpy when this buffer
+	// ends on a byte boundary, and shifts 8 bytes at a time otherwise.
+	public: void appendBytes(const std::uint8_t *data, std::size_t len);
+	
+	
+	// Appends all the bits of the given buffer.
+	public: void appendBuffer(const BitBuffer &other);
+	
+	
+	// Returns the number of bits in this buffer.
+	public: std::size_t size() const;
+	
+	
+	// Returns the bit at the given index, which must be less than size().
+	public: bool getBit(std::size_t index) const;
+	
+	
+	// Returns the packed bytes, (size() + 7) / 8 of them.
+	public: const std::vector<std::uint8_t> &getBytes() const;
+	
+	
+	// Removes all bits, keeping the storage.
+	public: void clear();
+	
+	
+	// Makes room for the given number of bits without further allocation.
+	public: void reserve(std::size_t numBits);
+	
+	
+	
+	/*---- Fields ----*/
+	
+	private: std::vector<std::uint8_t> bytes;
+	private: std::size_t bitLength;
+	
+};
+
+
+
 /* 
  * A segment of character/binary/control data in a QR Code symbol.
  * Instances of this class are immutable.
@@ -160,7 +285,7 @@ class QrSegment final {
 	private: int numChars;
 	
 	/* The data bits of this segment. Accessed through getData(). */
-	private: std::vector<bool> data;
+	private: BitBuffer data;
 	
 	
 	/*---- Constructors (low level) ----*/
@@ -181,6 +306,14 @@ class QrSegment final {
 	public: QrSegment(const Mode &md, int numCh, std::vector<bool> &&dt);
 	
 	
+	/* 
+	 * Creates a new QR Code segment with the given attributes and data.
+	 * The character count (numCh) must agree with the mode and the bit buffer length,
+	 * but the constraint isn't checked. The given bit buffer is moved and stored.
+	 */
+	public: QrSegment(const Mode &md, int numCh, BitBuffer &&dt);
+	
+	
 	/*---- Methods ----*/
 	
 	/* 
@@ -198,7 +331,7 @@ class QrSegment final {
 	/* 
 	 * Returns the data bits of this segment.
 	 */
-	public: const std::vector<bool> &getData() const;
+	public: const BitBuffer &getData() const;
 	
 	
 	// (Package-private) Calculates the number of bits needed to encode the given segments at
@@ -217,6 +350,10 @@ class QrSegment final {
 
 
 
+class QrEncoderContext;
+
+
+
 /* 
  * A QR Code symbol, which is a type of two-dimension barcode.
  * Invented by Denso Wave and described in the ISO/IEC 18004 standard.
@@ -252,6 +389,15 @@ class QrCode final {
 	private: static int getFormatBits(Ecc ecl);
 	
 	
+	// Finds the smallest version in [minVersion, maxVersion] that holds the data, given the total
+	// bits the data needs at versions 1 to 9, 10 to 26 and 27 to 40 (-1 where it cannot be encoded),
+	// and raises ecl as far as boostEcl allows. Writes the version and the bits used at that version,
+	// or throws data_too_long. Shared by encodeSegments() and QrEncoderContext. Takes constant time,
+	// with a binary search of the capacity table in each of the three ranges.
+	private: static void selectVersion(const std::array<int,3> &usedBits, Ecc &ecl, int minVersion, int maxVersion,
+		bool boostEcl, int &version, int &dataUsedBits);
+	
+	
 	
 	/*---- Static factory functions (high level) ----*/
 	
@@ -283,12 +429,16 @@ class QrCode final {
 	 * may be higher than the ecl argument if it can be done without increasing the
 	 * version. The mask number is either between 0 to 7 (inclusive) to force that
 	 * mask, or -1 to automatically choose an appropriate mask (which may be slow).
+	 * Iff parallelMask is true and a large version is chosen, the automatic mask
+	 * choice scores the 8 candidates concurrently on a shared worker pool; the
+	 * result is identical to the serial choice.
 	 * This function allows the user to create a custom sequence of segments that switches
 	 * between modes (such as alphanumeric and byte) to encode text in less space.
 	 * This is a mid-level API; the high-level API is encodeText() and encodeBinary().
 	 */
 	public: static QrCode encodeSegments(const std::vector<QrSegment> &segs, Ecc ecl,
-		int minVersion=1, int maxVersion=40, int mask=-1, bool boostEcl=true);  // All optional parameters
+		int minVersion=1, int maxVersion=40, int mask=-1, bool boostEcl=true,
+		bool parallelMask=false);  // All optional parameters
 	
 	
 	
@@ -315,11 +465,12 @@ class QrCode final {
 	// Private grids of modules/pixels, with dimensions of size*size:
 	
 	// The modules of this QR Code (false = light, true = dark).
-	// Immutable after constructor finishes. Accessed through getModule().
-	private: std::vector<std::vector<bool> > modules;
+	// Immutable after constructor finishes. Accessed through getModule() and getRow().
+	private: BitMatrix modules;
 	
-	// Indicates function modules that are not subjected to masking. Discarded when constructor finishes.
-	private: std::vector<std::vector<bool> > isFunction;
+	// Indicates function modules that are not subjected to masking. Only filled in while a
+	// QrVersionTemplate is being drawn; empty in every finished QR Code.
+	private: BitMatrix isFunction;
 	
 	
 	
@@ -329,9 +480,24 @@ class QrCode final {
 	 * Creates a new QR Code with the given version number,
 	 * error correction level, data codeword bytes, and mask number.
 	 * This is a low-level API that most users should not use directly.
-	 * A mid-level API is the encodeSegments() function.
+	 * A mid-level API is the encodeSegments() function. See encodeSegments() for parallelMask.
 	 */
-	public: QrCode(int ver, Ecc ecl, const std::vector<std::uint8_t> &dataCodewords, int msk);
+	public: QrCode(int ver, Ecc ecl, const std::vector<std::uint8_t> &dataCodewords, int msk,
+		bool parallelMask=false);
+	
+	
+	// Creates an all-light version 1 placeholder. Only used for the reusable objects of QrEncoderContext.
+	private: QrCode();
+	
+	
+	// Draws this QR Code from the given data codewords, with version and errorCorrectionLevel already set.
+	// Scratch buffers are borrowed from ctx if it is not null, so that no memory is allocated once the
+	// context has warmed up; otherwise temporary buffers are used. Shared by both construction paths.
+	private: void build(const std::uint8_t *dataCodewords, std::size_t dataLen, int msk, bool parallelMask,
+		QrEncoderContext *ctx);
+	
+	friend class QrEncoderContext;
+	friend class QrVersionTemplate;
 	
 	
 	
@@ -370,6 +536,88 @@ class QrCode final {
 	
 	
 	
+	/*---- Public static capacity queries ----*/
+	
+	/* 
+	 * How the codewords of a QR Code are split into error correction blocks. The first
+	 * numShortBlocks blocks hold shortBlockLen codewords and the rest hold one more;
+	 * the last blockEccLen codewords of every block are error correction codewords.
+	 */
+	public: struct BlockLayout {
+		int numBlocks;
+		int numShortBlocks;
+		int shortBlockLen;
+		int blockEccLen;
+		int rawCodewords;  // Data and error correction codewords over all blocks
+		int dataCodewords;  // Data codewords over all blocks
+	};
+	
+	
+	/* 
+	 * Returns the number of data bits that can be stored in a QR Code of the given version number, after
+	 * all function modules are excluded. This includes remainder bits, so it might not be a multiple of 8.
+	 * The result is in the range [208, 29648]. Looked up in a table generated at compile time.
+	 */
+	public: static int getNumRawDataModules(int ver);
+	
+	
+	/* 
+	 * Returns the number of 8-bit data (i.e. not error correction) codewords contained in any
+	 * QR Code of the given version number and error correction level, with remainder bits discarded.
+	 * Looked up in a table generated at compile time.
+	 */
+	public: static int getNumDataCodewords(int ver, Ecc ecl);
+	
+	
+	/* 
+	 * Returns the largest number of bytes that a single byte mode segment can carry in a QR Code
+	 * of the given version and error correction level, which encodeBinary() and QrEncoderContext
+	 * fit into exactly that version. Takes constant time.
+	 */
+	public: static int getMaxBytePayload(int ver, Ecc ecl);
+	
+	
+	/* 
+	 * Returns the error correction block layout for the given version and error correction level.
+	 * Throws std::domain_error if the version is out of range.
+	 */
+	public: static BlockLayout getBlockLayout(int ver, Ecc ecl);
+	
+	
+	
+	/*---- Public static self check ----*/
+	
+	/* 
+	 * The outcome of checkMaskScoring(). A mismatch is a masked grid, a mask's penalty score
+	 * or an automatically chosen mask that differs from the per-module reference.
+	 */
+	public: struct MaskScoringCheck {
+		int grids;  // Grids scored, each with all 8 masks
+		int mismatches;
+		std::chrono::nanoseconds time;  // Masking and scoring with the word-at-a-time code
+		std::chrono::nanoseconds referenceTime;  // The same with the per-module reference
+	};
+	
+	
+	/* 
+	 * Masks and scores the given number of unmasked grids of the given version and error correction
+	 * level with all 8 masks, once with applyMask() and getPenaltyScore() and once with the original
+	 * per-module code, and compares the results. Even grids hold random data codewords with their
+	 * error correction; odd grids fill the data area with random modules, some mostly light or mostly
+	 * dark. The grids are the same on every call. Throws std::domain_error if the version is out of range.
+	 */
+	public: static MaskScoringCheck checkMaskScoring(int ver, Ecc ecl, int grids);
+	
+	
+	/* 
+	 * Returns the packed modules of row y, which must be in the range [0, size). The row consists of
+	 * (size + 63) / 64 words; module x is bit (x % 64) of word (x / 64), and bits past the end of the
+	 * row are zero. The pointer stays valid for the lifetime of this QR Code.
+	 */
+	public: const std::uint64_t *getRow(int y) const;
+	
+	
+	
 	/*---- Private helper methods for constructor: Drawing function modules ----*/
 	
 	// Reads this object's version field, and draws and marks all function modules.
@@ -396,8 +644,8 @@ class QrCode final {
 	private: void drawAlignmentPattern(int x, int y);
 	
 	
-	// Sets the color of a module and marks it as a function module.
-	// Only used by the constructor. Coordinates must be in bounds.
+	// Sets the color of a module, and marks it as a function module if isFunction is in use.
+	// Only used by the constructor and QrVersionTemplate. Coordinates must be in bounds.
 	private: void setFunctionModule(int x, int y, bool isDark);
 	
 	
@@ -407,17 +655,19 @@ class QrCode final {
 	
 	/*---- Private helper methods for constructor: Codewords and masking ----*/
 	
-	// Returns a new byte string representing the given data with the appropriate error correction
-	// codewords appended to it, based on this object's version and error correction level.
-	private: std::vector<std::uint8_t> addEccAndInterleave(const std::vector<std::uint8_t> &data) const;
+	// Writes the given len data bytes with the appropriate error correction codewords interleaved into
+	// result, based on this object's version and error correction level. The result must have room
+	// for getNumRawDataModules(version) / 8 bytes.
+	private: void addEccAndInterleave(const std::uint8_t *data, std::size_t len, std::uint8_t *result) const;
 	
 	
-	// Draws the given sequence of 8-bit codewords (data and error correction) onto the entire
-	// data area of this QR Code. Function modules need to be marked off before this is called.
-	private: void drawCodewords(const std::vector<std::uint8_t> &data);
+	// Draws the given sequence of len 8-bit codewords (data and error correction) onto the entire
+	// data area of this QR Code, by scattering the bits through the version template's index map.
+	// The modules must hold the template's function pattern, with all data modules light.
+	private: void drawCodewords(const std::uint8_t *data, std::size_t len);
 	
 	
-	// XORs the codeword modules in this QR Code with the given mask pattern.
+	// XORs the codeword modules in this QR Code with the given mask pattern, a whole word at a time.
 	// The function modules must be marked and the codeword bits must be drawn
 	// before masking. Due to the arithmetic of XOR, calling applyMask() with
 	// the same mask value a second time will undo the mask. A final well-formed
@@ -427,41 +677,43 @@ class QrCode final {
 	
 	// Calculates and returns the penalty score based on state of this QR Code's current modules.
 	// This is used by the automatic mask choice algorithm to find the mask pattern that yields the lowest score.
-	private: long getPenaltyScore() const;
+	// Rows are scored directly from the packed words; columns are scored on a transposed copy, kept in columns.
+	private: long getPenaltyScore(BitMatrix &columns) const;
 	
 	
+	// Returns the run-length (N1) and finder-like (N3) penalty of one packed line of modules
+	// (a row, or a column of the transposed grid). A helper function for getPenaltyScore().
+	private: long getLinePenalty(const std::uint64_t *line) const;
 	
-	/*---- Private helper functions ----*/
 	
-	// Returns an ascending list of positions of alignment patterns for this version number.
-	// Each position is in the range [0,177), and are used on both the x and y axes.
-	// This could be implemented as lookup table of 40 variable-length lists of unsigned bytes.
-	private: std::vector<int> getAlignmentPatternPositions() const;
+	// The original per-module versions of applyMask() and getPenaltyScore(), which test every module
+	// against the mask formula and walk every row and column. Only used by checkMaskScoring().
+	private: void applyMaskReference(int msk);
+	private: long getPenaltyScoreReference() const;
 	
 	
-	// Returns the number of data bits that can be stored in a QR Code of the given version number, after
-	// all function modules are excluded. This includes remainder bits, so it might not be a multiple of 8.
-	// The result is in the range [208, 29648]. This could be implemented as a 40-entry lookup table.
-	private: static int getNumRawDataModules(int ver);
 	
+	/*---- Private helper functions ----*/
 	
-	// Returns the number of 8-bit data (i.e. not error correction) codewords contained in any
-	// QR Code of the given version number and error correction level, with remainder bits discarded.
-	// This stateless pure function could be implemented as a (40*4)-cell lookup table.
-	private: static int getNumDataCodewords(int ver, Ecc ecl);
+	// Writes the ascending list of positions of alignment patterns for this version number to result,
+	// and returns how many there are (0 to 7). Each position is in the range [0,177), and are used on
+	// both the x and y axes. Looked up in a table generated at compile time.
+	private: int getAlignmentPatternPositions(std::array<int,7> &result) const;
 	
 	
-	// Returns a Reed-Solomon ECC generator polynomial for the given degree. This could be
-	// implemented as a lookup table over all possible parameter values, instead of as an algorithm.
+	// Returns a Reed-Solomon ECC generator polynomial for the given degree.
+	// Only used to build the cached per-degree tables behind reedSolomonComputeRemainder().
 	private: static std::vector<std::uint8_t> reedSolomonComputeDivisor(int degree);
 	
 	
-	// Returns the Reed-Solomon error correction codeword for the given data and divisor polynomials.
-	private: static std::vector<std::uint8_t> reedSolomonComputeRemainder(const std::vector<std::uint8_t> &data, const std::vector<std::uint8_t> &divisor);
+	// Computes the Reed-Solomon remainder of the len data bytes divided by the generator polynomial
+	// of the given degree (at most MAX_ECC_CODEWORDS_PER_BLOCK), and writes its degree bytes to result.
+	// Runs as a shift register over a cached table of divisor multiples, using SSE2 or NEON where available.
+	private: static void reedSolomonComputeRemainder(const std::uint8_t *data, std::size_t len, int degree, std::uint8_t *result);
 	
 	
 	// Returns the product of the two given field elements modulo GF(2^8/0x11D).
-	// All inputs are valid. This could be implemented as a 256*256 lookup table.
+	// All inputs are valid. Implemented with log/antilog tables.
 	private: static std::uint8_t reedSolomonMultiply(std::uint8_t x, std::uint8_t y);
 	
 	
@@ -490,6 +742,13 @@ class QrCode final {
 	// The maximum version number supported in the QR Code Model 2 standard.
 	public: static constexpr int MAX_VERSION = 40;
 	
+	// The smallest version for which a parallelMask request actually uses the worker pool.
+	// Below this, scoring a mask costs less than handing it to another thread.
+	public: static constexpr int PARALLEL_MASK_MIN_VERSION = 20;
+	
+	
+	// The largest number of error correction codewords in one block, over all versions and levels.
+	private: static constexpr int MAX_ECC_CODEWORDS_PER_BLOCK = 30;
 	
 	// For use in getPenaltyScore(), when evaluating which mask is best.
 	private: static const int PENALTY_N1;
@@ -498,51 +757,172 @@ class QrCode final {
 	private: static const int PENALTY_N4;
 	
 	
-	private: static const std::int8_t ECC_CODEWORDS_PER_BLOCK[4][41];
-	private: static const std::int8_t NUM_ERROR_CORRECTION_BLOCKS[4][41];
 	
 };
 
 
 
-/*---- Public exception class ----*/
-
 /* 
- * Thrown when the supplied data does not fit any QR Code version. Ways to handle this exception include:
- * - Decrease the error correction level if it was greater than Ecc::LOW.
- * - If the encodeSegments() function was called with a maxVersion argument, then increase
- *   it if it was less than QrCode::MAX_VERSION. (This advice does not apply to the other
- *   factory functions because they search all versions up to QrCode::MAX_VERSION.)
- * - Split the text data into better or optimal segments in order to reduce the number of bits required.
- * - Change the text or binary data to be shorter.
- * - Change the text to fit the character set of a particular segment mode (e.g. alphanumeric).
- * - Propagate the error upward to the caller/user.
+ * The parts of a QR Code that depend only on its version: the function patterns (finder,
+ * alignment and timing patterns, version information and the always-dark module), the grid
+ * marking which modules are function modules, the 8 mask patterns restricted to data modules,
+ * and the position of every codeword bit in the zigzag placement order. Each template is built
+ * once, on first use, and shared for the life of the program. Instances are immutable, so any
+ * number of threads can use them at once.
  */
-class data_too_long : public std::length_error {
+class QrVersionTemplate final {
 	
-	public: explicit data_too_long(const std::string &msg);
+	/*---- Static factory function ----*/
+	
+	/* 
+	 * Returns the template for the given version number, which must be
+	 * in the range [1, 40]. The first call for a version builds it.
+	 */
+	public: static const QrVersionTemplate &get(int ver);
+	
+	
+	/*---- Instance methods ----*/
+	
+	/* 
+	 * Returns this template's version number, in the range [1, 40].
+	 */
+	public: int getVersion() const;
+	
+	
+	/* 
+	 * Returns this template's size in modules, equal to version * 4 + 17.
+	 */
+	public: int getSize() const;
+	
+	
+	/* 
+	 * Returns the grid with every function module drawn and every data module light.
+	 * The format information modules hold placeholder values, which the
+	 * encoder overwrites once the error correction level and mask are known.
+	 */
+	public: const BitMatrix &getFunctionPattern() const;
+	
+	
+	/* 
+	 * Returns the grid where a set bit marks a function module (one not subject to masking).
+	 */
+	public: const BitMatrix &getFunctionModules() const;
+	
+	
+	/* 
+	 * Returns the modules inverted by the given mask pattern, which must be in the
+	 * range [0, 7]. Function modules are already cleared from the returned grid.
+	 */
+	public: const BitMatrix &getMaskPattern(int msk) const;
+	
+	
+	/* 
+	 * Returns the position of each codeword bit in placement order, where entry i is for bit
+	 * (7 - i % 8) of codeword i / 8. There are getNumRawDataModules(version) / 8 * 8 entries; the
+	 * remainder bits (0 to 7) are not listed and stay light. An entry p refers to bit (p % 64) of
+	 * word (p / 64) of a grid laid out like getFunctionPattern(), counting the words of all rows
+	 * contiguously from row 0: that is module x = (p / 64) % wordsPerRow * 64 + p % 64 and
+	 * y = (p / 64) / wordsPerRow.
+	 */
+	public: const std::vector<std::uint32_t> &getCodewordBitPositions() const;
+	
+	
+	/*---- Constructor (private) ----*/
+	
+	// Draws the template for the given version, which must be in range. Only used by get().
+	private: explicit QrVersionTemplate(int ver);
+	
+	
+	/*---- Fields ----*/
+	
+	private: int version;
+	private: BitMatrix functionPattern;
+	private: BitMatrix functionModules;
+	private: std::array<BitMatrix,8> maskPatterns;
+	private: std::vector<std::uint32_t> codewordBitPositions;
 	
 };
 
 
 
 /* 
- * An appendable sequence of bits (0s and 1s). Mainly used by QrSegment.
+ * Reusable working memory for encoding QR Codes at a high rate. A context owns every buffer the
+ * encoder needs, sized for MAX_VERSION when the context is created, and encodes into QR Code
+ * objects whose module storage is reused as well. After construction, encoding byte data into an
+ * output obtained from makeOutput() performs no heap allocation (error paths excepted).
+ * A context must not be used by several threads at once; give each encoding thread its own.
  */
-class BitBuffer final : public std::vector<bool> {
+class QrEncoderContext final {
 	
 	/*---- Constructor ----*/
 	
-	// Creates an empty bit buffer (length 0).
-	public: BitBuffer();
+	public: QrEncoderContext();
 	
 	
+	/*---- Methods ----*/
 	
-	/*---- Method ----*/
+	/* 
+	 * Returns an all-light placeholder QR Code with storage reserved for MAX_VERSION,
+	 * meant to be passed repeatedly as the output of encodeBinary().
+	 */
+	public: static QrCode makeOutput();
 	
-	// Appends the given number of low-order bits of the given value
-	// to this buffer. Requires 0 <= len <= 31 and val < 2^len.
-	public: void appendBits(std::uint32_t val, int len);
+	
+	/* 
+	 * Encodes the given len bytes in byte mode into out, replacing its previous contents. The
+	 * parameters have the same meaning as in QrCode::encodeSegments(), and the result is identical
+	 * to QrCode::encodeSegments() called with a single QrSegment::makeBytes() segment.
+	 */
+	public: void encodeBinary(const std::uint8_t *data, std::size_t len, QrCode::Ecc ecl, QrCode &out,
+		int minVersion=1, int maxVersion=40, int mask=-1, bool boostEcl=true, bool parallelMask=false);
+	
+	
+	/* 
+	 * Encodes the given segments into out, replacing its previous contents. The result is identical
+	 * to QrCode::encodeSegments() with the same arguments, but the data codewords, the grid and the
+	 * mask trials reuse this context's buffers; only the segments themselves hold memory of their own.
+	 */
+	public: void encodeSegments(const std::vector<QrSegment> &segs, QrCode::Ecc ecl, QrCode &out,
+		int minVersion=1, int maxVersion=40, int mask=-1, bool boostEcl=true, bool parallelMask=false);
+	
+	
+	/*---- Fields ----*/
+	
+	// Data codewords of the code being encoded, including segment headers and padding.
+	private: BitBuffer dataCodewords;
+	
+	// Data and ECC codewords after interleaving.
+	private: std::vector<std::uint8_t> allCodewords;
+	
+	// Transposed grid for scoring columns in getPenaltyScore().
+	private: BitMatrix columns;
+	
+	// Per-mask copies of the grid and their column scratch, for parallel mask evaluation.
+	private: std::vector<QrCode> trials;
+	private: std::array<BitMatrix,8> trialColumns;
+	
+	friend class QrCode;
+	
+};
+
+
+
+/*---- Public exception class ----*/
+
+/* 
+ * Thrown when the supplied data does not fit any QR Code version. Ways to handle this exception include:
+ * - Decrease the error correction level if it was greater than Ecc::LOW.
+ * - If the encodeSegments() function was called with a maxVersion argument, then increase
+ *   it if it was less than QrCode::MAX_VERSION. (This advice does not apply to the other
+ *   factory functions because they search all versions up to QrCode::MAX_VERSION.)
+ * - Split the text data into better or optimal segments in order to reduce the number of bits required.
+ * - Change the text or binary data to be shorter.
+ * - Change the text to fit the character set of a particular segment mode (e.g. alphanumeric).
+ * - Propagate the error upward to the caller/user.
+ */
+class data_too_long : public std::length_error {
+	
+	public: explicit data_too_long(const std::string &msg);
 	
 };
 